@@ -6,12 +6,71 @@
 #define DEMO_DEFAULT_VALUE WOKWI  // Whether app launches in demo mode
 
 #define DIGITS_TYPE_CLOCK WOKWI   // A clock-type digits display with a single colon instead of 4 decimal points
+#define DIGITS_BIT_DELAY_US 100   // TM1637 bit delay; the library default, slow enough for the filter caps on most modules
 
 #define BOARD_REV 3
 
+#define SERIAL_DEFAULT_BAUD 10400
+
+// KWP2000 baud to request after init via StartDiagnosticSession (0 = stay at default),
+// e.g. 19200.  Any error ends the session, so the next init is at the default baud;
+// after a few such drops, or one refusal, the faster baud isn't asked for again.
+#define OBD_HIGH_SPEED_BAUD 0
+
+// Refresh gauges covered by menu_blockFields from KWP record blocks (service 0x21)
+// instead of one mode 01 request per value.  Block layouts are ECU-specific, so the
+// table ships empty; fill it in for your ECU before enabling this.
+#define OBD_BLOCK_READ_ENABLED false
+
+// Stream every K-line byte (with edge timings) and flip dump as framed binary
+// records on the USB serial port, see VStream.h for the format
+#define STREAM_CAPTURE_ENABLED false
+
+// Send a telemetry record (pid values, totals, timing and error counts) each update cycle
+#define STREAM_TELEMETRY_ENABLED false
+
+#define STREAM_ENABLED (STREAM_CAPTURE_ENABLED || STREAM_TELEMETRY_ENABLED)
+#define STREAM_BAUD 500000       // 0% error at 16MHz; a byte record is ~17 bytes per K-line byte
+
+// Accept ELM327 AT commands and hex requests on the USB serial port and forward them
+// through the gauge's own connection; gauges then show values from the forwarded traffic
+#define ELM_BRIDGE_ENABLED false
+#define ELM_BAUD 38400
+
+// Line-based console on the USB serial port for scripted control and diagnostics,
+// see VConsole.h for the commands
+#define CONSOLE_ENABLED false
+#define CONSOLE_BAUD 115200
+
+// Time the hot paths listed in VBench.h at power-on and print the results on the USB
+// serial port before the gauge starts
+#define BENCH_ENABLED false
+#define BENCH_BAUD 115200
+
+// Keep per-pid and per-protocol histograms of ECU response timing (P2, P1, whole
+// transaction) and error classes, see VObd.h; ~300 bytes of SRAM.  Shown by the console
+#define OBD_STATS_ENABLED false
+
+// Time loop phases (bus transmit/receive, display updates, EEPROM writes, titles) with
+// min/avg/max counters, see VProfile.h; shown from the SPEC menu and the console
+#define PROFILE_ENABLED false
+
+// Per-cycle timing and pid samples for the stream and the console's `stats`; the host
+// drivers time the gauge by them
+#if STREAM_TELEMETRY_ENABLED || CONSOLE_ENABLED || !defined(__AVR__)
+  #define TELEMETRY_ENABLED true
+#else
+  #define TELEMETRY_ENABLED false
+#endif
+
+#if (ELM_BRIDGE_ENABLED + STREAM_ENABLED + CONSOLE_ENABLED + BENCH_ENABLED) > 1
+  #error "The ELM327 bridge, the binary stream, the console and the benchmarks each need the hardware UART"
+#endif
+
 // TODO: Revisit to make these dynamic
-#define SERIAL_MAX_BYTES 13
-#define SERIAL_MAX_FLIPS (SERIAL_MAX_BYTES*10)
+#define SERIAL_MAX_BYTES 48      // Longest message received (block reads), bytes are decoded as they arrive
+#define SERIAL_BYTE_FLIPS 10     // Edges in one start + 8 data + stop bit frame
+#define SERIAL_MAX_FLIPS (13*SERIAL_BYTE_FLIPS)  // Raw edges kept for flip dumps
 
 #if BOARD_REV == 1
   #define BATTERY_VOLTAGE_DIVIDE (30.0+10)/10 // REV 1 board
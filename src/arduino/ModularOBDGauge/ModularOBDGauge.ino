@@ -1,7 +1,14 @@
 #include "Environment.h"
+#include "VButtons.h"
 #include "VDigits.h"
 #include "VDisplayables.h"
 #include "VRing.h"
+#include "VStream.h"
+#include "VElm.h"
+#include "VConsole.h"
+#include "VBench.h"
+#include "VProfile.h"
+#include "VFormat.h"
 
 //
 // MODULAROBDGAUGE.INO
@@ -30,18 +37,33 @@
 #define SWITCH_PIN_2        8
 #define LED_PIN             13
 
+VButtons vbuttons;
 VDigits vdigits;
 VDisplayables vdisplayables;
 VRing vring;
+#if STREAM_ENABLED
+VStream vstream;
+#endif
+#if ELM_BRIDGE_ENABLED
+VElm velm;
+#endif
+#if CONSOLE_ENABLED
+VConsole vconsole;
+#endif
+#if BENCH_ENABLED
+VBench vbench;
+#endif
 
 // Forward declarations
 bool ap_isControlsButton1Down();
 bool ap_isControlsButton2Down();
+bool ap_readControlsButtonEvent(struct ButtonEvent *event);
 void ap_menuItemHighlight(int current, char color, int count, MenuDataSource *ds);
 void ap_menuItemShowTitle(char *title);
 int  ap_getDisplayBarCount(void);
 void ap_setDisplayBarColor(int index, unsigned char color);
 void ap_showDisplayBar();
+void ap_deferDisplayBar(bool deferred);
 void ap_showDisplayFloatValue(float num, int decimals, int suffix, bool addPlus);
 void ap_showDisplayStatusState(bool connecting, bool resetting, int errorCount, int connectionErrorCount, int protocolIndex);
 void ap_showDisplayStatusString(char *text);
@@ -49,11 +71,39 @@ void ap_showDisplayStatusString_P(char *ptext);
 void ap_showSweep(char color, int mode);
 void ap_setDisplayBrightness(int brightness);
 void ap_smartDelay(unsigned long wait);
+void ap_idle();
+void ap_captureByte(unsigned long time, unsigned char value, unsigned char flags, unsigned long *flips, int flipCount);
+void ap_captureFlips(unsigned long *flips, int flipCount);
+void ap_serviceStream();
+void ap_sendTelemetry(struct DisplayableTelemetry *telemetry);
+int  ap_bridgeRequest(int protocol, unsigned char *data, int length, unsigned char *response, int maxBytes);
+int  ap_bridgeRequestPids(int protocol, unsigned char *pids, int count, long *values);
+unsigned char ap_bridgeGetNackCode(void);
+int  ap_bridgeGetPidDataLength(unsigned char pid);
+int  ap_bridgeGetProtocol(void);
+void ap_bridgeDisconnect(void);
+float ap_bridgeGetBatteryVolts(void);
+int  ap_consoleGetItemCount(void);
+int  ap_consoleGetCurrentItem(void);
+void ap_consoleSelectItem(int index);
+char *ap_consoleGetItemName(int index);
+bool ap_consoleIsItemHidden(int index);
+int  ap_consoleRequest(unsigned char *data, int length, unsigned char *response, int maxBytes);
+int  ap_consoleReadPersistedState(int offset, unsigned char *bytes, int count);
+int  ap_consoleWritePersistedState(int offset, unsigned char *bytes, int count);
+void ap_consoleLoadPersistedState(void);
+void ap_consoleGetTelemetry(struct DisplayableTelemetry *telemetry);
+bool ap_consoleGetMode(int mode);
+void ap_consoleToggleMode(int mode);
+struct ObdStats *ap_consoleGetObdStats(void);
+void ap_consoleResetObdStats(void);
 
 struct MenuControlsProvider app_menuControlsProvider = {
   ap_isControlsButton1Down,
   ap_isControlsButton2Down,
-  ap_smartDelay
+  ap_readControlsButtonEvent,
+  ap_smartDelay,
+  ap_idle
 };
 
 struct MenuDisplayProvider app_menuDisplayProvider = {
@@ -61,6 +111,39 @@ struct MenuDisplayProvider app_menuDisplayProvider = {
   ap_menuItemShowTitle,
 };
 
+struct SerialCaptureProvider app_serialCaptureProvider = {
+  ap_captureByte,
+  ap_captureFlips,
+  ap_serviceStream,
+};
+
+struct ElmBridgeProvider app_elmBridgeProvider = {
+  ap_bridgeRequest,
+  ap_bridgeRequestPids,
+  ap_bridgeGetNackCode,
+  ap_bridgeGetPidDataLength,
+  ap_bridgeGetProtocol,
+  ap_bridgeDisconnect,
+  ap_bridgeGetBatteryVolts,
+};
+
+struct ConsoleProvider app_consoleProvider = {
+  ap_consoleGetItemCount,
+  ap_consoleGetCurrentItem,
+  ap_consoleSelectItem,
+  ap_consoleGetItemName,
+  ap_consoleIsItemHidden,
+  ap_consoleRequest,
+  ap_consoleReadPersistedState,
+  ap_consoleWritePersistedState,
+  ap_consoleLoadPersistedState,
+  ap_consoleGetTelemetry,
+  ap_consoleGetMode,
+  ap_consoleToggleMode,
+  ap_consoleGetObdStats,
+  ap_consoleResetObdStats,
+};
+
 struct DisplayablesOutputProvider app_displayablesOutputProvider = {
   ap_getDisplayBarCount,
   ap_setDisplayBarColor,
@@ -71,14 +154,15 @@ struct DisplayablesOutputProvider app_displayablesOutputProvider = {
   ap_showDisplayStatusString_P,
   ap_showSweep,
   ap_setDisplayBrightness,
+  ap_sendTelemetry,
+  ap_deferDisplayBar,
 };
 
 void setup() {
  
   // Setup
   pinMode(POWER_PIN, INPUT);
-  pinMode(SWITCH_PIN_1, INPUT_PULLUP);
-  pinMode(SWITCH_PIN_2, INPUT_PULLUP);
+  vbuttons.setup(SWITCH_PIN_1, SWITCH_PIN_2);
   vdigits.setup(DIGITS_PIN_CLK, DIGITS_PIN_DIO);
   vring.setup(RING_PIN_CONTROL, RING_LIGHT_COUNT, RING_BRIGHTNESS, RING_ROTATION_OFFSET);
 
@@ -90,10 +174,38 @@ void setup() {
   vring.clear();
 
   vdisplayables.setup(OBD_IN_PIN, OBD_OUT_PIN, POWER_ANALOG_PIN, &app_displayablesOutputProvider, &app_menuDisplayProvider, &app_menuControlsProvider);
+
+#if STREAM_ENABLED
+  // Also services the stream while polling the bus
+  vstream.setup(STREAM_BAUD);
+  vdisplayables.setCaptureProvider(&app_serialCaptureProvider);
+#endif
+
+#if ELM_BRIDGE_ENABLED
+  vdisplayables.setBridgeMode(true);
+  velm.setup(ELM_BAUD, &app_elmBridgeProvider);
+#endif
+
+#if CONSOLE_ENABLED
+  vconsole.setup(CONSOLE_BAUD, &app_consoleProvider);
+#endif
+
+#if BENCH_ENABLED
+  Serial.begin(BENCH_BAUD);
+  vbench.setup(micros, &app_displayablesOutputProvider);
+  vbench.run();
+#endif
 }
 
 void loop() {
+#if CONSOLE_ENABLED
+  // Between updates, so commands may use the bus
+  vconsole.poll(true);
+#endif
+
+  PROFILE_BEGIN(start);
   vdisplayables.mainLoop();
+  PROFILE_END(PROFILE_PHASE_LOOP, start);
 }
 
 ///////////////////////////////////////////////////////////////
@@ -104,38 +216,18 @@ void loop() {
 // Private
 //------------------------------------------------------
 
-#define BUTTON_DEBOUNCE_COUNT 12
-static bool ap_button1LastState = false;
-static bool ap_button2LastState = false;
-
 bool ap_isControlsButton1Down() {
-  bool state = !digitalRead(SWITCH_PIN_1);
+  bool state = vbuttons.isDown(0);
   digitalWrite(LED_PIN, state);
-
-  if (state != ap_button1LastState) {
-    for (int i=0; i<BUTTON_DEBOUNCE_COUNT; i++) {
-      if (!digitalRead(SWITCH_PIN_1) != state) return ap_button1LastState;
-      ap_smartDelay(1);
-    }
-    return ap_button1LastState = state;
-  }
-
-  // Kind of hacky, but ping when reading buttons to keep connection alive
-  vdisplayables.ping();
-
-  return ap_button1LastState;
+  return state;
 }
 
 bool ap_isControlsButton2Down() {
-  bool state = !digitalRead(SWITCH_PIN_2);
-  if (state != ap_button2LastState) {
-    for (int i=0; i<BUTTON_DEBOUNCE_COUNT; i++) {
-      if (!digitalRead(SWITCH_PIN_2) != state) return ap_button2LastState;
-      ap_smartDelay(1);
-    }
-    return ap_button2LastState = state;
-  }
-  return ap_button2LastState;
+  return vbuttons.isDown(1);
+}
+
+bool ap_readControlsButtonEvent(struct ButtonEvent *event) {
+  return vbuttons.readEvent(event);
 }
 
 void ap_menuItemHighlight(int current, char color, int count, MenuDataSource *ds) {
@@ -145,7 +237,7 @@ void ap_menuItemHighlight(int current, char color, int count, MenuDataSource *ds
   for (int i = 0; i < RING_LIGHT_COUNT; i++) {
     if (i == iCur) {
       vring.setPixelColor(i, color);
-    } else if (i >= RING_STATUS_COUNT && i < RING_STATUS_COUNT + count || (RING_STATUS_COUNT + count > RING_LIGHT_COUNT && i < (RING_STATUS_COUNT + count) % RING_LIGHT_COUNT)) {
+    } else if ((i >= RING_STATUS_COUNT && i < RING_STATUS_COUNT + count) || (RING_STATUS_COUNT + count > RING_LIGHT_COUNT && i < (RING_STATUS_COUNT + count) % RING_LIGHT_COUNT)) {
       int delta = i - iCur;
 
       if (delta > RING_LIGHT_COUNT/2 && current + delta - RING_LIGHT_COUNT >= 0) {
@@ -168,11 +260,11 @@ void ap_menuItemHighlight(int current, char color, int count, MenuDataSource *ds
       vring.setPixelColor(i, 'k');
     }
   }
-  vring.show();
+  ap_showDisplayBar();
 }
 
 void ap_menuItemShowTitle(char *title) {
-  vdigits.showString(title, true);
+  ap_showDisplayStatusString(title);
 }
 
 int ap_getDisplayBarCount(void) {
@@ -184,80 +276,29 @@ void ap_setDisplayBarColor(int index, unsigned char color) {
 }
 
 void ap_showDisplayBar() {
+  PROFILE_BEGIN(start);
   vring.show();
+  PROFILE_END(PROFILE_PHASE_RING, start);
 }
 
-void ap_showDisplayFloatValue(float num, int dig, int suf, bool addPlus) {
-  char sufBuf[2];
-  char preBuf[2];
-  char *prefix = preBuf; prefix[0] = (num < 0) ? '-' : addPlus ? '+' : 0;
-
-  char suffix = 0;
-  unsigned long whole = 0;
-  unsigned long frac = 0;
-  int fracdig = 0;
-
-  sufBuf[1] = 0;
-  preBuf[1] = 0;
-  num = fabs(num);
-
-  if (num > 999000000) {
-    whole = num/1000000000;
-    frac = (num-whole*1000000000)/100000000;
-    fracdig = 1;
-    suffix = 'B';
-  } else if (num > 999000) {
-    whole = num/1000000;
-    frac = (num-whole*1000000)/100000;
-    fracdig = 1;
-    suffix = 'M';
-  } else if (num > 9999) {
-    whole = num/1000;
-    frac = (num-whole*1000)/100;
-    fracdig = 1;
-    suffix = 'k';
-  } else {
-    whole = num;
-    if (dig > 0) {
-      float diff = fabs(num) - floor(fabs(num));
-      for (int i=0; i<dig; i++) {
-        diff *= 10;
-      }
-      frac = diff;
-      fracdig = dig;
-    }
-  }
-
-  char buf[30];
-  char tmp[30];
-
-  strcpy(buf, prefix);
-  itoa(whole, buf+strlen(buf), 10);
-
-  int maxDigits = 4;
-
-  // Override default suffix if set
-  sufBuf[0] = suffix ?: suf;
+void ap_deferDisplayBar(bool deferred) {
+  PROFILE_BEGIN(start);
+  vring.setShowDeferred(deferred);
+  PROFILE_END(PROFILE_PHASE_RING, start);
+}
 
-  if (strlen(buf) + strlen(sufBuf) + 1 <= maxDigits && ((strlen(sufBuf) && suffix) || dig)) {
-    maxDigits++;
-    strncat(buf, ".", sizeof(buf)-1);
-    itoa(frac, tmp, 10);
-    for (int i=strlen(tmp); i<fracdig; i++) {
-      strncat(buf, "0", sizeof(buf)-1);
-    }
-    strncat(buf, tmp, sizeof(buf)-1);
-  }
+void ap_showDisplayFloatValue(float num, int dig, int suf, bool addPlus) {
+  PROFILE_BEGIN(start);
+  char buf[FORMAT_VALUE_SIZE];
+  float magnitude = fabs(num);
 
-  // Right justify
-  int space = maxDigits - strlen(buf) - strlen(sufBuf);
-  space = max(0, space);
-  tmp[0] = tmp[1] = tmp[2] = tmp[3] = ' ';
-  tmp[4] = 0;
-  strcpy(tmp+space, buf);
+  // One float conversion; large values are shown with k, M or B and no decimals of their own
+  uint8_t decimals = (magnitude < 10000 && dig > 0) ? dig : 0;
+  unsigned long value = magnitude * VFormat::getScale(decimals);
 
-  strncat(tmp, sufBuf, sizeof(tmp)-1);
-  vdigits.showString(tmp, true);
+  char *text = VFormat::formatValue(buf, value, decimals, suf, (num < 0) ? '-' : addPlus ? '+' : 0);
+  vdigits.showString((unsigned char *)text, true);
+  PROFILE_END(PROFILE_PHASE_DIGITS, start);
 }
 
 void ap_showDisplayStatusState(bool connecting, bool resetting, int errorCount, int connectionErrorCount, int protocolIndex) {
@@ -274,11 +315,13 @@ void ap_showDisplayStatusState(bool connecting, bool resetting, int errorCount,
       vring.setPixelColor(RING_STATUS_COUNT-i-1, i < errorCount ? 'R' : 'k');
     }
   }
-  vring.show();
+  ap_showDisplayBar();
 }
 
 void ap_showDisplayStatusString(char *text) {
+  PROFILE_BEGIN(start);
   vdigits.showString(text, true);
+  PROFILE_END(PROFILE_PHASE_DIGITS, start);
 }
 
 void ap_showDisplayStatusString_P(char *ptext) {
@@ -287,53 +330,9 @@ void ap_showDisplayStatusString_P(char *ptext) {
   ap_showDisplayStatusString(text);
 }
 
+// Runs on from ap_idle, so it overlaps whatever the caller does next
 void ap_showSweep(char color, int mode) {
-  int lightCount = ap_getDisplayBarCount();
-
-  switch(mode) {
-    case SWEEP_MODE_UP:
-      for (int j = 0; j <= lightCount/2; j++) {
-        for (int i = 0; i < lightCount; i++) {    
-          ap_setDisplayBarColor(i, i==j || i==lightCount-1-j ? color : 'k');
-        }
-        ap_showDisplayBar(); 
-        ap_smartDelay(40);
-      }
-      ap_setDisplayBarColor(lightCount/2, 'k');
-      break;
-
-    case SWEEP_MODE_DOWN:
-      for (int j = lightCount/2; j >= 0; j--) {    
-        for (int i = 0; i < lightCount; i++) {    
-          ap_setDisplayBarColor(i, i==j || i==lightCount-1-j ? color : 'k');
-        }
-        ap_showDisplayBar(); 
-        ap_smartDelay(40);
-      }
-      ap_setDisplayBarColor(0, 'k');
-      ap_setDisplayBarColor(lightCount-1, 'k');
-      break;
-
-    case SWEEP_MODE_RIGHT_LEFT:
-    default:
-      for (int j = 0; j < lightCount; j++) {    
-        for (int i = 0; i < lightCount; i++) {    
-          ap_setDisplayBarColor(i, i==j ? color : 'k');
-        }
-        ap_showDisplayBar(); 
-        ap_smartDelay(40);
-      }
-      for (int j = lightCount-1; j >= 0; j--) {    
-        for (int i = 0; i < lightCount; i++) {    
-          ap_setDisplayBarColor(i, i==j ? color : 'k');
-        }
-        ap_showDisplayBar(); 
-        ap_smartDelay(40);
-      }
-      ap_setDisplayBarColor(0, 'k');
-      break;
-  }
-  ap_showDisplayBar(); 
+  vring.startSweep(RING_STATUS_COUNT, ap_getDisplayBarCount(), color, mode);
 }
 
 void ap_setDisplayBrightness(int brightness) {
@@ -361,7 +360,159 @@ void ap_smartDelay(unsigned long wait) {
     unsigned long time = millis();
     if (time < start || time >= start + wait) return;
 
+    ap_idle();
+
     // Don't block UI for extended periods of time
     if (time >= start + 100 && ap_isControlsButton1Down()) return;
   }
 }
+
+void ap_idle() {
+  vring.animate();
+
+  // Keep connection alive while waiting on the user or display
+  vdisplayables.ping();
+
+#if STREAM_ENABLED
+  vstream.drain();
+#endif
+
+#if ELM_BRIDGE_ENABLED
+  // Forward host requests while the gauge waits
+  velm.poll();
+#endif
+
+#if CONSOLE_ENABLED
+  vconsole.poll(false);
+#endif
+}
+
+void ap_captureByte(unsigned long time, unsigned char value, unsigned char flags, unsigned long *flips, int flipCount) {
+#if STREAM_CAPTURE_ENABLED
+  vstream.captureByte(time, value, flags, flips, flipCount);
+#endif
+}
+
+void ap_captureFlips(unsigned long *flips, int flipCount) {
+#if STREAM_CAPTURE_ENABLED
+  vstream.captureFlips(flips, flipCount);
+#endif
+}
+
+void ap_serviceStream() {
+#if STREAM_ENABLED
+  vstream.service();
+#endif
+}
+
+#if STREAM_TELEMETRY_ENABLED
+static_assert(2 + 22 + 9 * DISPLAYABLE_TELEMETRY_MAX_SAMPLES <= STREAM_MAX_PAYLOAD, "telemetry records must fit a stream buffer");
+#endif
+
+void ap_sendTelemetry(struct DisplayableTelemetry *t) {
+#if STREAM_TELEMETRY_ENABLED
+  // Queued without blocking; the UART interrupt drains it as ap_idle hands bytes over
+  if (!vstream.beginTimedRecord(STREAM_RECORD_TELEMETRY, 22 + 9 * t->sampleCount, micros())) return;
+  vstream.put(t->sequence);
+  vstream.putWord(t->cycleMillis);
+  vstream.putWord(t->updateMillis);
+  vstream.put(t->requestErrorCount);
+  vstream.put(t->totalRequestErrorCount);
+  vstream.put(t->connectionErrorCount);
+  vstream.put(t->protocol);
+  vstream.putFloat(t->totalElapsedSeconds);
+  vstream.putFloat(t->totalDrivenKilometers);
+  vstream.putFloat(t->totalConsumedFuelLitres);
+  vstream.put(t->sampleCount);
+  for (int i=0; i<t->sampleCount; i++) {
+    vstream.put(t->samples[i].pid);
+    vstream.putLong(t->samples[i].raw);
+    vstream.putFloat(t->samples[i].scaled);
+  }
+  vstream.endRecord();
+#endif
+}
+
+int ap_bridgeRequest(int protocol, unsigned char *data, int length, unsigned char *response, int maxBytes) {
+  return vdisplayables.bridgeRequest(protocol, data, length, response, maxBytes);
+}
+
+int ap_bridgeRequestPids(int protocol, unsigned char *pids, int count, long *values) {
+  return vdisplayables.bridgeRequestPids(protocol, pids, count, values);
+}
+
+unsigned char ap_bridgeGetNackCode(void) {
+  return vdisplayables.getBridgeNackCode();
+}
+
+int ap_bridgeGetPidDataLength(unsigned char pid) {
+  return vdisplayables.getPidDataLength(pid);
+}
+
+int ap_bridgeGetProtocol(void) {
+  return vdisplayables.getBridgeProtocol();
+}
+
+void ap_bridgeDisconnect(void) {
+  vdisplayables.bridgeDisconnect();
+}
+
+float ap_bridgeGetBatteryVolts(void) {
+  return vdisplayables.getBatteryVolts();
+}
+
+int ap_consoleGetItemCount(void) {
+  return vdisplayables.getItemCount();
+}
+
+int ap_consoleGetCurrentItem(void) {
+  return vdisplayables.getCurrentItem();
+}
+
+void ap_consoleSelectItem(int index) {
+  vdisplayables.selectItem(index);
+}
+
+char *ap_consoleGetItemName(int index) {
+  return vdisplayables.getItemName(index);
+}
+
+bool ap_consoleIsItemHidden(int index) {
+  return vdisplayables.isItemHidden(index);
+}
+
+int ap_consoleRequest(unsigned char *data, int length, unsigned char *response, int maxBytes) {
+  return vdisplayables.bridgeRequest(OBD_PROTOCOL_AUTOMATIC, data, length, response, maxBytes);
+}
+
+int ap_consoleReadPersistedState(int offset, unsigned char *bytes, int count) {
+  return vdisplayables.readPersistedState(offset, bytes, count);
+}
+
+int ap_consoleWritePersistedState(int offset, unsigned char *bytes, int count) {
+  return vdisplayables.writePersistedState(offset, bytes, count);
+}
+
+void ap_consoleLoadPersistedState(void) {
+  vdisplayables.loadPersistedState();
+}
+
+void ap_consoleGetTelemetry(struct DisplayableTelemetry *telemetry) {
+  vdisplayables.getTelemetry(telemetry);
+}
+
+bool ap_consoleGetMode(int mode) {
+  return vdisplayables.getMode(mode);
+}
+
+void ap_consoleToggleMode(int mode) {
+  vdisplayables.toggleMode(mode);
+}
+
+struct ObdStats *ap_consoleGetObdStats(void) {
+  return vdisplayables.getObdStats();
+}
+
+void ap_consoleResetObdStats(void) {
+  vdisplayables.resetObdStats();
+}
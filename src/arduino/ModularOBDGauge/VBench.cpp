@@ -0,0 +1,232 @@
+#include "Environment.h"
+#include "VBench.h"
+#include "VMenu.h"
+#include "VObd.h"
+
+#include <Arduino.h>
+
+///////////////////////////////////////////////////////////////
+// VBENCH.CPP
+// Micro-benchmarks for the hot paths, on the part or the host
+///////////////////////////////////////////////////////////////
+
+// Module internals under test, not exported by their headers
+struct DisplayableItem;
+struct DisplayableItem *ds_getDisplayableObject(int index);
+float ds_scaleDisplayableValue(float fvalue, struct DisplayableItem *disp, bool useAltUnits);
+void  ds_showDisplayableBar(float fvalue, struct DisplayableItem *disp, bool useAltUnits, bool showAsSpot);
+int   ds_itemIndexFromVisibleIndex(int index);
+VObd *ds_getObd();
+int   mn_getVisibleItemCount(struct MenuDataSource *dataSource);
+int   mn_getCurrentVisibleItem(struct MenuDataSource *dataSource);
+void  mn_setCurrentVisibleItem(struct MenuDataSource *dataSource, int current);
+
+#define BENCH_MENU_ITEM_COUNT 25           // As many as the gauge menu
+#define BENCH_MENU_HIDDEN     0x00a4c0a1L  // Some hidden, spread across the list
+
+static const char bn_caseNames[BENCH_CASE_COUNT][BENCH_NAME_SIZE] PROGMEM = {
+  "empty",
+  "decodeFlipsToByte",
+  "parsePidResponse.iso9141",
+  "parsePidResponse.kwp2ecu",
+  "ds_scaleDisplayableValue",
+  "ds_showDisplayableBar",
+  "ap_showDisplayFloatValue",
+  "mn_getVisibleItemCount",
+  "mn_getCurrentVisibleItem",
+  "mn_setCurrentVisibleItem",
+  "ds_itemIndexFromVisibleIndex",
+  "setPixelColor",
+};
+
+// Example: 48 6B 10 41 0C 1A F8 22 (rpm)
+static unsigned char bn_isoResponse[] = { 0x48, 0x6b, 0x10, 0x41, 0x0c, 0x1a, 0xf8, 0x22 };
+
+// Example: [83 F1 18 41 0D 64 3E] [83 F1 11 41 0D 64 37] (transmission, engine)
+static unsigned char bn_kwpResponse[] = { 0x83, 0xf1, 0x18, 0x41, 0x0d, 0x64, 0x3e, 0x83, 0xf1, 0x11, 0x41, 0x0d, 0x64, 0x37 };
+
+static const char bn_colors[] = "rgbyk";
+
+static unsigned long (*bn_clock)(void);
+static struct DisplayablesOutputProvider *bn_output;
+static unsigned long bn_flips[SERIAL_BYTE_FLIPS];
+static int bn_flipCount;
+static unsigned int bn_sampleUs[9];
+static struct DisplayableItem *bn_item;
+static int bn_barCount;
+static volatile long bn_sink;   // Keeps results from being optimized away
+
+static int  bn_getCurrentItem(MenuDataSource *ds) { return ds->alternateCurrentItem; }
+static void bn_setCurrentItem(int index, MenuDataSource *ds) { ds->alternateCurrentItem = index; }
+static bool bn_isItemHidden(int index, MenuDataSource *ds) { return !!(BENCH_MENU_HIDDEN & (1L << index)); }
+static unsigned long bn_getHiddenMask(MenuDataSource *ds) { return BENCH_MENU_HIDDEN; }
+
+static struct MenuDataSource bn_menuDataSource = {
+  BENCH_MENU_ITEM_COUNT,
+  bn_getCurrentItem,
+  bn_setCurrentItem,
+  NULL,
+  NULL,
+  NULL,
+  bn_isItemHidden,
+  NULL,
+  NULL,
+  'w',
+  BENCH_MENU_ITEM_COUNT - 1,
+  NULL,
+  NULL,
+  NULL,
+  bn_getHiddenMask,
+};
+
+// Edge times of one byte as VSerial::readBytes records them
+static int bn_encodeByte(unsigned char value, unsigned long baud, unsigned long *flips) {
+  unsigned long bitUs = 1000000L / baud;
+  int level = 0;
+  int count = 0;
+
+  flips[count++] = 0;
+  for (int bit=0; bit<=8; bit++) {
+    int next = (bit == 8) ? 1 : (value >> bit) & 1;
+    if (next != level) {
+      flips[count++] = (bit + 1) * bitUs;
+      level = next;
+    }
+  }
+  return count;
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VBench::setup(unsigned long (*clock)(void), struct DisplayablesOutputProvider *output) {
+  bn_clock = clock;
+  bn_output = output;
+  bn_flipCount = bn_encodeByte(0x41, SERIAL_DEFAULT_BAUD, bn_flips);
+  for (int i=0; i<9; i++) {
+    bn_sampleUs[i] = (i * 1000000L + 1500000L)/SERIAL_DEFAULT_BAUD;
+  }
+  bn_item = ds_getDisplayableObject(0);
+  bn_barCount = output->getBarCount();
+}
+
+extern void VBench::getCaseName(int index, char *buf) {
+  strcpy_P(buf, bn_caseNames[index]);
+}
+
+extern unsigned long VBench::runCase(int index, unsigned long *calls) {
+  void (*body)(uint16_t) = getCaseBody(index);
+  VObd *obd = ds_getObd();
+  int protocol = obd->protocol;
+  unsigned char ecuAddress = obd->ecuAddress;
+  unsigned long count = 0;
+  unsigned long elapsed;
+
+  unsigned long start = bn_clock();
+  do {
+    for (uint16_t i=0; i<BENCH_BATCH; i++) body(count + i);
+    count += BENCH_BATCH;
+    elapsed = bn_clock() - start;
+  } while (elapsed < BENCH_MIN_MICROS);
+
+  // Parse cases borrow the gauge's connection state
+  obd->protocol = protocol;
+  obd->ecuAddress = ecuAddress;
+
+  if (calls) *calls = count;
+  return elapsed * 1000 / count;
+}
+
+extern void VBench::run() {
+  char name[BENCH_NAME_SIZE];
+
+  Serial.println(F("# VBench " BUILD_VERSION ", ns per call"));
+  for (int i=0; i<BENCH_CASE_COUNT; i++) {
+    unsigned long calls;
+    unsigned long ns = runCase(i, &calls);
+    getCaseName(i, name);
+    Serial.print(name);
+    Serial.print(' ');
+    Serial.print(ns);
+    Serial.print(' ');
+    Serial.println(calls);
+  }
+}
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+void (*VBench::getCaseBody(int index))(uint16_t) {
+  switch (index) {
+    case BENCH_DECODE_BYTE:       return benchDecodeByte;
+    case BENCH_PARSE_ISO:         return benchParseIso;
+    case BENCH_PARSE_KWP:         return benchParseKwp;
+    case BENCH_SCALE_VALUE:       return benchScaleValue;
+    case BENCH_SHOW_BAR:          return benchShowBar;
+    case BENCH_SHOW_FLOAT:        return benchShowFloat;
+    case BENCH_MENU_COUNT:        return benchMenuCount;
+    case BENCH_MENU_CURRENT:      return benchMenuCurrent;
+    case BENCH_MENU_SET:          return benchMenuSet;
+    case BENCH_ITEM_FROM_VISIBLE: return benchItemFromVisible;
+    case BENCH_SET_PIXEL:         return benchSetPixel;
+  }
+  return benchEmpty;
+}
+
+void VBench::benchEmpty(uint16_t i) {
+  bn_sink = i;
+}
+
+void VBench::benchDecodeByte(uint16_t i) {
+  bn_sink = VSerial::decodeFlipsToByte(bn_flips, bn_flipCount, bn_sampleUs);
+}
+
+void VBench::benchParseIso(uint16_t i) {
+  unsigned char buf[4];
+  VObd *obd = ds_getObd();
+  obd->protocol = OBD_PROTOCOL_ISO_9141;
+  obd->ecuAddress = 0;
+  bn_sink = obd->parsePidResponse(bn_isoResponse, sizeof(bn_isoResponse), buf, sizeof(buf), 0x0c, 1, false);
+}
+
+void VBench::benchParseKwp(uint16_t i) {
+  unsigned char buf[4];
+  VObd *obd = ds_getObd();
+  obd->protocol = OBD_PROTOCOL_KWP_FAST;
+  obd->ecuAddress = 0x11;
+  bn_sink = obd->parsePidResponse(bn_kwpResponse, sizeof(bn_kwpResponse), buf, sizeof(buf), 0x0d, 1, false);
+}
+
+void VBench::benchScaleValue(uint16_t i) {
+  bn_sink = ds_scaleDisplayableValue((float)(i & 0xff), bn_item, i & 1);
+}
+
+void VBench::benchShowBar(uint16_t i) {
+  ds_showDisplayableBar((float)((i & 0x3f) * 100), bn_item, false, false);
+}
+
+void VBench::benchShowFloat(uint16_t i) {
+  bn_output->showFloatValue(12.5 + (i & 0x7f), 1, 0, false);
+}
+
+void VBench::benchMenuCount(uint16_t i) {
+  bn_sink = mn_getVisibleItemCount(&bn_menuDataSource);
+}
+
+void VBench::benchMenuCurrent(uint16_t i) {
+  bn_sink = mn_getCurrentVisibleItem(&bn_menuDataSource);
+}
+
+void VBench::benchMenuSet(uint16_t i) {
+  mn_setCurrentVisibleItem(&bn_menuDataSource, i & 0x0f);
+}
+
+void VBench::benchItemFromVisible(uint16_t i) {
+  bn_sink = ds_itemIndexFromVisibleIndex(i & 0x0f);
+}
+
+void VBench::benchSetPixel(uint16_t i) {
+  bn_output->setBarColor(i % bn_barCount, bn_colors[i % (sizeof(bn_colors) - 1)]);
+}
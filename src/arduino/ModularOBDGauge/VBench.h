@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////
+// VBENCH.H
+// Micro-benchmarks for the hot paths, on the part or the host
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+#include "VDisplayables.h"
+
+#ifndef _VBENCH
+#define _VBENCH
+
+#define BENCH_MIN_MICROS   250000L  // Each case repeats for at least this long
+#define BENCH_BATCH        16       // Calls between clock reads
+#define BENCH_NAME_SIZE    30
+
+// Cases, in output order
+#define BENCH_EMPTY                 0   // Loop and call overhead, included in every case
+#define BENCH_DECODE_BYTE           1   // VSerial::decodeFlipsToByte, one 10400 baud byte
+#define BENCH_PARSE_ISO             2   // VObd::parsePidResponse, one ISO 9141 frame
+#define BENCH_PARSE_KWP             3   // VObd::parsePidResponse, two ECUs answering
+#define BENCH_SCALE_VALUE           4   // ds_scaleDisplayableValue
+#define BENCH_SHOW_BAR              5   // ds_showDisplayableBar, whole ring
+#define BENCH_SHOW_FLOAT            6   // ap_showDisplayFloatValue, through the output provider
+#define BENCH_MENU_COUNT            7   // mn_getVisibleItemCount
+#define BENCH_MENU_CURRENT          8   // mn_getCurrentVisibleItem, last item current
+#define BENCH_MENU_SET              9   // mn_setCurrentVisibleItem
+#define BENCH_ITEM_FROM_VISIBLE     10  // ds_itemIndexFromVisibleIndex
+#define BENCH_SET_PIXEL             11  // VRing::setPixelColor, through the output provider
+#define BENCH_CASE_COUNT            12
+
+// Output of run(), one line per case, e.g. "decodeFlipsToByte 5120 48832":
+//   <name> <nanoseconds per call> <calls timed>
+// Lines starting with '#' are comments.
+class VBench {
+  private:
+    static void (*getCaseBody(int index))(uint16_t);
+    static void benchEmpty(uint16_t i);
+    static void benchDecodeByte(uint16_t i);
+    static void benchParseIso(uint16_t i);
+    static void benchParseKwp(uint16_t i);
+    static void benchScaleValue(uint16_t i);
+    static void benchShowBar(uint16_t i);
+    static void benchShowFloat(uint16_t i);
+    static void benchMenuCount(uint16_t i);
+    static void benchMenuCurrent(uint16_t i);
+    static void benchMenuSet(uint16_t i);
+    static void benchItemFromVisible(uint16_t i);
+    static void benchSetPixel(uint16_t i);
+
+  public:
+    // The clock returns microseconds; the host build passes a real one
+    void setup(unsigned long (*clock)(void), struct DisplayablesOutputProvider *output);
+    void getCaseName(int index, char *buf);   // buf holds BENCH_NAME_SIZE
+    unsigned long runCase(int index, unsigned long *calls);   // nanoseconds per call
+    void run();   // All cases, printed on the hardware UART
+};
+
+#endif
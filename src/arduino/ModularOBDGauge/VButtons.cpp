@@ -0,0 +1,177 @@
+#include "Environment.h"
+#include "VButtons.h"
+
+#include <Arduino.h>
+
+///////////////////////////////////////////////////////////////
+// VBUTTONS.CPP
+// Debounced push buttons, queued as press and release events
+///////////////////////////////////////////////////////////////
+
+struct ButtonState {
+  bool level;                // Last sample, down when true
+  bool down;                 // Debounced
+  uint8_t holds;             // Long press events sent for this press
+  unsigned long changedMs;   // When level last changed
+  unsigned long pressedMs;   // When down last became true
+};
+
+static struct ButtonState bt_buttons[BUTTON_COUNT];
+
+// Written by the timer interrupt at bt_head, read from bt_tail
+static volatile struct ButtonEvent bt_queue[BUTTON_QUEUE_SIZE];
+static volatile uint8_t bt_head;
+static volatile uint8_t bt_tail;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+static void bt_push(uint8_t type, uint8_t button, unsigned long heldMs) {
+  uint8_t next = (bt_head + 1) % BUTTON_QUEUE_SIZE;
+  if (next == bt_tail) return;
+
+  bt_queue[bt_head].type = type;
+  bt_queue[bt_head].button = button;
+  bt_queue[bt_head].heldMs = heldMs > 0xffff ? 0xffff : heldMs;
+  bt_head = next;
+}
+
+#if defined(__AVR__)
+
+static volatile uint8_t *bt_inputs[BUTTON_COUNT];
+static uint8_t bt_masks[BUTTON_COUNT];
+
+static bool bt_readLevel(uint8_t button) {
+  return !(*bt_inputs[button] & bt_masks[button]);
+}
+
+#else
+
+static uint8_t bt_pins[BUTTON_COUNT];
+
+static bool bt_readLevel(uint8_t button) {
+  return !digitalRead(bt_pins[button]);
+}
+
+#endif
+
+// One debounce step; true while a button is down or settling, so sampling goes on
+static bool bt_service(unsigned long now) {
+  bool active = false;
+
+  for (uint8_t i=0; i<BUTTON_COUNT; i++) {
+    struct ButtonState *b = &bt_buttons[i];
+    bool level = bt_readLevel(i);
+
+    if (level != b->level) {
+      b->level = level;
+      b->changedMs = now;
+    } else if (level != b->down && now - b->changedMs >= BUTTON_DEBOUNCE_MS) {
+      b->down = level;
+      if (level) {
+        b->pressedMs = now;
+        b->holds = 0;
+        bt_push(BUTTON_EVENT_PRESS, i, 0);
+      } else {
+        bt_push(BUTTON_EVENT_RELEASE, i, now - b->pressedMs);
+      }
+    }
+
+    if (b->down) {
+      unsigned long heldMs = now - b->pressedMs;
+      if (b->holds < 1 && heldMs >= BUTTON_LONG_MS) {
+        b->holds = 1;
+        bt_push(BUTTON_EVENT_LONG, i, heldMs);
+      }
+      if (b->holds < 2 && heldMs >= BUTTON_SUPER_LONG_MS) {
+        b->holds = 2;
+        bt_push(BUTTON_EVENT_SUPER_LONG, i, heldMs);
+      }
+    }
+    if (b->down || level != b->down) active = true;
+  }
+  return active;
+}
+
+#if defined(__AVR__)
+
+// Timer 0 also keeps millis(); its compare B match comes once per overflow,
+// about every 1.024ms, whatever OCR0B holds, and is free unless pin 5 is
+// used for PWM
+ISR(TIMER0_COMPB_vect) {
+  if (!bt_service(millis())) TIMSK0 &= ~_BV(OCIE0B);
+}
+
+// Any edge restarts sampling; all three ports share the handler so the
+// buttons may be on any pins, which leaves none for SoftwareSerial
+ISR(PCINT0_vect) {
+  TIMSK0 |= _BV(OCIE0B);
+}
+ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
+
+static void bt_setupPin(uint8_t button, int pin) {
+  pinMode(pin, INPUT_PULLUP);
+  bt_inputs[button] = portInputRegister(digitalPinToPort(pin));
+  bt_masks[button] = digitalPinToBitMask(pin);
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCICR |= _BV(digitalPinToPCICRbit(pin));
+}
+
+static void bt_startSampling() {
+  // Buttons held at power up have no edge to start with
+  TIMSK0 |= _BV(OCIE0B);
+}
+
+static void bt_poll() {
+}
+
+#else
+
+static void bt_setupPin(uint8_t button, int pin) {
+  pinMode(pin, INPUT_PULLUP);
+  bt_pins[button] = pin;
+}
+
+static void bt_startSampling() {
+}
+
+// No interrupts on the host, so callers sample
+static void bt_poll() {
+  bt_service(millis());
+}
+
+#endif
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VButtons::setup(int pin1, int pin2) {
+  bt_setupPin(0, pin1);
+  bt_setupPin(1, pin2);
+  bt_startSampling();
+}
+
+extern bool VButtons::isDown(int button) {
+  bt_poll();
+  return bt_buttons[button].down;
+}
+
+extern bool VButtons::readEvent(struct ButtonEvent *event) {
+  bt_poll();
+  if (bt_tail == bt_head) return false;
+
+  // The interrupt doesn't write this slot until bt_tail moves past it
+  event->type = bt_queue[bt_tail].type;
+  event->button = bt_queue[bt_tail].button;
+  event->heldMs = bt_queue[bt_tail].heldMs;
+  bt_tail = (bt_tail + 1) % BUTTON_QUEUE_SIZE;
+  return true;
+}
+
+extern void VButtons::flushEvents() {
+  bt_poll();
+  bt_tail = bt_head;
+}
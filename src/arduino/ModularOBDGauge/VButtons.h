@@ -0,0 +1,42 @@
+///////////////////////////////////////////////////////////////
+// VBUTTONS.H
+// Debounced push buttons, queued as press and release events
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+
+#include <stdint.h>
+
+#ifndef _VBUTTONS
+#define _VBUTTONS
+
+#define BUTTON_COUNT          2
+#define BUTTON_QUEUE_SIZE     8      // Events waiting to be read; later ones are dropped when full
+#define BUTTON_DEBOUNCE_MS    12     // A pin must hold its level this long to count
+#define BUTTON_LONG_MS        500    // Held this long for a long press
+#define BUTTON_SUPER_LONG_MS  1500   // And this long for a super-long press
+
+#define BUTTON_EVENT_PRESS       1
+#define BUTTON_EVENT_RELEASE     2
+#define BUTTON_EVENT_LONG        3   // Still down after BUTTON_LONG_MS
+#define BUTTON_EVENT_SUPER_LONG  4   // Still down after BUTTON_SUPER_LONG_MS
+
+struct ButtonEvent {
+  uint8_t  type;       // BUTTON_EVENT_*
+  uint8_t  button;     // 0 or 1, in setup() order
+  uint16_t heldMs;     // For releases, how long the button was down
+};
+
+// On the part, a pin change interrupt starts a timer interrupt that samples
+// the buttons once a millisecond until they settle, so no caller blocks to
+// debounce and presses made during bus traffic are queued rather than missed.
+// The host build has neither and samples whenever it's asked for a button.
+class VButtons {
+  public:
+    void setup(int pin1, int pin2);   // Both INPUT_PULLUP, down when low
+    bool isDown(int button);
+    bool readEvent(struct ButtonEvent *event);   // false when there are none
+    void flushEvents();
+};
+
+#endif
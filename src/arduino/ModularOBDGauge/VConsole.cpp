@@ -0,0 +1,395 @@
+#include "Environment.h"
+#include "VConsole.h"
+#include "VObd.h"
+#include "VProfile.h"
+#include "VMemory.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////
+// VCONSOLE.CPP
+// Line-based command console over the hardware UART
+///////////////////////////////////////////////////////////////
+
+// Indexed by DISPLAYABLE_MODE_*
+static const char cs_modeNames[DISPLAYABLE_MODE_COUNT][7] PROGMEM = { "loop", "demo", "debug", "listen" };
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VConsole::setup(unsigned long baud, struct ConsoleProvider *consoleProvider) {
+  provider = consoleProvider;
+  lineLength = 0;
+  lineReady = false;
+  busy = false;
+  Serial.begin(baud);
+  printPrompt();
+}
+
+extern void VConsole::poll(bool busFree) {
+  // Commands call back into idle handlers, which poll again
+  if (busy) return;
+  busy = true;
+
+  // Take what has arrived, up to the end of one line
+  while (!lineReady && Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (lineLength) lineReady = true;
+    } else if ((lineLength || c != ' ') && lineLength < CONSOLE_LINE_SIZE - 1) {
+      line[lineLength++] = c;
+    }
+  }
+
+  // Bus commands stay queued until the update in progress has finished
+  if (lineReady && (busFree || !usesBus(line, lineLength))) {
+    line[lineLength] = 0;
+    processCommand(line);
+    lineLength = 0;
+    lineReady = false;
+    printPrompt();
+  }
+  busy = false;
+}
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+bool VConsole::usesBus(char *command, int length) {
+  // Mode toggles, writes and loading can disconnect or reconnect with the new settings
+  return isCommand_P(command, length, PSTR("req")) || isCommand_P(command, length, PSTR("mode")) ||
+         isCommand_P(command, length, PSTR("w")) || isCommand_P(command, length, PSTR("load"));
+}
+
+bool VConsole::isCommand_P(char *command, int length, const char *name) {
+  int nameLength = strlen_P(name);
+  return length >= nameLength && !strncasecmp_P(command, name, nameLength) && (length == nameLength || command[nameLength] == ' ');
+}
+
+void VConsole::processCommand(char *command) {
+  char *args = command;
+  char *word = nextWord(&args);
+
+  if (!strcasecmp_P(word, PSTR("req"))) {
+    processRequest(args);
+  } else if (!strcasecmp_P(word, PSTR("gauge"))) {
+    processGauge(args);
+  } else if (!strcasecmp_P(word, PSTR("list"))) {
+    char buf[16];
+    for (int i=0; i<provider->getItemCount(); i++) {
+      snprintf_P(buf, sizeof(buf), PSTR("%2d %c"), i, provider->isItemHidden(i) ? '-' : ' ');
+      Serial.print(buf);
+      Serial.println(provider->getItemName(i));
+    }
+  } else if (!strcasecmp_P(word, PSTR("stats"))) {
+    processStats();
+#if OBD_STATS_ENABLED
+  } else if (!strcasecmp_P(word, PSTR("pids"))) {
+    processObdStats(args);
+#endif
+#if PROFILE_ENABLED
+  } else if (!strcasecmp_P(word, PSTR("prof"))) {
+    processProfile(args);
+#endif
+  } else if (!strcasecmp_P(word, PSTR("mem"))) {
+    processMemory();
+  } else if (!strcasecmp_P(word, PSTR("mode"))) {
+    processMode(args);
+  } else if (!strcasecmp_P(word, PSTR("dump"))) {
+    processDump();
+  } else if (!strcasecmp_P(word, PSTR("w"))) {
+    processWrite(args);
+  } else if (!strcasecmp_P(word, PSTR("load"))) {
+    provider->loadPersistedState();
+    printLine_P(PSTR("OK"));
+  } else if (!strcasecmp_P(word, PSTR("help"))) {
+    print_P(PSTR("list gauge req stats mem mode dump w load"));
+#if OBD_STATS_ENABLED
+    print_P(PSTR(" pids"));
+#endif
+#if PROFILE_ENABLED
+    print_P(PSTR(" prof"));
+#endif
+    Serial.println();
+  } else {
+    printLine_P(PSTR("?"));
+  }
+}
+
+void VConsole::processGauge(char *args) {
+  char *word = nextWord(&args);
+  int index = -1;
+
+  if (!word) {
+    index = provider->getCurrentItem();
+    Serial.print(index);
+    Serial.print(' ');
+    Serial.println(provider->getItemName(index));
+    return;
+  }
+
+  if (!parseInt(word, &index)) {
+    for (int i=0; i<provider->getItemCount(); i++) {
+      if (!strcasecmp(word, provider->getItemName(i))) index = i;
+    }
+  }
+  if (index < 0 || index >= provider->getItemCount()) {
+    printLine_P(PSTR("?"));
+  } else {
+    provider->selectItem(index);
+    printLine_P(PSTR("OK"));
+  }
+}
+
+void VConsole::processRequest(char *args) {
+  unsigned char data[CONSOLE_MAX_REQUEST];
+  unsigned char response[CONSOLE_MAX_RESPONSE];
+  int count = parseHex(args, data, sizeof(data));
+
+  if (count <= 0) {
+    printLine_P(PSTR("?"));
+    return;
+  }
+
+  int responseCount = provider->request(data, count, response, sizeof(response));
+  if (responseCount == CONSOLE_NOT_CONNECTED) {
+    printLine_P(PSTR("NOT CONNECTED"));
+  } else if (responseCount == 0) {
+    printLine_P(PSTR("NACK"));
+  } else if (responseCount < 0) {
+    printLine_P(PSTR("NO DATA"));
+  } else {
+    printBytes(response, responseCount);
+  }
+}
+
+void VConsole::processStats() {
+  struct DisplayableTelemetry t;
+  char buf[40];
+
+  provider->getTelemetry(&t);
+  snprintf_P(buf, sizeof(buf), PSTR("protocol %d seq %d"), t.protocol, t.sequence);
+  Serial.println(buf);
+  snprintf_P(buf, sizeof(buf), PSTR("cycle %ums update %ums"), t.cycleMillis, t.updateMillis);
+  Serial.println(buf);
+  snprintf_P(buf, sizeof(buf), PSTR("errors %d total %d conn %d"), t.requestErrorCount, t.totalRequestErrorCount, t.connectionErrorCount);
+  Serial.println(buf);
+  print_P(PSTR("time ")); Serial.print(t.totalElapsedSeconds, 0);
+  print_P(PSTR("s dist ")); Serial.print(t.totalDrivenKilometers, 1);
+  print_P(PSTR("km fuel ")); Serial.print(t.totalConsumedFuelLitres, 2);
+  printLine_P(PSTR("L"));
+}
+
+#if PROFILE_ENABLED
+void VConsole::processProfile(char *args) {
+  struct ProfilePhase phase;
+  char name[PROFILE_NAME_SIZE];
+  char buf[48];
+  char *word = nextWord(&args);
+
+  if (word && !strcasecmp_P(word, PSTR("reset"))) {
+    VProfile::reset();
+    printLine_P(PSTR("OK"));
+    return;
+  }
+  printLine_P(PSTR("phase count min avg max (us)"));
+  for (int i=0; i<PROFILE_PHASE_COUNT; i++) {
+    VProfile::getPhase(i, &phase);
+    VProfile::getPhaseName(i, name);
+    snprintf_P(buf, sizeof(buf), PSTR("%-4s %u %lu %lu %lu"), name, phase.count, phase.minMicros, phase.avgMicros, phase.maxMicros);
+    Serial.println(buf);
+  }
+}
+#endif
+
+#if OBD_STATS_ENABLED
+void VConsole::processObdStats(char *args) {
+  struct ObdStats *stats = provider->getObdStats();
+  char *word = nextWord(&args);
+  char buf[40];
+
+  if (word && !strcasecmp_P(word, PSTR("reset"))) {
+    provider->resetObdStats();
+    printLine_P(PSTR("OK"));
+    return;
+  }
+
+  // Header row gives the upper bound of each bucket in ms, '+' for the open one
+  print_P(PSTR("ms  "));
+  for (int i=0; i<OBD_STATS_BUCKET_COUNT; i++) {
+    int bound = VObd::getStatsBucketMs(i);
+    if (bound) snprintf_P(buf, sizeof(buf), PSTR(" <%-3d"), bound);
+    else strcpy_P(buf, PSTR(" +"));
+    Serial.print(buf);
+  }
+  Serial.println();
+
+  for (int i=0; i<OBD_PROTOCOL_LAST; i++) {
+    snprintf_P(buf, sizeof(buf), PSTR("protocol %d"), i + 1);
+    Serial.println(buf);
+    printTimingStats(&stats->protocols[i]);
+  }
+  for (int i=0; i<OBD_STATS_PID_SLOTS && stats->pids[i].mode; i++) {
+    snprintf_P(buf, sizeof(buf), PSTR("mode %02X pid %02X"), stats->pids[i].mode, stats->pids[i].pid);
+    Serial.println(buf);
+    printTimingStats(&stats->pids[i].timing);
+  }
+}
+
+void VConsole::printTimingStats(struct ObdTimingStats *timing) {
+  char buf[56];
+
+  snprintf_P(buf, sizeof(buf), PSTR("  ok %u to %u cnt %u nack %u sid %u pid %u"),
+    timing->results[OBD_RESULT_OK], timing->results[OBD_RESULT_TIMEOUT], timing->results[OBD_RESULT_COUNT],
+    timing->results[OBD_RESULT_NACK], timing->results[OBD_RESULT_SID], timing->results[OBD_RESULT_PID]);
+  Serial.println(buf);
+  printHistogram_P(PSTR("p2 "), timing->p2, timing->maxP2Ms);
+  printHistogram_P(PSTR("p1 "), timing->p1, timing->maxP1Ms);
+  printHistogram_P(PSTR("all"), timing->total, -1);
+}
+
+void VConsole::printHistogram_P(const char *name, uint8_t *buckets, int maxMs) {
+  char buf[20];
+
+  print_P(PSTR("  "));
+  print_P(name);
+  for (int i=0; i<OBD_STATS_BUCKET_COUNT; i++) {
+    snprintf_P(buf, sizeof(buf), PSTR(" %4u"), buckets[i]);
+    Serial.print(buf);
+  }
+  if (maxMs >= 0) {
+    snprintf_P(buf, sizeof(buf), PSTR("  max %d"), maxMs);
+    Serial.print(buf);
+  }
+  Serial.println();
+}
+#endif
+
+void VConsole::processMemory() {
+  struct MemoryUsage memory;
+  char buf[48];
+
+  VMemory::getUsage(&memory);
+  snprintf_P(buf, sizeof(buf), PSTR("static %u heap %u stack %u free %u"),
+    memory.staticBytes, memory.heapBytes, memory.stackBytes, memory.freeBytes);
+  Serial.println(buf);
+  snprintf_P(buf, sizeof(buf), PSTR("arena %u owner %u conflicts %u"),
+    (unsigned int)MEMORY_ARENA_SIZE, VMemory::getArenaOwner(), VMemory::getArenaConflicts());
+  Serial.println(buf);
+}
+
+void VConsole::processMode(char *args) {
+  char *word = nextWord(&args);
+  char name[7];
+
+  for (int i=0; i<DISPLAYABLE_MODE_COUNT; i++) {
+    strcpy_P(name, cs_modeNames[i]);
+    if (!word) {
+      Serial.print(name);
+      Serial.println(provider->getMode(i) ? " on" : " off");
+    } else if (!strcasecmp(word, name)) {
+      provider->toggleMode(i);
+      Serial.print(name);
+      Serial.println(provider->getMode(i) ? " on" : " off");
+      return;
+    }
+  }
+  if (word) printLine_P(PSTR("?"));
+}
+
+// Output can be sent back as is to restore the state
+void VConsole::processDump() {
+  unsigned char bytes[CONSOLE_STATE_CHUNK];
+  int count;
+
+  for (int offset=0; (count = provider->readPersistedState(offset, bytes, sizeof(bytes))) > 0; offset += count) {
+    print_P(PSTR("w "));
+    Serial.print(offset);
+    Serial.write(' ');
+    printBytes(bytes, count);
+  }
+  printLine_P(PSTR("load"));
+}
+
+void VConsole::processWrite(char *args) {
+  unsigned char bytes[CONSOLE_STATE_CHUNK];
+  char *word = nextWord(&args);
+  int offset;
+  int count = parseHex(args, bytes, sizeof(bytes));
+
+  if (!word || !parseInt(word, &offset) || count <= 0 || provider->writePersistedState(offset, bytes, count) != count) {
+    printLine_P(PSTR("?"));
+  } else {
+    printLine_P(PSTR("OK"));
+  }
+}
+
+// Splits off the next space separated word, NULL at the end of the line
+char *VConsole::nextWord(char **text) {
+  char *word = *text;
+  while (*word == ' ') word++;
+  if (!*word) return NULL;
+
+  char *end = word;
+  while (*end && *end != ' ') end++;
+  if (*end) *end++ = 0;
+  *text = end;
+  return word;
+}
+
+// Hex digits, optionally separated by spaces; returns the byte count or -1
+int VConsole::parseHex(char *text, unsigned char *bytes, int maxBytes) {
+  int count = 0;
+  int digits = 0;
+  for (; *text; text++) {
+    char c = *text;
+    if (c == ' ') continue;
+    int nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    if (nibble < 0) return -1;
+    if (digits++ & 1) {
+      bytes[count++] |= nibble;
+    } else {
+      if (count >= maxBytes) return -1;
+      bytes[count] = nibble << 4;
+    }
+  }
+  return (digits & 1) ? -1 : count;
+}
+
+bool VConsole::parseInt(char *text, int *value) {
+  if (!*text) return false;
+  *value = 0;
+  for (; *text; text++) {
+    if (*text < '0' || *text > '9') return false;
+    *value = *value * 10 + *text - '0';
+  }
+  return true;
+}
+
+void VConsole::printBytes(unsigned char *bytes, int count) {
+  char buf[4];
+  for (int i=0; i<count; i++) {
+    snprintf_P(buf, sizeof(buf), PSTR("%02X"), bytes[i]);
+    Serial.print(buf);
+  }
+  Serial.println();
+}
+
+void VConsole::print_P(const char *text) {
+  char buf[80];
+  strncpy_P(buf, text, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = 0;
+  Serial.print(buf);
+}
+
+void VConsole::printLine_P(const char *text) {
+  print_P(text);
+  Serial.println();
+}
+
+void VConsole::printPrompt() {
+  print_P(PSTR("> "));
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////
+// VCONSOLE.H
+// Line-based command console over the hardware UART
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+#include "VDisplayables.h"
+
+#ifndef _VCONSOLE
+#define _VCONSOLE
+
+#define CONSOLE_LINE_SIZE      48
+#define CONSOLE_MAX_REQUEST    8
+#define CONSOLE_MAX_RESPONSE   SERIAL_MAX_BYTES
+#define CONSOLE_STATE_CHUNK    16    // Persisted state bytes per dumped line
+
+#define CONSOLE_NOT_CONNECTED  -2
+
+// Commands (one per line, case-insensitive, arguments separated by spaces):
+//   help                     list commands
+//   list                     gauge indexes and names, '-' marks hidden ones
+//   gauge [index|name]       show or select the current gauge
+//   req <hex bytes>          send a request, e.g. "req 01 0c", print the response
+//   stats                    counters and last update cycle timing
+//   prof [reset]             loop phase timings, with PROFILE_ENABLED
+//   pids [reset]             response timing histograms, with OBD_STATS_ENABLED
+//   mem                      SRAM use; stack and free are high-water marks since boot
+//   mode [name]              show modes, or toggle loop, demo, debug or listen
+//   dump                     print the persisted state as "w" lines followed by "load"
+//   w <offset> <hex bytes>   write persisted state bytes to EEPROM
+//   load                     reload (and validate) the persisted state from EEPROM
+struct ConsoleProvider {
+  int   (*getItemCount)(void);
+  int   (*getCurrentItem)(void);
+  void  (*selectItem)(int index);
+  char *(*getItemName)(int index);
+  bool  (*isItemHidden)(int index);
+  int   (*request)(unsigned char *data, int length, unsigned char *response, int maxBytes);
+  int   (*readPersistedState)(int offset, unsigned char *bytes, int count);
+  int   (*writePersistedState)(int offset, unsigned char *bytes, int count);
+  void  (*loadPersistedState)(void);
+  void  (*getTelemetry)(struct DisplayableTelemetry *telemetry);
+  bool  (*getMode)(int mode);
+  void  (*toggleMode)(int mode);
+  struct ObdStats *(*getObdStats)(void);   // NULL if not kept
+  void  (*resetObdStats)(void);
+};
+
+class VConsole {
+  private:
+    struct ConsoleProvider *provider;
+    char line[CONSOLE_LINE_SIZE];
+    unsigned char lineLength;
+    bool lineReady;
+    bool busy;
+
+    bool usesBus(char *command, int length);
+    bool isCommand_P(char *command, int length, const char *name);
+    void processCommand(char *command);
+    void processGauge(char *args);
+    void processRequest(char *args);
+    void processStats();
+#if PROFILE_ENABLED
+    void processProfile(char *args);
+#endif
+#if OBD_STATS_ENABLED
+    void processObdStats(char *args);
+    void printTimingStats(struct ObdTimingStats *timing);
+    void printHistogram_P(const char *name, uint8_t *buckets, int maxMs);
+#endif
+    void processMemory();
+    void processMode(char *args);
+    void processDump();
+    void processWrite(char *args);
+    char *nextWord(char **text);
+    int  parseHex(char *text, unsigned char *bytes, int maxBytes);
+    bool parseInt(char *text, int *value);
+    void printBytes(unsigned char *bytes, int count);
+    void print_P(const char *text);
+    void printLine_P(const char *text);
+    void printPrompt();
+
+  public:
+    void setup(unsigned long baud, struct ConsoleProvider *provider);
+
+    // Never blocks on input.  Commands that use the bus wait for a call
+    // with busFree set, made between gauge updates.
+    void poll(bool busFree);
+};
+
+#endif
@@ -9,6 +9,7 @@
 #endif
 
 #include <Arduino.h>
+#include <string.h>
 
 ///////////////////////////////////////////////////////////////
 // VDIGITS.CPP
@@ -153,25 +154,52 @@ static const uint8_t dg_font[TABLE_SIZE] PROGMEM = {
 };
 
 static TM1637Display *dg_display;
+static uint8_t dg_segments[MAX_DIGITS];   // As last sent
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+// Sends the changed digits, first to last, in one auto-increment transfer
+static void dg_showSegments(uint8_t *segments) {
+  int first = 0;
+  int last = MAX_DIGITS - 1;
+
+  while (first <= last && segments[first] == dg_segments[first]) first++;
+  while (last > first && segments[last] == dg_segments[last]) last--;
+  if (first > last) return;
+
+  memcpy(dg_segments + first, segments + first, last - first + 1);
+  dg_display->setSegments(dg_segments + first, last - first + 1, first);
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
 
 extern void VDigits::setup(int clockPin, int dataPin) {
-    dg_display = new TM1637Display(clockPin, dataPin);
+    dg_display = new TM1637Display(clockPin, dataPin, DIGITS_BIT_DELAY_US);
     dg_display->setBrightness(7, true);
     dg_display->setSegments("\xff\xff\xff\xff", 4, 0);
     delay(500);
     dg_display->clear();
+    memset(dg_segments, 0, sizeof(dg_segments));
     delay(500);
 }
 
 extern void VDigits::showChar(int pos, unsigned char c, bool addDot) {
-    uint8_t segment = pgm_read_byte_near(dg_font + FONT_INDEX(c));
+    uint8_t segments[MAX_DIGITS];
+    memcpy(segments, dg_segments, sizeof(segments));
+    segments[pos] = pgm_read_byte_near(dg_font + FONT_INDEX(c));
     if (addDot) {
-      segment |= SEG_DOT;
+      segments[pos] |= SEG_DOT;
     }
-    dg_display->setSegments(&segment, 1, pos);
+    dg_showSegments(segments);
 }
 
 extern void VDigits::showString(unsigned char *text, bool addDots) {
+  uint8_t segments[MAX_DIGITS];
+
   // Compensate for WOKWI LED only having center dot (clock LED)
 #if DIGITS_TYPE_CLOCK
   if (addDots && text[0] == ' ' && text[1] && text[1] != '.' && text[2] && text[2] != '.'  && text[3] == '.') {
@@ -190,12 +218,13 @@ extern void VDigits::showString(unsigned char *text, bool addDots) {
       text++;
       font |= SEG_DOT;
     }
-    dg_display->setSegments(&font, 1, i);
+    segments[i] = font;
   }
+  dg_showSegments(segments);
 }
 
+// The library sends brightness with the next transfer, so resend the digits
 extern void VDigits::setBrightness(int brite) {
   dg_display->setBrightness(brite);
+  dg_display->setSegments(dg_segments, MAX_DIGITS, 0);
 }
-
-
@@ -6,6 +6,7 @@
 #ifndef _VDIGITS
 #define _VDIGITS
 
+// Digits are only sent when they change, the changed span in one transfer
 class VDigits {
   public:
     void setup(int clockPin, int dataPin);
@@ -2,6 +2,9 @@
 #include "VDisplayables.h"
 #include "VSettings.h"
 #include "VObd.h"
+#include "VProfile.h"
+#include "VMemory.h"
+#include "VFormat.h"
 #include <Arduino.h>
 #include <EEPROM.h>
 #include <string.h>
@@ -18,6 +21,9 @@
 #define GEAR_NV_INTERVAL 1L
 #define GEAR_DETECT_TIME (60L * 1000L)
 #define GEAR_MIN_DIFF 3
+#define GEAR_BIN_COUNT ((GEAR_NV_MAX - GEAR_NV_MIN)/GEAR_NV_INTERVAL+1)
+#define GEAR_REFINE_SAMPLES 64    // Samples between background updates of the gear centers
+#define GEAR_REFINE_BINS 3        // Furthest a center moves to a nearby peak in one update
 #define GEAR_DIVIDEND 200
 
 #define WEIGHT_MIN 500
@@ -26,6 +32,13 @@
 
 #define LOOP_IDLE_CYCLE_MILLIS  10000
 
+#define BLOCK_READ_MAX_FAILURES 3   // Failed block reads in a row before they are given up for the session
+
+#define LISTEN_CACHE_SIZE       8
+#define LISTEN_STALE_MILLIS     3000
+#define LISTEN_LOOP_MILLIS      250
+#define BRIDGE_LOOP_MILLIS      100
+
 #define PID_SPEED       0x000d
 #define PID_MAF         0x0010
 #define PID_BURN_VALUE  0x005e
@@ -86,7 +99,7 @@ struct DisplayableItem {
 #define DISPLAYABLE_ITEM_INTAKE_TEMP        17
 #define DISPLAYABLE_ITEM_FUEL_TANK_LEVEL    18
 #define DISPLAYABLE_ITEM_FUEL_BURN_RATE     19
-#define DISPLAYABLE_ITEM_AIR_FUEL_TRIM.     20
+#define DISPLAYABLE_ITEM_AIR_FUEL_TRIM      20
 #define DISPLAYABLE_ITEM_AIR_FUEL_EQRATIO   21
 #define DISPLAYABLE_ITEM_OXY_SENSOR_A_VOLTS 22
 #define DISPLAYABLE_ITEM_OXY_SENSOR_B_VOLTS 23
@@ -137,6 +150,35 @@ static const DisplayableItem menu_displayables[] = {
   { '5', 'c',  0, "OYYYGGGgggccc",   "Batt",   "Volt",    "",    'V', false, false, 1, 0xff, 0,  0xffff,   0,    1,     1,   0,   1,      1,   10,   14,   10,  14 },
 };
 
+#if OBD_BLOCK_READ_ENABLED
+// Maps values in KWP record blocks (ReadDataByLocalIdentifier) onto displayables.
+// Raw values are converted to the encoding of the item's mode 01 PID, so the
+// usual shift, mask and scaling in menu_displayables apply unchanged.
+struct DisplayableBlockField {
+  uint8_t item;         // DISPLAYABLE_ITEM_*
+  uint8_t localId;      // record block
+  uint8_t offset;       // first data byte after local id
+  uint8_t length;       // big endian byte count
+  uint16_t multiplier;  // block units to PID units
+  uint16_t divisor;
+};
+
+// Record block layouts differ per ECU and none is known to be right for a given
+// car, so none ships.  Add one entry per field from your ECU's documentation,
+// sorted by local id; items left out are requested by pid as usual.
+static const DisplayableBlockField menu_blockFields[] = {
+};
+
+#define DISPLAYABLE_BLOCK_FIELD_COUNT (int)(sizeof(menu_blockFields)/sizeof(menu_blockFields[0]))
+#endif
+
+// Last value seen for each pid polled by another tester in listen mode
+struct DisplayableListenValue {
+  uint8_t pid;
+  unsigned long time;  // millis when seen, 0 if unused
+  long value;
+};
+
 //------------------------------------------------------
 // Private
 //------------------------------------------------------
@@ -155,6 +197,19 @@ static bool ds_resetting;
 static bool ds_persistedStateLoaded = false;
 static bool ds_debugModeEnabled = DEBUG_DEFAULT_VALUE;
 static int  ds_testProtocol = OBD_PROTOCOL_FIRST - 1;
+#if OBD_BLOCK_READ_ENABLED
+static bool ds_blockReadUnsupported;
+static uint8_t ds_blockReadFailures;   // In a row; a dropped frame shouldn't end block reads
+static long ds_blockValues[DISPLAYABLE_BLOCK_FIELD_COUNT];
+#endif
+static struct DisplayableListenValue ds_listenValues[LISTEN_CACHE_SIZE];
+#if TELEMETRY_ENABLED
+static struct DisplayableTelemetry ds_telemetry;
+static unsigned long ds_telemetryCycleStart;
+static unsigned long ds_telemetryUpdateStart;
+static bool ds_telemetryPending;
+#endif
+static bool ds_bridgeModeEnabled;
 static struct DisplayablesOutputProvider *ds_output;
 static struct MenuControlsProvider *ds_controls;
 
@@ -176,6 +231,7 @@ struct DisplayablePersistedState {
   long gears[GEAR_MAX_COUNT];
   int gearCount = 0;
   int kgWeight = 1400;
+  int listenModeEnabled;
 };
 
 static struct DisplayablePersistedState ds_persistedState;
@@ -186,20 +242,25 @@ struct DisplayableItem *ds_getDisplayableObject(int index) {
 struct DisplayableItem *ds_getCurrentDisplayableObject() {
   return ds_getDisplayableObject(ds_persistedState.currentItemIndex);
 }
+VObd *ds_getObd() {
+  return &vobd;
+}
+
+// True when gauges show values from traffic they didn't request (listen mode or bridge)
+bool ds_isPassive() {
+  return ds_persistedState.listenModeEnabled || ds_bridgeModeEnabled;
+}
 
 bool ds_isDisplayableHidden(int index) {
   return !!(ds_persistedState.itemsHiddenMask & (1L << index));
 } 
 
+unsigned long ds_getHiddenMask(MenuDataSource *ds) {
+  return ds_persistedState.itemsHiddenMask;
+}
+
 int ds_itemIndexFromVisibleIndex(int index) {
-  for (int i=0; i<DISPLAYABLE_ITEM_COUNT; i++) {
-    if (!ds_isDisplayableHidden(i)) {
-      if (--index < 0) {
-        return i;
-      }
-    }
-  }
-  return -1;
+  return vmenu.getItemIndex(index);
 }
 
 void ds_hideItem(int index) {
@@ -211,12 +272,12 @@ void ds_showItem(int index) {
 }
 
 void ds_loadPersistedState() {
-  for (int i=0; i<sizeof(ds_persistedState); i++) {
+  for (int i=0; i<(int)sizeof(ds_persistedState); i++) {
     ((unsigned char *)&ds_persistedState)[i] = EEPROM.read(i);
   }
 
   if (ds_persistedState.version != FLASH_VERSION) {
-    memset(&ds_persistedState, 0xff, sizeof(ds_persistedState));
+    memset((void *)&ds_persistedState, 0xff, sizeof(ds_persistedState));
     ds_persistedState.version = FLASH_VERSION;
   }
 
@@ -233,6 +294,7 @@ void ds_loadPersistedState() {
   if (ds_persistedState.hasAutoScannedItems < 0 || ds_persistedState.hasAutoScannedItems > 1) ds_persistedState.hasAutoScannedItems = 0;
   if (ds_persistedState.loopModeEnabled < 0 || ds_persistedState.loopModeEnabled > 1) ds_persistedState.loopModeEnabled = 0;
   if (ds_persistedState.demoModeEnabled < 0 || ds_persistedState.demoModeEnabled > 1) ds_persistedState.demoModeEnabled = DEMO_DEFAULT_VALUE;
+  if (ds_persistedState.listenModeEnabled < 0 || ds_persistedState.listenModeEnabled > 1) ds_persistedState.listenModeEnabled = 0;
   if (ds_persistedState.gearCount < 0 || ds_persistedState.gearCount > GEAR_MAX_COUNT) {
     ds_persistedState.gearCount = 5;
     ds_persistedState.gears[0] = 225 / 1.6 + 0.8;
@@ -249,9 +311,11 @@ void ds_loadPersistedState() {
 
 void ds_savePersistedState() {
   if (ds_persistedStateLoaded) {
-    for (int i=0; i<sizeof(ds_persistedState); i++) {
+    PROFILE_BEGIN(start);
+    for (int i=0; i<(int)sizeof(ds_persistedState); i++) {
       EEPROM.write(i, ((unsigned char *)&ds_persistedState)[i]);
     }
+    PROFILE_END(PROFILE_PHASE_EEPROM, start);
   }
 }
 
@@ -270,15 +334,15 @@ void ds_showStatusString_P(char *ptext) {
 }
 
 void ds_showStatusInteger(int num) {
-  char text[5];
-  snprintf_P(text, sizeof(text), PSTR("%-4d"), (int)num);
+  char text[8];
+  *VFormat::appendPadding(VFormat::appendDecimal(text, num), text, 4) = 0;
   ds_output->showStatusString(text);
   ds_controls->smartDelay(1000);
 }
 
 void ds_showStatusByte(int num) {
-  char text[5];
-  snprintf_P(text, sizeof(text), PSTR("= %02X"), (int)num);
+  char text[5] = "= ";
+  *VFormat::appendHex(text + 2, num, 2, false) = 0;
   ds_output->showStatusString(text);
   ds_controls->smartDelay(1000);
 }
@@ -287,12 +351,17 @@ void ds_showSweep(char color, int mode) {
   ds_output->showSweep(color, mode);
 }
 
+void ds_deferBar(bool deferred) {
+  if (ds_output->deferBar) ds_output->deferBar(deferred);
+}
+
 struct ObdOutputProvider ds_outputProvider = {
   ds_showStatusString,
   ds_showStatusString_P,
   ds_showStatusInteger,
   ds_showStatusByte,
-  ds_showSweep
+  ds_showSweep,
+  ds_deferBar
 };
 
 //------------------------------------------------------
@@ -300,6 +369,8 @@ struct ObdOutputProvider ds_outputProvider = {
 //------------------------------------------------------
 
 float ds_setValue(char *title, float value, float minVal, float maxVal, float interval1, float interval2, float interval3, int digits);
+float ds_scaleDisplayableValue(float fvalue, struct DisplayableItem *disp, bool useAltUnits);
+void  ds_releaseGearHistogram();
 
 int ds_getDisplayable() { 
   return ds_persistedState.currentItemIndex; 
@@ -343,15 +414,17 @@ bool ds_displayableLongPressAction(int current, int button, MenuDataSource *ds)
     ds_output->setBrightness(ds_persistedState.brightness);
     vmenu.highlightCurrentItem();
 
-    char text[5];
-    snprintf_P(text, sizeof(text), PSTR("br %d"), (int)ds_persistedState.brightness/25+1);
+    char text[8] = "br ";
+    *VFormat::appendDecimal(text + 3, ds_persistedState.brightness/25+1) = 0;
     ds_output->showStatusString(text);
     ds_controls->smartDelay(500);
 
     while(ds_controls->isButton2Down()) {}
-    return;
+    return false;
   }
 
+  // Settings may lease the arena, and gear detect restarts from there
+  ds_releaseGearHistogram();
   vsettings.showMenu();
   vmenu.showCurrentItem(false);
   return false;
@@ -367,18 +440,35 @@ static struct MenuDataSource ds_menuDataSource = {
   ds_isDisplayableHidden, 
   ds_displayableLongPressAction,
   NULL,
-  'I'
+  'I',
+  0,
+  NULL,
+  NULL,
+  NULL,
+  ds_getHiddenMask
 };
 
 //------------------------------------------------------
 // Private (gear support)
 //------------------------------------------------------
 
-static long gearRpkTable[(GEAR_NV_MAX - GEAR_NV_MIN)/GEAR_NV_INTERVAL+1];
+// N/V histogram, leased from the arena while the gear or N/V gauge is showing
+struct GearHistogram {
+  uint8_t bins[GEAR_BIN_COUNT];   // When one fills, all are halved, which keeps the peaks' shape
+  uint8_t peakMask[(GEAR_BIN_COUNT+7)/8];
+};
+static struct GearHistogram *gearHistogram = NULL;
+static uint8_t gearRefineSamples = 0;
 static long gearRpkSamplingMsRemaining = 0;
 
+void ds_releaseGearHistogram() {
+  VMemory::release(MEMORY_OWNER_GEARS);
+  gearHistogram = NULL;
+  gearRefineSamples = 0;
+}
+
 void ds_startGearDetect() {
-  memset(gearRpkTable, 0, sizeof(gearRpkTable));
+  ds_releaseGearHistogram();
   gearRpkSamplingMsRemaining = GEAR_DETECT_TIME;
   ds_persistedState.currentItemIndex = ds_lastItemIndex = DISPLAYABLE_ITEM_GEAR;
   ds_output->showSweep('G', SWEEP_MODE_RIGHT_LEFT);
@@ -393,7 +483,7 @@ void ds_sortGears() {
   qsort(ds_persistedState.gears, ds_persistedState.gearCount, sizeof(ds_persistedState.gears[0]), compareGears); // Standard C sort
 }
 
-int ds_showGears(void) {
+void ds_showGears(void) {
   bool useAltUnits = (ds_persistedState.itemsUsingAltUnitsMask & (1L << DISPLAYABLE_ITEM_GEAR));
   float mult = useAltUnits ? 1.0/0.6214 : 1;
 
@@ -410,6 +500,28 @@ int ds_showGears(void) {
   }
 }
 
+#if PROFILE_ENABLED
+// Name, average then peak ("H") milliseconds of each phase seen since the last showing
+void ds_showProfile(void) {
+  struct ProfilePhase phase;
+  char name[PROFILE_NAME_SIZE];
+
+  for (int i=0; i<PROFILE_PHASE_COUNT; i++) {
+    VProfile::getPhase(i, &phase);
+    if (!phase.count) continue;
+
+    VProfile::getPhaseName(i, name);
+    ds_output->showStatusString(name);
+    ds_controls->smartDelay(700);
+    ds_output->showFloatValue(phase.avgMicros / 1000.0, 1, 0, false);
+    ds_controls->smartDelay(1000);
+    ds_output->showFloatValue(phase.maxMicros / 1000.0, 1, 'H', false);
+    ds_controls->smartDelay(1000);
+  }
+  VProfile::reset();
+}
+#endif
+
 int ds_getGearCount(void) {
   return ds_persistedState.gearCount;
 }
@@ -450,17 +562,52 @@ void ds_editGear(int gear) {
   ds_savePersistedState();
 }
 
+bool ds_isGearPeak(int bin) {
+  return !!(gearHistogram->peakMask[bin/8] & (1 << (bin%8)));
+}
+
+// Local maxima, between the first and the last two bins
+bool ds_findGearPeak(int bin) {
+  if (bin < 1 || bin > GEAR_BIN_COUNT-3) return false;
+  int count = gearHistogram->bins[bin];
+  int below = gearHistogram->bins[bin-1];
+  int above = gearHistogram->bins[bin+1];
+  return count > below && count >= above && (count - below > GEAR_MIN_DIFF || count - above > GEAR_MIN_DIFF);
+}
+
+// True when the bin's peak flag changed
+bool ds_updateGearPeak(int bin) {
+  if (bin < 0 || bin >= GEAR_BIN_COUNT || ds_findGearPeak(bin) == ds_isGearPeak(bin)) return false;
+  gearHistogram->peakMask[bin/8] ^= 1 << (bin%8);
+  return true;
+}
+
+// Counts one sample, updating the peaks it can affect; true when any changed
+bool ds_addGearSample(float rpk) {
+  if (rpk < GEAR_NV_MIN || rpk > GEAR_NV_MAX) return false;
+  gearHistogram = (struct GearHistogram *)VMemory::lease(MEMORY_OWNER_GEARS, sizeof(struct GearHistogram));
+  if (!gearHistogram) return false;
+
+  int index = (rpk - GEAR_NV_MIN + GEAR_NV_INTERVAL/2) / GEAR_NV_INTERVAL;
+  bool changed = false;
+
+  if (gearHistogram->bins[index] == 0xff) {
+    for (int i=0; i<GEAR_BIN_COUNT; i++) gearHistogram->bins[i] /= 2;
+    for (int i=0; i<GEAR_BIN_COUNT; i++) changed |= ds_updateGearPeak(i);
+  }
+  gearHistogram->bins[index]++;
+  for (int i=index-1; i<=index+1; i++) changed |= ds_updateGearPeak(i);
+  return changed;
+}
+
 void ds_updateGears() {
   memset(ds_persistedState.gears, 0, sizeof(ds_persistedState.gears));
   int count = 0;
 
-  for (long rpk = GEAR_NV_MAX-GEAR_NV_INTERVAL-1; rpk >= GEAR_NV_MIN+GEAR_NV_INTERVAL; rpk -= GEAR_NV_INTERVAL) {
-    int j = (rpk - GEAR_NV_MIN + GEAR_NV_INTERVAL/2) / GEAR_NV_INTERVAL;
-
-    // Find local maxima
-    if (gearRpkTable[j] > gearRpkTable[j-1] && gearRpkTable[j] >= gearRpkTable[j+1] && 
-    (gearRpkTable[j] - gearRpkTable[j-1] > GEAR_MIN_DIFF || gearRpkTable[j] - gearRpkTable[j+1] > GEAR_MIN_DIFF)) {
-      ds_persistedState.gears[count] = rpk;
+  // Highest ratio (lowest gear) first
+  for (int bin = GEAR_BIN_COUNT-3; bin >= 1; bin--) {
+    if (ds_isGearPeak(bin)) {
+      ds_persistedState.gears[count] = GEAR_NV_MIN + bin * GEAR_NV_INTERVAL;
       if (++count >= GEAR_MAX_COUNT) break;
     }
   }
@@ -468,11 +615,32 @@ void ds_updateGears() {
 }
 
 void ds_updateGearTable(float rpk) {
-  if (rpk >= GEAR_NV_MIN && rpk <= GEAR_NV_MAX) {
-    int index = (rpk - GEAR_NV_MIN + GEAR_NV_INTERVAL/2) / GEAR_NV_INTERVAL;
-    gearRpkTable[index] ++;
+  if (ds_addGearSample(rpk)) ds_updateGears();
+}
+
+// Outside calibration, moves each gear to the strongest peak near it, keeping the gear count
+void ds_refineGears(float rpk) {
+  ds_addGearSample(rpk);
+  if (!gearHistogram || ++gearRefineSamples < GEAR_REFINE_SAMPLES) return;
+  gearRefineSamples = 0;
+
+  for (int i=0; i<ds_persistedState.gearCount; i++) {
+    int center = (ds_persistedState.gears[i] - GEAR_NV_MIN) / GEAR_NV_INTERVAL;
+    int best = -1;
+
+    for (int bin = center-GEAR_REFINE_BINS; bin <= center+GEAR_REFINE_BINS; bin++) {
+      if (bin < 0 || bin >= GEAR_BIN_COUNT || !ds_isGearPeak(bin)) continue;
+      if (best < 0 || gearHistogram->bins[bin] > gearHistogram->bins[best]) best = bin;
+    }
+    if (best < 0 || best == center) continue;
+
+    // Leave it if a neighbouring gear already has that peak
+    long rpk = GEAR_NV_MIN + best * GEAR_NV_INTERVAL;
+    bool taken = false;
+    for (int j=0; j<ds_persistedState.gearCount; j++) taken |= ds_persistedState.gears[j] == rpk;
+    if (!taken) ds_persistedState.gears[i] = rpk;
   }
-  ds_updateGears();
+  ds_sortGears();
 }
 
 int ds_getGear(float rpk) {
@@ -489,6 +657,230 @@ int ds_getGear(float rpk) {
   return best;
 }
 
+//------------------------------------------------------
+// Private (block read support)
+//------------------------------------------------------
+
+void ds_readBlockValues() {
+#if OBD_BLOCK_READ_ENABLED
+  unsigned char buf[SERIAL_MAX_BYTES];
+  int byteCount = 0;
+  int localId = -1;
+
+  for (int i=0; i<DISPLAYABLE_BLOCK_FIELD_COUNT; i++) {
+    const DisplayableBlockField *field = &menu_blockFields[i];
+    ds_blockValues[i] = -1;
+
+    if (ds_blockReadUnsupported || ds_isPassive()) continue;
+
+    // One transaction per record block, fields are sorted by local id
+    if (field->localId != localId) {
+      localId = field->localId;
+      byteCount = vobd.readLocalIdentifier(localId, buf, sizeof(buf), false);
+      if (byteCount <= 0) {
+        // A rejected service or record won't change this session
+        unsigned char nack = vobd.getLastNackCode();
+        if (nack == KWP_NACK_SERVICE_NOT_SUPPORTED || nack == KWP_NACK_SUB_FUNCTION_NOT_SUPPORTED || nack == KWP_NACK_REQUEST_OUT_OF_RANGE ||
+            ++ds_blockReadFailures >= BLOCK_READ_MAX_FAILURES) {
+          ds_blockReadUnsupported = true;
+        }
+        continue;
+      }
+      ds_blockReadFailures = 0;
+    }
+
+    if (field->offset + field->length <= byteCount) {
+      unsigned long value = 0;
+      for (int j=0; j<field->length; j++) {
+        value = (value << 8) | buf[field->offset + j];
+      }
+      ds_blockValues[i] = value * field->multiplier / field->divisor;
+    }
+  }
+#endif
+}
+
+long ds_getBlockValue(int item) {
+#if OBD_BLOCK_READ_ENABLED
+  for (int i=0; i<DISPLAYABLE_BLOCK_FIELD_COUNT; i++) {
+    if (menu_blockFields[i].item == item) {
+      return ds_blockValues[i];
+    }
+  }
+#endif
+  return -1;
+}
+
+//------------------------------------------------------
+// Private (listen mode support)
+//------------------------------------------------------
+
+void ds_storeListenValues(unsigned char *pids, long *values, int count) {
+  unsigned long time = millis() | 1;
+
+  for (int i=0; i<count; i++) {
+    // Reuse the pid's slot, else the oldest one
+    int slot = 0;
+    for (int j=0; j<LISTEN_CACHE_SIZE; j++) {
+      if (ds_listenValues[j].time && ds_listenValues[j].pid == pids[i]) { slot = j; break; }
+      if ((long)(ds_listenValues[j].time - ds_listenValues[slot].time) < 0) slot = j;
+    }
+    ds_listenValues[slot].pid = pids[i];
+    ds_listenValues[slot].time = time;
+    ds_listenValues[slot].value = values[i];
+  }
+}
+
+// Decodes traffic from another tester for a while, caching every pid value seen
+void ds_listenForValues() {
+  unsigned char pids[OBD_MAX_PIDS_PER_REQUEST];
+  long values[OBD_MAX_PIDS_PER_REQUEST];
+  unsigned long start = millis();
+
+  do {
+    int count = vobd.listenForPids(pids, values, OBD_MAX_PIDS_PER_REQUEST);
+    ds_storeListenValues(pids, values, count);
+  } while (millis() - start < LISTEN_LOOP_MILLIS);
+}
+
+// Milliseconds since the pid was last seen, or -1 if never
+long ds_getListenAge(unsigned char pid) {
+  for (int i=0; i<LISTEN_CACHE_SIZE; i++) {
+    if (ds_listenValues[i].time && ds_listenValues[i].pid == pid) {
+      // Stored time is rounded up to be non-zero, so may be 1ms ahead
+      return max(0L, (long)(millis() - ds_listenValues[i].time));
+    }
+  }
+  return -1;
+}
+
+// Cached value of the pid, or -1 if never seen or stale
+long ds_getListenValue(unsigned char pid) {
+  long age = ds_getListenAge(pid);
+  if (age < 0 || age > LISTEN_STALE_MILLIS) return -1;
+
+  for (int i=0; i<LISTEN_CACHE_SIZE; i++) {
+    if (ds_listenValues[i].time && ds_listenValues[i].pid == pid) {
+      return ds_listenValues[i].value;
+    }
+  }
+  return -1;
+}
+
+// Shows why a gauge doesn't update when the other tester doesn't poll its pid
+void ds_showListenStatus(unsigned char pid) {
+  if (ds_isPassive()) {
+    ds_output->showStatusString_P(ds_getListenAge(pid) < 0 ? PSTR("Lisn") : PSTR("Old "));
+  }
+}
+
+//------------------------------------------------------
+// Private (value fetching)
+//------------------------------------------------------
+
+// Returns value from the last record block if covered, else requests the pid
+long ds_fetchItemValue(int item, unsigned char pid, bool showErrors, int debugMode) {
+  if (ds_isPassive()) return ds_getListenValue(pid);
+
+  long value = ds_getBlockValue(item);
+  if (value < 0) {
+    vobd.sendPidRequest(pid, 1);
+    value = vobd.receivePidResponse(pid, 1, showErrors, debugMode);
+  }
+  return value;
+}
+
+// Same as above for several items, batching the pids not covered by a block;
+// bit i of errorMask shows errors for items[i]
+void ds_fetchItemValues(int *items, unsigned char *pids, long *values, int count, unsigned char errorMask) {
+  unsigned char requestPids[OBD_MAX_PIDS_PER_REQUEST];
+  long requestValues[OBD_MAX_PIDS_PER_REQUEST];
+  int requestIndexes[OBD_MAX_PIDS_PER_REQUEST];
+  int requestCount = 0;
+  unsigned char requestErrorMask = 0;
+
+  // Listening or bridging never transmits, so a cache miss stays a miss
+  if (ds_isPassive()) {
+    for (int i=0; i<count; i++) {
+      values[i] = ds_getListenValue(pids[i]);
+    }
+    return;
+  }
+
+  for (int i=0; i<count; i++) {
+    values[i] = ds_getBlockValue(items[i]);
+    if (values[i] < 0 && requestCount < OBD_MAX_PIDS_PER_REQUEST) {
+      if (errorMask & (1 << i)) requestErrorMask |= 1 << requestCount;
+      requestPids[requestCount] = pids[i];
+      requestIndexes[requestCount++] = i;
+    }
+  }
+  if (requestCount) {
+    vobd.requestPids(requestPids, requestCount, requestValues, requestErrorMask, true);
+    for (int i=0; i<requestCount; i++) {
+      values[requestIndexes[i]] = requestValues[i];
+    }
+  }
+}
+
+//------------------------------------------------------
+// Private (telemetry support)
+//------------------------------------------------------
+
+// Without TELEMETRY_ENABLED these do nothing, so the update cycle skips the scaling
+void ds_startTelemetry() {
+#if TELEMETRY_ENABLED
+  ds_telemetryUpdateStart = millis();
+  ds_telemetry.sampleCount = 0;
+  ds_telemetryPending = true;
+#endif
+}
+
+void ds_addTelemetrySample(int item, long raw) {
+#if TELEMETRY_ENABLED
+  struct DisplayableItem *disp = ds_getDisplayableObject(item);
+
+  for (int i=0; i<ds_telemetry.sampleCount; i++) {
+    if (ds_telemetry.samples[i].pid == disp->pid) return;
+  }
+  if (ds_telemetry.sampleCount >= DISPLAYABLE_TELEMETRY_MAX_SAMPLES) return;
+
+  struct DisplayableTelemetrySample *sample = &ds_telemetry.samples[ds_telemetry.sampleCount++];
+  sample->pid = disp->pid;
+  sample->raw = raw;
+  sample->scaled = (raw < 0) ? 0 : ds_scaleDisplayableValue((float)(((unsigned long)raw >> disp->shift) & disp->mask), disp, false);
+#endif
+}
+
+#if TELEMETRY_ENABLED
+void ds_updateTelemetryCounters() {
+  ds_telemetry.requestErrorCount = ds_requestErrorCount;
+  ds_telemetry.totalRequestErrorCount = ds_totalRequestErrorCount;
+  ds_telemetry.connectionErrorCount = ds_connectionErrorCount;
+  ds_telemetry.protocol = vobd.isConnected() ? ds_testProtocol : 0;
+  ds_telemetry.totalElapsedSeconds = ds_persistedState.totalElapsedSeconds;
+  ds_telemetry.totalDrivenKilometers = ds_persistedState.totalDrivenKilometers;
+  ds_telemetry.totalConsumedFuelLitres = ds_persistedState.totalConsumedFuelLitres;
+}
+#endif
+
+// Closes the update cycle, sending one frame if the output provider takes them
+void ds_sendTelemetry() {
+#if TELEMETRY_ENABLED
+  if (!ds_telemetryPending) return;
+
+  unsigned long time = millis();
+  ds_telemetry.sequence++;
+  ds_telemetry.cycleMillis = min(time - ds_telemetryCycleStart, 0xffffUL);
+  ds_telemetry.updateMillis = min(time - ds_telemetryUpdateStart, 0xffffUL);
+  ds_updateTelemetryCounters();
+  if (ds_output->sendTelemetry) ds_output->sendTelemetry(&ds_telemetry);
+
+  ds_telemetryCycleStart = time;
+  ds_telemetryPending = false;
+#endif
+}
+
 //------------------------------------------------------
 // Private (settings support)
 //------------------------------------------------------
@@ -545,7 +937,7 @@ void ds_adjustTime(void) {
 }
 
 void ds_clearPersistedState(void) {
-  for (int i=0; i<sizeof(ds_persistedState); i++) {
+  for (int i=0; i<(int)sizeof(ds_persistedState); i++) {
     ((unsigned char *)&ds_persistedState)[i] = -1;
   }
   ds_savePersistedState();
@@ -571,7 +963,7 @@ void ds_autoScanItemsAt(int base) {
   unsigned char buf[4];
 
   if (ds_persistedState.demoModeEnabled) {
-    *(long *)buf = 0xffffffff;
+    memset(buf, 0xff, sizeof(buf));
   } else {
     vobd.sendPidRequest(base, 1);
     if (4 > vobd.receivePidResponseData(buf, 4, base, 1, true, false)) {
@@ -597,7 +989,9 @@ void ds_autoScanItemsAt(int base) {
 
   for (int i=0; i<4; i++) {
      char tbuf[6];
-     snprintf_P(tbuf, sizeof(tbuf), PSTR("%02X.%02X"), (int)(base + i*8 + 1), (int)buf[i]);
+     char *p = VFormat::appendHex(tbuf, base + i*8 + 1, 2, false);
+     *p++ = '.';
+     *VFormat::appendHex(p, buf[i], 2, false) = 0;
      ds_showStatusString(tbuf);
   }
 }
@@ -678,7 +1072,7 @@ void ds_showDtcMonitors(void) {
   vobd.sendPidRequest(0x01, 1);
   unsigned long value = vobd.receivePidResponse(0x01, 1, true, 0);
 
-  if (value != -1) {
+  if (value != (unsigned long)-1) {
     int a = value >> 24;
     int b = (value >> 16) & 0xff;
     int c = (value >> 8) & 0xff;
@@ -754,7 +1148,7 @@ void ds_showDtcCode(long value) {
     case 0xc0: ds_showStatusString_P(PSTR(" U- ") ); break;
   }
   char buf[6];
-  snprintf_P(buf, sizeof(buf), PSTR("%04lx"), value & 0x3fff);
+  *VFormat::appendHex(buf, value & 0x3fff, 4, true) = 0;
   ds_showStatusString(buf);
   ds_controls->smartDelay(2000);
 }
@@ -784,7 +1178,7 @@ void ds_showDtcCodes(void) {
 void ds_clearDtcCodes(void) {
   vobd.sendPidRequest(0x00, 4);
   unsigned long value = vobd.receivePidResponse(0x0, 4, true, 0);
-  if (value != -1) {
+  if (value != (unsigned long)-1) {
     ds_showStatusString_P(PSTR("Done"));
     ds_controls->smartDelay(2000);
   }
@@ -807,6 +1201,13 @@ void ds_toggleDebugMode(void) {
   ds_debugModeEnabled = !ds_debugModeEnabled;
 }
 
+void ds_toggleListenMode(void) {
+  // When on, never transmits and only shows values polled by another tester
+  ds_persistedState.listenModeEnabled = !ds_persistedState.listenModeEnabled;
+  ds_savePersistedState();
+  vobd.disconnect();
+}
+
 void ds_enterSniffMode(int mode) {
   ds_debugModeEnabled = true; // disable pings
 
@@ -868,6 +1269,22 @@ bool ds_isCurrentItemComputed(void) {
   return false;
 }
 
+bool ds_isItemPidValue(int index) {
+  // Items showing a (scaled) pid value rather than an accumulated or derived one
+  switch (index) {
+    case DISPLAYABLE_ITEM_TOTAL_DISTANCE:
+    case DISPLAYABLE_ITEM_TOTAL_TIME:
+    case DISPLAYABLE_ITEM_TOTAL_FUEL:
+    case DISPLAYABLE_ITEM_AVERAGE_SPEED:
+    case DISPLAYABLE_ITEM_AVERAGE_EFFICIENCY:
+    case DISPLAYABLE_ITEM_BATTERY_VOLTS:
+    case DISPLAYABLE_ITEM_GFORCE:
+    case DISPLAYABLE_ITEM_HORSEPOWER:
+      return false;
+  }
+  return true;
+}
+
 char *ds_getCurrentItemAltUnits(void) {
   if ((ds_persistedState.itemsUsingAltUnitsMask & (1L << ds_persistedState.currentItemIndex)) && ds_getCurrentDisplayableObject()->unit2[0]) {
     return ds_getCurrentDisplayableObject()->unit2;
@@ -876,11 +1293,29 @@ char *ds_getCurrentItemAltUnits(void) {
   }
 }
 
-static char dsHiddenItemTitlesBuf[DISPLAYABLE_ITEM_COUNT*8];
+// Title and unit strings, leased from the arena while the settings gauges menu is open
+struct HiddenItemNames {
+  char titles[DISPLAYABLE_ITEM_COUNT*8];
+  char units[DISPLAYABLE_ITEM_COUNT*8];
+};
 static char *dsHiddenItemTitles[DISPLAYABLE_ITEM_COUNT+1];
+static char *dsHiddenItemUnits[DISPLAYABLE_ITEM_COUNT+1];
+
+// Lists are just BACK when the arena is taken
+struct HiddenItemNames *ds_leaseHiddenItemNames(char **list) {
+  struct HiddenItemNames *names = (struct HiddenItemNames *)VMemory::lease(MEMORY_OWNER_HIDDEN_ITEMS, sizeof(struct HiddenItemNames));
+  if (!names) {
+    list[0] = "BACK";
+    list[1] = NULL;
+  }
+  return names;
+}
 
 char **ds_getHiddenItemTitles(void) {
-  char *buf = dsHiddenItemTitlesBuf;
+  struct HiddenItemNames *names = ds_leaseHiddenItemNames(dsHiddenItemTitles);
+  if (!names) return dsHiddenItemTitles;
+
+  char *buf = names->titles;
   char **titles = dsHiddenItemTitles;
 
   // Add initial menu (a little odd that it is here)
@@ -901,11 +1336,11 @@ char **ds_getHiddenItemTitles(void) {
   return dsHiddenItemTitles;
 } 
 
-static char dsHiddenItemUnitsBuf[DISPLAYABLE_ITEM_COUNT*8];
-static char *dsHiddenItemUnits[DISPLAYABLE_ITEM_COUNT+1];
-
 char **ds_getHiddenItemUnits(void) {
-  char *buf = dsHiddenItemUnitsBuf;
+  struct HiddenItemNames *names = ds_leaseHiddenItemNames(dsHiddenItemUnits);
+  if (!names) return dsHiddenItemUnits;
+
+  char *buf = names->units;
   char **titles = dsHiddenItemUnits;
 
   // Add initial menu (a little odd that it is here)
@@ -930,6 +1365,10 @@ char **ds_getHiddenItemUnits(void) {
   return dsHiddenItemUnits;
 } 
 
+void ds_releaseHiddenItems(void) {
+  VMemory::release(MEMORY_OWNER_HIDDEN_ITEMS);
+}
+
 static struct SettingsDataSource ds_settingsDataSource = {
   ds_clearHistory,
   ds_clearDistance,
@@ -959,7 +1398,13 @@ static struct SettingsDataSource ds_settingsDataSource = {
   ds_toggleLoopMode,
   ds_toggleDemoMode,
   ds_toggleDebugMode,
+  ds_toggleListenMode,
   ds_enterSniffMode,
+#if PROFILE_ENABLED
+  ds_showProfile,
+#else
+  NULL,
+#endif
 
   ds_isCurrentItemHidden,
   ds_isCurrentItemMultiUnit,
@@ -967,12 +1412,27 @@ static struct SettingsDataSource ds_settingsDataSource = {
   ds_getCurrentItemAltUnits,
   ds_getHiddenItemTitles,
   ds_getHiddenItemUnits,
+  ds_releaseHiddenItems,
 };
 
 void ds_showStatusState() {
   ds_output->showStatusState(ds_connecting, ds_resetting, ds_requestErrorCount, ds_connectionErrorCount, ds_testProtocol - OBD_PROTOCOL_FIRST);
 }
 
+// Counts bridge failures like the gauge's own requests, dropping the session after enough
+void ds_bridgeResult(int count) {
+  if (count < 0) {
+    ++ds_totalRequestErrorCount;
+    if (++ds_requestErrorCount >= 3) {
+      vobd.disconnect();
+      ds_requestErrorCount = 0;
+    }
+  } else {
+    ds_requestErrorCount = 0;
+  }
+  ds_showStatusState();
+}
+
 float ds_scaleDisplayableValue(float fvalue, struct DisplayableItem *disp, bool useAltUnits) {
   if (!ds_persistedState.demoModeEnabled) {
     fvalue += (useAltUnits) ? disp->offset2 : disp->offset1;
@@ -1085,7 +1545,7 @@ extern void VDisplayables::setup(int inPin, int outPin, int powerAnalogPin, stru
       for (int i=0; i<barCount; i++) ds_output->setBarColor(i, 'k'); 
       ds_output->showBar(); 
 
-      while ((ds_controls->isButton1Down() || ds_controls->isButton2Down()) && millis() < end+2000L) {}
+      while ((ds_controls->isButton1Down() || ds_controls->isButton2Down()) && (long)millis() < end+2000L) {}
 
       if (b1 && b2) {
         ds_clearPersistedState();
@@ -1100,11 +1560,191 @@ extern void VDisplayables::setup(int inPin, int outPin, int powerAnalogPin, stru
       break;
     }
   }
+
+  // Presses that chose an override aren't menu input
+  struct ButtonEvent event;
+  while (ds_controls->readButtonEvent(&event)) {}
+#endif
+}
+
+extern void VDisplayables::setCaptureProvider(struct SerialCaptureProvider *provider) {
+  vobd.setCaptureProvider(provider);
+}
+
+extern void VDisplayables::setBridgeMode(bool enabled) {
+  ds_bridgeModeEnabled = enabled;
+}
+
+// Forwards a request from a host (ELM327 bridge), connecting first if needed.
+// Mode 01 values in the response also feed the gauges.
+extern int VDisplayables::bridgeRequest(int protocol, unsigned char *data, int length, unsigned char *response, int maxBytes) {
+  if (!bridgeConnect(protocol)) return DISPLAYABLE_BRIDGE_NOT_CONNECTED;
+
+  int count = vobd.request(data, length, response, maxBytes);
+  ds_bridgeResult(count);
+
+  if (count > 1 && response[0] == 0x41) {
+    unsigned char pids[OBD_MAX_PIDS_PER_REQUEST];
+    long values[OBD_MAX_PIDS_PER_REQUEST];
+    int pidCount = 0;
+
+    for (int i=1; i<count && pidCount<OBD_MAX_PIDS_PER_REQUEST; ) {
+      int pidLength = vobd.getPidDataLength(response[i]);
+      if (!pidLength || i + 1 + pidLength > count) break;
+      pids[pidCount] = response[i++];
+      values[pidCount] = 0;
+      for (int j=0; j<pidLength; j++) values[pidCount] = (values[pidCount] << 8) | response[i++];
+      pidCount++;
+    }
+    ds_storeListenValues(pids, values, pidCount);
+  }
+  return count;
+}
+
+// Same for several mode 01 pids, batched into one request where the ECU allows it.
+// Each pid is a separate host command, so one failing doesn't skip the others.
+extern int VDisplayables::bridgeRequestPids(int protocol, unsigned char *pids, int count, long *values) {
+  if (!bridgeConnect(protocol)) return DISPLAYABLE_BRIDGE_NOT_CONNECTED;
+
+  for (int i=0; i<count; i++) values[i] = -1;
+  int found = vobd.requestPids(pids, count, values, 0, false);
+  ds_bridgeResult(found > 0 ? found : -1);
+
+  for (int i=0; i<count; i++) {
+    if (values[i] >= 0) ds_storeListenValues(pids + i, values + i, 1);
+  }
+  return found;
+}
+
+extern bool VDisplayables::bridgeConnect(int protocol) {
+  if (vobd.isConnected()) return true;
+
+  // Requested protocol only, else the saved one followed by the others
+  int first = protocol ? protocol : ds_persistedState.protocol;
+  int protocolCount = OBD_PROTOCOL_LAST - OBD_PROTOCOL_FIRST + 1;
+  if (first == OBD_PROTOCOL_AUTOMATIC) first = OBD_PROTOCOL_FIRST;
+
+  for (int i=0; i<(protocol ? 1 : protocolCount) && !vobd.isConnected(); i++) {
+    ds_testProtocol = OBD_PROTOCOL_FIRST + (first - OBD_PROTOCOL_FIRST + i) % protocolCount;
+    ds_connecting = true; ds_showStatusState();
+    vobd.connect(ds_testProtocol, ds_persistedState.demoModeEnabled);
+    ds_connecting = false; ds_showStatusState();
+  }
+  return vobd.isConnected();
+}
+
+extern void VDisplayables::bridgeDisconnect() {
+  vobd.disconnect();
+}
+
+extern int VDisplayables::getBridgeProtocol() {
+  return vobd.isConnected() ? ds_testProtocol : 0;
+}
+
+extern unsigned char VDisplayables::getBridgeNackCode() {
+  return vobd.getLastNackCode();
+}
+
+extern int VDisplayables::getPidDataLength(unsigned char pid) {
+  return vobd.getPidDataLength(pid);
+}
+
+extern float VDisplayables::getBatteryVolts() {
+  return analogRead(ds_powerAnalogPin) * (5.0 * BATTERY_VOLTAGE_DIVIDE / 1023.0);
+}
+
+extern int VDisplayables::getItemCount() {
+  return DISPLAYABLE_ITEM_COUNT;
+}
+
+extern int VDisplayables::getCurrentItem() {
+  return ds_persistedState.currentItemIndex;
+}
+
+extern void VDisplayables::selectItem(int index) {
+  if (index < 0 || index >= DISPLAYABLE_ITEM_COUNT) return;
+  ds_persistedState.currentItemIndex = index;
+  ds_lastLoopChangeMillis = millis();
+  vmenu.highlightCurrentItem();
+  showCurrentItem();
+}
+
+extern char *VDisplayables::getItemName(int index) {
+  return ds_getDisplayableObject(index)->name;
+}
+
+extern bool VDisplayables::isItemHidden(int index) {
+  return ::ds_isDisplayableHidden(index);
+}
+
+// Raw access to the EEPROM image, so a host can back up and restore settings.
+// Writes take effect on the next loadPersistedState(), which validates them.
+extern int VDisplayables::readPersistedState(int offset, unsigned char *bytes, int count) {
+  if (offset < 0 || offset >= (int)sizeof(ds_persistedState)) return 0;
+  count = min(count, (int)sizeof(ds_persistedState) - offset);
+  for (int i=0; i<count; i++) bytes[i] = EEPROM.read(offset + i);
+  return count;
+}
+
+extern int VDisplayables::writePersistedState(int offset, unsigned char *bytes, int count) {
+  if (offset < 0 || count < 0 || offset + count > (int)sizeof(ds_persistedState)) return 0;
+  for (int i=0; i<count; i++) EEPROM.update(offset + i, bytes[i]);
+  return count;
+}
+
+extern void VDisplayables::loadPersistedState() {
+  ds_loadPersistedState();
+  ds_output->setBrightness(ds_persistedState.brightness);
+  vobd.disconnect();
+  selectItem(ds_persistedState.currentItemIndex);
+}
+
+// Last completed update cycle's timing, with current counters and totals; zeros unless TELEMETRY_ENABLED
+extern void VDisplayables::getTelemetry(struct DisplayableTelemetry *telemetry) {
+#if TELEMETRY_ENABLED
+  ds_updateTelemetryCounters();
+  *telemetry = ds_telemetry;
+#else
+  memset(telemetry, 0, sizeof(*telemetry));
 #endif
 }
 
+// NULL unless OBD_STATS_ENABLED
+extern struct ObdStats *VDisplayables::getObdStats() {
+#if OBD_STATS_ENABLED
+  return vobd.getStats();
+#else
+  return NULL;
+#endif
+}
+
+extern void VDisplayables::resetObdStats() {
+#if OBD_STATS_ENABLED
+  vobd.resetStats();
+#endif
+}
+
+extern bool VDisplayables::getMode(int mode) {
+  switch (mode) {
+    case DISPLAYABLE_MODE_LOOP:   return ds_persistedState.loopModeEnabled;
+    case DISPLAYABLE_MODE_DEMO:   return ds_persistedState.demoModeEnabled;
+    case DISPLAYABLE_MODE_DEBUG:  return ds_debugModeEnabled;
+    case DISPLAYABLE_MODE_LISTEN: return ds_persistedState.listenModeEnabled;
+  }
+  return false;
+}
+
+extern void VDisplayables::toggleMode(int mode) {
+  switch (mode) {
+    case DISPLAYABLE_MODE_LOOP:   ds_toggleLoopMode(); break;
+    case DISPLAYABLE_MODE_DEMO:   ds_toggleDemoMode(); break;
+    case DISPLAYABLE_MODE_DEBUG:  ds_toggleDebugMode(); break;
+    case DISPLAYABLE_MODE_LISTEN: ds_toggleListenMode(); break;
+  }
+}
+
 extern void VDisplayables::mainLoop() {
-  if (!vobd.isConnected()) {
+  if (!vobd.isConnected() && !ds_isPassive()) {
     showCurrentItem();
     vmenu.mainLoop(false);
     vmenu.highlightCurrentItem();
@@ -1130,14 +1770,32 @@ extern void VDisplayables::mainLoop() {
     } 
   }
 
+  // Listen only; values come from another tester polling the ECU, or
+  // from requests the bridge forwards while waiting here
+  if (ds_isPassive()) {
+    // Another tester or the bridge's host drives the bus, so a ring refresh,
+    // which blocks interrupts, waits for the gap after this pass's traffic
+    ds_deferBar(true);
+    if (ds_bridgeModeEnabled) {
+      ds_controls->smartDelay(BRIDGE_LOOP_MILLIS);
+    } else {
+      ds_listenForValues();
+    }
+    updateCurrentItemValue();
+    ds_deferBar(false);
+    ds_sendTelemetry();
+    return;
+  }
+
   // Connect if needed
   if (!vobd.isConnected()) {
     ds_output->showStatusString_P(PSTR("Init"));
     ds_output->showSweep('r', SWEEP_MODE_RIGHT_LEFT);
 
-    // Show error counts
+    // Show error counts, then SRAM never reached by the stack
     if (ds_debugModeEnabled) {
-      char counts[4];
+      char counts[5];
+      struct MemoryUsage memory;
       counts[0] = 'E';
       counts[1] = ds_connectionErrorCount + '0';
       counts[2] = ds_totalRequestErrorCount + '0';
@@ -1145,6 +1803,12 @@ extern void VDisplayables::mainLoop() {
       counts[4] = 0;
       ds_output->showStatusString(counts);
       ds_controls->smartDelay(500);
+
+      VMemory::getUsage(&memory);
+      counts[0] = 'F';
+      *VFormat::appendDecimal(counts + 1, min(memory.freeBytes, 999U)) = 0;
+      ds_output->showStatusString(counts);
+      ds_controls->smartDelay(500);
     }
 
     // Reset current protocol to auto if enough failures
@@ -1174,6 +1838,11 @@ extern void VDisplayables::mainLoop() {
     ds_connecting = false; ds_showStatusState();
 
     if (vobd.isConnected()) {
+#if OBD_BLOCK_READ_ENABLED
+      ds_blockReadUnsupported = false;
+      ds_blockReadFailures = 0;
+#endif
+
       if (!ds_persistedState.hasAutoScannedItems) {
         ds_persistedState.hasAutoScannedItems = 1;
         ds_savePersistedState();
@@ -1207,6 +1876,8 @@ extern void VDisplayables::mainLoop() {
     }
   } 
 
+  ds_sendTelemetry();
+
   // Reset if not connected at end of loop
   if (!vobd.isConnected()) {
       ds_connectionErrorCount++; ds_showStatusState();
@@ -1238,6 +1909,7 @@ extern bool VDisplayables::updateCurrentItemValue() {
     ds_persistedState.totalElapsedSeconds += ((double)(deltaMs))/1000.0;
   } 
   lastMillis = ms;
+  ds_startTelemetry();
 
   //
   // DEMO MODE
@@ -1300,21 +1972,33 @@ extern bool VDisplayables::updateCurrentItemValue() {
 
   else {
 
-    // Always fetch speed (in km/hr) and fuel consumption (in l/20hr) for accumulated values
-    vobd.sendPidRequest(PID_SPEED, 1);
-    long speedValue = vobd.receivePidResponse(PID_SPEED, 1, true, 0);
+    // Refresh all values covered by record blocks in one transaction
+    ds_readBlockValues();
+
+    // Always fetch speed (in km/hr) and fuel consumption (in l/20hr) for accumulated values,
+    // along with the displayed pid in the same request where the ECU allows it
+    int items[3] = { DISPLAYABLE_ITEM_SPEED, DISPLAYABLE_ITEM_FUEL_BURN_RATE, ds_persistedState.currentItemIndex };
+    unsigned char pids[3] = { PID_SPEED, PID_BURN_VALUE, disp->pid };
+    long values[3];
+    bool batchDisplayedPid = !ds_debugModeEnabled && ds_isItemPidValue(ds_persistedState.currentItemIndex) &&
+                             disp->pid != PID_SPEED && disp->pid != PID_BURN_VALUE && disp->pid != PID_MAF;
+
+    // Errors for speed and the displayed pid, but not burn rate as it's optional
+    ds_fetchItemValues(items, pids, values, batchDisplayedPid ? 3 : 2, (1 << 0) | (1 << 2));
+    long speedValue = values[0];
+    long burnValue = values[1];
     long mafValue = -1;
-
-    float deltaSpeedValue = speedValue - lastSpeedValue;
-    if (deltaMs > 0) {
-      lastSpeedValue = speedValue;
-    }
+    ds_addTelemetrySample(DISPLAYABLE_ITEM_SPEED, speedValue);
+    ds_addTelemetrySample(DISPLAYABLE_ITEM_FUEL_BURN_RATE, burnValue);
 
     // Speed should be supported by everything, so return error if no
-    if (speedValue == -1) return false;
+    // (unless listening, where it depends on what the other tester polls)
+    if (speedValue == -1 && !ds_isPassive()) return false;
 
-    vobd.sendPidRequest(PID_BURN_VALUE, 1);
-    long burnValue = vobd.receivePidResponse(PID_BURN_VALUE, 1, false, 0); // swallow error silently as not critical
+    float deltaSpeedValue = (speedValue < 0) ? 0 : speedValue - lastSpeedValue;
+    if (deltaMs > 0 && speedValue >= 0) {
+      lastSpeedValue = speedValue;
+    }
 
     // If burn value is not available, estimate from MAF
     // - divide by 14.7 (ideal air/fuel ratio) to get g/s of gas
@@ -1322,8 +2006,8 @@ extern bool VDisplayables::updateCurrentItemValue() {
     // - divide by 740g/l to get l/hour of gas
     // - divide by 5 for difference between burn/maf rate formula divisors
     if (burnValue < 0 || (burnValue == 0 && speedValue > 0)) {
-      vobd.sendPidRequest(PID_MAF, 1);
-      mafValue = vobd.receivePidResponse(PID_MAF, 1, false, 0);
+      mafValue = ds_fetchItemValue(DISPLAYABLE_ITEM_INTAKE_AIR_FLOW, PID_MAF, false, 0);
+      ds_addTelemetrySample(DISPLAYABLE_ITEM_INTAKE_AIR_FLOW, mafValue);
       if (mafValue >= 0) {
         burnValue = (float)mafValue * (3600.0 / (14.7 * 740 * 5));
       }
@@ -1422,14 +2106,22 @@ extern bool VDisplayables::updateCurrentItemValue() {
           value = (float)burnValue * ds_persistedState.fuelAdjustment;
         }
 
-        // Else get PID value
+        // Use value fetched with speed if batched
+        else if (batchDisplayedPid) {
+          // Just return 0 if PID is not supported, as some are optional
+          value = values[2];
+          if (value == -1) { ds_showListenStatus(disp->pid); return 0; }
+        }
+
+        // Else get block or PID value
         else {
-          vobd.sendPidRequest(disp->pid, 1);
           // Just return 0 if PID is not supported, as some are optional
-          value = vobd.receivePidResponse(disp->pid, 1, true, ds_debugModeEnabled);
-          if (value == -1) return 0;
+          value = ds_fetchItemValue(ds_persistedState.currentItemIndex, disp->pid, true, ds_debugModeEnabled);
+          if (value == -1) { ds_showListenStatus(disp->pid); return 0; }
         }
 
+        ds_addTelemetrySample(ds_persistedState.currentItemIndex, value);
+
         // Offset and scale value
         value = (unsigned long)value >> disp->shift;
         value &= disp->mask;
@@ -1457,7 +2149,11 @@ extern bool VDisplayables::updateCurrentItemValue() {
 
               ds_showGears();
             }
+          } else if (deltaMs > 0 && speedValue > 0) {
+            ds_refineGears(fvalue);
           }
+        } else {
+          ds_releaseGearHistogram();
         }
     }
   }
@@ -1534,13 +2230,17 @@ extern bool VDisplayables::updateCurrentItemValue() {
 }
 
 extern void VDisplayables::ping() {
-  if (!ds_persistedState.demoModeEnabled) {
+  // Never transmit while sniffing, listening or in demo mode
+  if (!ds_persistedState.demoModeEnabled && !ds_debugModeEnabled && !ds_persistedState.listenModeEnabled) {
     vobd.ping();
   }
 }
 
 extern bool VDisplayables::showCurrentItem() {
-  return vmenu.showCurrentItem(true);
+  PROFILE_BEGIN(start);
+  bool result = vmenu.showCurrentItem(true);
+  PROFILE_END(PROFILE_PHASE_TITLES, start);
+  return result;
 }
 
 extern bool VDisplayables::savePersistedState() {
@@ -2,6 +2,7 @@
 #define _VDISPLAYABLES
 
 #include "VMenu.h"
+#include "VSerial.h"
 
 ///////////////////////////////////////////////////////////////
 // DISPLAYABLES.H
@@ -12,6 +13,41 @@
 #define SWEEP_MODE_UP         1
 #define SWEEP_MODE_DOWN       2
 
+// Snapshot of one update cycle, handed to the output provider for logging
+
+#define DISPLAYABLE_TELEMETRY_MAX_SAMPLES 4
+
+struct DisplayableTelemetrySample {
+  uint8_t pid;
+  long  raw;     // as received, -1 if not supported
+  float scaled;  // primary units
+};
+
+struct DisplayableTelemetry {
+  uint8_t sequence;        // wraps, lets the host detect dropped frames
+  unsigned int cycleMillis;
+  unsigned int updateMillis;
+  uint8_t requestErrorCount;
+  uint8_t totalRequestErrorCount;
+  uint8_t connectionErrorCount;
+  uint8_t protocol;
+  float totalElapsedSeconds;
+  float totalDrivenKilometers;
+  float totalConsumedFuelLitres;
+  uint8_t sampleCount;
+  struct DisplayableTelemetrySample samples[DISPLAYABLE_TELEMETRY_MAX_SAMPLES];
+};
+
+struct ObdStats;
+
+#define DISPLAYABLE_BRIDGE_NOT_CONNECTED -2
+
+#define DISPLAYABLE_MODE_LOOP   0
+#define DISPLAYABLE_MODE_DEMO   1
+#define DISPLAYABLE_MODE_DEBUG  2
+#define DISPLAYABLE_MODE_LISTEN 3
+#define DISPLAYABLE_MODE_COUNT  4
+
 struct DisplayablesOutputProvider {
   int   (*getBarCount)(void);
   int   (*setBarColor)(int index, unsigned char color);
@@ -22,6 +58,8 @@ struct DisplayablesOutputProvider {
   void  (*showStatusString_P)(char *text);
   void  (*showSweep)(char color, int mode);
   void  (*setBrightness)(int brightness);
+  void  (*sendTelemetry)(struct DisplayableTelemetry *telemetry);  // optional
+  void  (*deferBar)(bool deferred);   // optional; holds showBar() until cleared, and nests
 };
 
 class VDisplayables {
@@ -36,11 +74,38 @@ class VDisplayables {
 
   public:
     void setup(int inPin, int outPin, int powerAnalogPin, struct DisplayablesOutputProvider *output, struct MenuDisplayProvider *display, struct MenuControlsProvider *controls);
+    void setCaptureProvider(struct SerialCaptureProvider *provider);
     void mainLoop();
     bool updateCurrentItemValue();
     void ping();
     bool showCurrentItem();
     bool savePersistedState();
+
+    // Bridge to a host tool; while enabled the gauges only show values from forwarded requests
+    void setBridgeMode(bool enabled);
+    bool bridgeConnect(int protocol);
+    void bridgeDisconnect();
+    int  bridgeRequest(int protocol, unsigned char *data, int length, unsigned char *response, int maxBytes);
+    int  bridgeRequestPids(int protocol, unsigned char *pids, int count, long *values);
+    int  getBridgeProtocol();
+    unsigned char getBridgeNackCode();   // of the last forwarded request, 0 if it wasn't refused
+    int  getPidDataLength(unsigned char pid);
+    float getBatteryVolts();
+
+    // Scripted control (serial console)
+    int   getItemCount();
+    int   getCurrentItem();
+    void  selectItem(int index);
+    char *getItemName(int index);
+    bool  isItemHidden(int index);
+    int   readPersistedState(int offset, unsigned char *bytes, int count);
+    int   writePersistedState(int offset, unsigned char *bytes, int count);
+    void  loadPersistedState();
+    void  getTelemetry(struct DisplayableTelemetry *telemetry);
+    struct ObdStats *getObdStats();   // NULL unless OBD_STATS_ENABLED
+    void  resetObdStats();
+    bool  getMode(int mode);
+    void  toggleMode(int mode);
 };
 
 #endif
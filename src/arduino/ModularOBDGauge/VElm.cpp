@@ -0,0 +1,336 @@
+#include "Environment.h"
+#include "VElm.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////
+// VELM.CPP
+// ELM327-compatible command bridge over the hardware UART
+///////////////////////////////////////////////////////////////
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VElm::setup(unsigned long baud, struct ElmBridgeProvider *provider) {
+  bridge = provider;
+  lineLength = 0;
+  busy = false;
+  reset();
+  Serial.begin(baud);
+  printNewline();
+  printPrompt();
+}
+
+extern void VElm::poll() {
+  // Bus transactions call back into idle handlers, which poll again
+  if (busy) return;
+  busy = true;
+
+  // Queue input without waiting for the prompt, so a host can pipeline
+  // commands while the previous one is still on the bus
+  while (Serial.available() && lineLength < ELM_LINE_SIZE) {
+    char c = Serial.read();
+    if (c == ' ' || c == '\n' || c == 0) continue;
+    if (echo) {
+      if (c == '\r') printNewline(); else Serial.write(c);
+    }
+    line[lineLength++] = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+  }
+
+  char *end = (char *)memchr(line, '\r', lineLength);
+  if (!end && lineLength >= ELM_LINE_SIZE) {
+    // Too long to ever complete
+    lineLength = 0;
+    printLine_P(PSTR("?"));
+    printPrompt();
+  } else if (end) {
+    if (end == line && repeatCommand()) end = line + repeatLength;
+    int consumed = processCommand(line, end - line);
+
+    memmove(line, line + consumed, lineLength - consumed);
+    lineLength -= consumed;
+  }
+  busy = false;
+}
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+// Handles the command at the start of the queue, returning the queued bytes consumed
+int VElm::processCommand(char *command, int length) {
+  unsigned char data[ELM_MAX_REQUEST];
+  unsigned char response[ELM_MAX_RESPONSE];
+
+  if (length >= 2 && command[0] == 'A' && command[1] == 'T') {
+    processAtCommand(command + 2, length - 2);
+    printPrompt();
+    return length + 1;
+  }
+
+  // Requests are what an empty command repeats
+  if (length > 0 && length <= ELM_REPEAT_SIZE) {
+    memcpy(repeat, command, length);
+    repeatLength = length;
+  }
+
+  // Mode 01 pid requests are cached, and batched with any queued behind them
+  int pid = parseSinglePid(command, length);
+  if (pid >= 0 && bridge->getPidDataLength(pid)) {
+    return processPidRequests(command, length, pid);
+  }
+
+  // Other requests are forwarded as is; an odd trailing digit is the ELM response count hint
+  char hint = length ? command[length-1] : 0;
+  int count = (length > 0) ? parseHex(command, length & ~1, data, sizeof(data)) : -1;
+  if (count <= 0 || ((length & 1) && !((hint >= '0' && hint <= '9') || (hint >= 'A' && hint <= 'F')))) {
+    printLine_P(PSTR("?"));
+  } else {
+    int responseCount = bridge->request(protocol, data, count, response, sizeof(response));
+    unsigned char nack = (responseCount == 0) ? bridge->getNackCode() : 0;
+    if (responseCount == ELM_BRIDGE_NOT_CONNECTED) {
+      printLine_P(PSTR("UNABLE TO CONNECT"));
+    } else if (nack) {
+      // Negative response, shown as the ECU sent it: 7F sid code
+      unsigned char negative[3] = { 0x7f, data[0], nack };
+      printBytes(negative, sizeof(negative));
+    } else if (responseCount <= 0) {
+      printLine_P(PSTR("NO DATA"));
+    } else {
+      printBytes(response, responseCount);
+    }
+  }
+  printPrompt();
+  return length + 1;
+}
+
+// Puts the last request in place of the empty command at the start of the queue,
+// as ELM327 repeats it for a bare CR
+bool VElm::repeatCommand() {
+  if (!repeatLength || lineLength + repeatLength > ELM_LINE_SIZE) return false;
+  memmove(line + repeatLength, line, lineLength);
+  memcpy(line, repeat, repeatLength);
+  lineLength += repeatLength;
+  return true;
+}
+
+void VElm::processAtCommand(char *command, int length) {
+  char c0 = length > 0 ? command[0] : 0;
+  char c1 = length > 1 ? command[1] : 0;
+
+  if (c0 == 'Z' || (c0 == 'W' && c1 == 'S')) {
+    reset();
+    printNewline();
+    printLine_P(PSTR(ELM_VERSION_STRING));
+    return;
+  }
+  if (c0 == 'I' && length == 1)  { printLine_P(PSTR(ELM_VERSION_STRING)); return; }
+  if (c0 == '@' && c1 == '1')    { printLine_P(PSTR("OBDII to RS232 Interpreter")); return; }
+  if (c0 == 'E' && length == 2)  { echo = (c1 == '1'); printLine_P(PSTR("OK")); return; }
+  if (c0 == 'L' && length == 2)  { linefeeds = (c1 == '1'); printLine_P(PSTR("OK")); return; }
+  if (c0 == 'S' && length == 2)  { spaces = (c1 == '1'); printLine_P(PSTR("OK")); return; }
+  if (c0 == 'H' && length == 2)  { headers = (c1 == '1'); printLine_P(PSTR("OK")); return; }
+  if (c0 == 'D' && length == 1)  { reset(); printLine_P(PSTR("OK")); return; }
+
+  if (c0 == 'R' && c1 == 'V') {
+    char buf[16];
+    int tenths = bridge->getBatteryVolts() * 10 + 0.5;
+    snprintf_P(buf, sizeof(buf), PSTR("%d.%dV"), tenths / 10, tenths % 10);
+    Serial.print(buf);
+    printNewline();
+    return;
+  }
+
+  // ATSP/ATTP: 0 = automatic, 3 = ISO 9141-2, 4 = ISO 14230-4 5 baud init, 5 = ISO 14230-4 fast init
+  if ((c0 == 'S' || c0 == 'T') && c1 == 'P' && length >= 3) {
+    char p = command[length-1];
+    int newProtocol = -1;
+    switch (p) {
+      case '0': newProtocol = OBD_PROTOCOL_AUTOMATIC; break;
+      case '3': newProtocol = OBD_PROTOCOL_ISO_9141;  break;
+      case '4': newProtocol = OBD_PROTOCOL_KWP_SLOW;  break;
+      case '5': newProtocol = OBD_PROTOCOL_KWP_FAST;  break;
+    }
+    if (newProtocol < 0) { printLine_P(PSTR("?")); return; }
+    if (newProtocol != protocol && bridge->getProtocol()) bridge->disconnect();
+    protocol = newProtocol;
+    printLine_P(PSTR("OK"));
+    return;
+  }
+
+  if (c0 == 'D' && c1 == 'P') {
+    int current = bridge->getProtocol() ? bridge->getProtocol() : protocol;
+    bool numeric = (length == 3 && command[2] == 'N');
+    if (numeric) {
+      if (!protocol) Serial.write('A');
+      Serial.write(current == OBD_PROTOCOL_ISO_9141 ? '3' : current == OBD_PROTOCOL_KWP_SLOW ? '4' : current == OBD_PROTOCOL_KWP_FAST ? '5' : '0');
+      printNewline();
+      return;
+    }
+    if (!protocol) print_P(current ? PSTR("AUTO, ") : PSTR("AUTO"));
+    switch (current) {
+      case OBD_PROTOCOL_ISO_9141: printLine_P(PSTR("ISO 9141-2")); break;
+      case OBD_PROTOCOL_KWP_SLOW: printLine_P(PSTR("ISO 14230-4 (KWP 5BAUD)")); break;
+      case OBD_PROTOCOL_KWP_FAST: printLine_P(PSTR("ISO 14230-4 (KWP FAST)")); break;
+    }
+    return;
+  }
+
+  if (c0 == 'P' && c1 == 'C') {
+    bridge->disconnect();
+    printLine_P(PSTR("OK"));
+    return;
+  }
+
+  // Timing, memory, adaptive timing etc. don't apply to the K-line driver; accept them
+  if (length > 0) {
+    printLine_P(PSTR("OK"));
+  } else {
+    printLine_P(PSTR("?"));
+  }
+}
+
+// Answers the first queued request for a single mode 01 pid, plus any that follow it
+int VElm::processPidRequests(char *command, int length, int pid) {
+  unsigned char pids[OBD_MAX_PIDS_PER_REQUEST];
+  long values[OBD_MAX_PIDS_PER_REQUEST];
+  int pidCount = 0;
+  int consumed = 0;
+
+  // Fresh cache entry answers without touching the bus
+  struct ElmCacheEntry *entry = findCache(pid);
+  if (entry) {
+    unsigned char response[6] = { 0x41, (unsigned char)pid };
+    memcpy(response + 2, entry->data, entry->length);
+    printBytes(response, entry->length + 2);
+    printPrompt();
+    return length + 1;
+  }
+
+  // Batch the complete commands queued behind this one while they're single pid requests too
+  char *next = command;
+  while (pidCount < OBD_MAX_PIDS_PER_REQUEST) {
+    char *end = (char *)memchr(next, '\r', lineLength - (next - line));
+    if (!end) break;
+    int nextPid = parseSinglePid(next, end - next);
+    if (nextPid < 0 || !bridge->getPidDataLength(nextPid) || findCache(nextPid)) break;
+    pids[pidCount++] = nextPid;
+    next = end + 1;
+  }
+  consumed = next - command;
+
+  int found = bridge->requestPids(protocol, pids, pidCount, values);
+
+  for (int i=0; i<pidCount; i++) {
+    if (found == ELM_BRIDGE_NOT_CONNECTED) {
+      printLine_P(PSTR("UNABLE TO CONNECT"));
+    } else if (values[i] < 0) {
+      printLine_P(PSTR("NO DATA"));
+    } else {
+      int pidLength = bridge->getPidDataLength(pids[i]);
+      storeCache(pids[i], values[i], pidLength);
+      printPidValue(pids[i], values[i], pidLength);
+    }
+    printPrompt();
+  }
+  return consumed;
+}
+
+// Returns the pid if the command is exactly "01xx", else -1
+int VElm::parseSinglePid(char *command, int length) {
+  unsigned char data[2];
+  if (length != 4 || parseHex(command, 4, data, 2) != 2 || data[0] != 1) return -1;
+  return data[1];
+}
+
+int VElm::parseHex(char *text, int length, unsigned char *bytes, int maxBytes) {
+  int count = 0;
+  for (int i=0; i<length; i++) {
+    char c = text[i];
+    int nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    if (nibble < 0) return -1;
+    if (i & 1) {
+      bytes[count++] |= nibble;
+    } else {
+      if (count >= maxBytes) return -1;
+      bytes[count] = nibble << 4;
+    }
+  }
+  return count;
+}
+
+struct ElmCacheEntry *VElm::findCache(unsigned char pid) {
+  for (int i=0; i<ELM_CACHE_SIZE; i++) {
+    if (cache[i].time && cache[i].pid == pid && (long)(millis() - cache[i].time) < ELM_CACHE_MILLIS) {
+      return &cache[i];
+    }
+  }
+  return NULL;
+}
+
+void VElm::storeCache(unsigned char pid, long value, int length) {
+  // Reuse the pid's slot, else the oldest one
+  int slot = 0;
+  for (int i=0; i<ELM_CACHE_SIZE; i++) {
+    if (cache[i].time && cache[i].pid == pid) { slot = i; break; }
+    if ((long)(cache[i].time - cache[slot].time) < 0) slot = i;
+  }
+  cache[slot].pid = pid;
+  cache[slot].length = length;
+  cache[slot].time = millis() | 1;
+  for (int i=length; i--;) {
+    cache[slot].data[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+void VElm::reset() {
+  echo = true;
+  linefeeds = true;
+  spaces = true;
+  headers = false;   // Accepted, but responses never include headers
+  protocol = OBD_PROTOCOL_AUTOMATIC;
+  repeatLength = 0;
+  memset(cache, 0, sizeof(cache));
+}
+
+void VElm::printBytes(unsigned char *bytes, int count) {
+  char buf[4];
+  for (int i=0; i<count; i++) {
+    snprintf_P(buf, sizeof(buf), spaces ? PSTR("%02X ") : PSTR("%02X"), bytes[i]);
+    Serial.print(buf);
+  }
+  printNewline();
+}
+
+void VElm::printPidValue(unsigned char pid, long value, int length) {
+  unsigned char response[6] = { 0x41, pid };
+  for (int i=length; i--;) {
+    response[2 + i] = value & 0xff;
+    value >>= 8;
+  }
+  printBytes(response, length + 2);
+}
+
+void VElm::print_P(const char *text) {
+  char buf[32];
+  strcpy_P(buf, text);
+  Serial.print(buf);
+}
+
+void VElm::printLine_P(const char *text) {
+  print_P(text);
+  printNewline();
+}
+
+void VElm::printNewline() {
+  Serial.write('\r');
+  if (linefeeds) Serial.write('\n');
+}
+
+void VElm::printPrompt() {
+  printNewline();
+  Serial.write('>');
+}
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////
+// VELM.H
+// ELM327-compatible command bridge over the hardware UART
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+#include "VObd.h"
+
+#ifndef _VELM
+#define _VELM
+
+#define ELM_VERSION_STRING   "ELM327 v1.5"
+#define ELM_LINE_SIZE        64    // Queued input; holds several commands sent ahead of the prompt
+#define ELM_MAX_REQUEST      8
+#define ELM_MAX_RESPONSE     SERIAL_MAX_BYTES
+#define ELM_REPEAT_SIZE      (ELM_MAX_REQUEST * 2 + 1)   // Longest request a bare CR repeats
+#define ELM_CACHE_SIZE       4
+#define ELM_CACHE_MILLIS     100   // Repeated single pid requests within this time are answered from cache
+
+#define ELM_BRIDGE_NOT_CONNECTED -2
+
+// Requests are forwarded through these; protocol is OBD_PROTOCOL_* (0 = automatic)
+struct ElmBridgeProvider {
+  int   (*request)(int protocol, unsigned char *data, int length, unsigned char *response, int maxBytes);
+  int   (*requestPids)(int protocol, unsigned char *pids, int count, long *values);
+  unsigned char (*getNackCode)(void);   // of the last request, 0 if it wasn't refused
+  int   (*getPidDataLength)(unsigned char pid);
+  int   (*getProtocol)(void);   // connected protocol, 0 if not connected
+  void  (*disconnect)(void);
+  float (*getBatteryVolts)(void);
+};
+
+struct ElmCacheEntry {
+  unsigned char pid;
+  unsigned char length;
+  unsigned char data[4];
+  unsigned long time;   // 0 if unused
+};
+
+class VElm {
+  private:
+    struct ElmBridgeProvider *bridge;
+    char line[ELM_LINE_SIZE];
+    unsigned char lineLength;
+    char repeat[ELM_REPEAT_SIZE];   // Last request, sent again for an empty command
+    unsigned char repeatLength;
+    bool busy;
+    bool echo;
+    bool linefeeds;
+    bool spaces;
+    bool headers;
+    int  protocol;
+    struct ElmCacheEntry cache[ELM_CACHE_SIZE];
+
+    int  processCommand(char *command, int length);
+    bool repeatCommand();
+    void processAtCommand(char *command, int length);
+    int  processPidRequests(char *command, int length, int pid);
+    int  parseHex(char *text, int length, unsigned char *bytes, int maxBytes);
+    int  parseSinglePid(char *command, int length);
+    struct ElmCacheEntry *findCache(unsigned char pid);
+    void storeCache(unsigned char pid, long value, int length);
+    void reset();
+    void printBytes(unsigned char *bytes, int count);
+    void printPidValue(unsigned char pid, long value, int length);
+    void print_P(const char *text);
+    void printLine_P(const char *text);
+    void printNewline();
+    void printPrompt();
+
+  public:
+    void setup(unsigned long baud, struct ElmBridgeProvider *bridge);
+    void poll();   // Handles at most one queued command per call
+};
+
+#endif
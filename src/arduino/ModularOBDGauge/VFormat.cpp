@@ -0,0 +1,103 @@
+#include "Environment.h"
+#include "VFormat.h"
+
+#include <Arduino.h>
+
+///////////////////////////////////////////////////////////////
+// VFORMAT.CPP
+// Integer text formatting for the displays, without printf
+///////////////////////////////////////////////////////////////
+
+static const uint32_t fm_scales[FORMAT_MAX_DECIMALS + 1] PROGMEM = { 1, 10, 100, 1000, 10000 };
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern unsigned long VFormat::getScale(uint8_t decimals) {
+  return pgm_read_dword(&fm_scales[min(decimals, FORMAT_MAX_DECIMALS)]);
+}
+
+extern char *VFormat::formatValue(char *buf, unsigned long value, uint8_t decimals, char suffix, char sign) {
+  unsigned long scale = getScale(decimals);
+  unsigned long whole = value / scale;
+  unsigned long frac = value - whole * scale;
+  unsigned long ceiling = whole + (frac ? 1 : 0);
+  bool large = true;
+
+  // Thousands, millions and billions keep one decimal
+  if (ceiling > 999000000UL) {
+    frac = whole % 1000000000UL / 100000000UL; whole /= 1000000000UL; suffix = 'B';
+  } else if (ceiling > 999000UL) {
+    frac = whole % 1000000UL / 100000UL; whole /= 1000000UL; suffix = 'M';
+  } else if (ceiling > 9999) {
+    frac = whole % 1000 / 100; whole /= 1000; suffix = 'k';
+  } else {
+    large = false;
+  }
+  if (large) decimals = 1;
+
+  // Digits left once the whole part, sign and suffix are placed
+  int8_t room = FORMAT_DISPLAY_DIGITS - (sign ? 1 : 0) - (suffix ? 1 : 0) - 1;
+  for (unsigned long w = whole; w >= 10; w /= 10) room--;
+
+  // Built from the right
+  char *p = buf + FORMAT_VALUE_SIZE - 1;
+  *p = 0;
+
+  if (room > 0 && decimals) {
+    // Decimals may take the suffix's digit too, which then isn't shown
+    int8_t shown = min(decimals, room + (suffix ? 1 : 0));
+    if (shown <= room && suffix) *--p = suffix;
+    for (uint8_t i = decimals; i > shown; i--) frac /= 10;
+    room = max(0, room - shown);
+    for (int8_t i = 0; i < shown; i++) {
+      *--p = '0' + frac % 10;
+      frac /= 10;
+    }
+    *--p = '.';
+  } else if (suffix) {
+    *--p = suffix;
+  }
+
+  do {
+    *--p = '0' + whole % 10;
+    whole /= 10;
+  } while (whole);
+
+  if (sign) *--p = sign;
+  while (room-- > 0) *--p = ' ';
+  return p;
+}
+
+extern char *VFormat::appendDecimal(char *p, int value) {
+  unsigned int magnitude = value;
+  char digits[10];
+  uint8_t count = 0;
+
+  if (value < 0) {
+    *p++ = '-';
+    magnitude = -value;
+  }
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  while (count) *p++ = digits[--count];
+  return p;
+}
+
+extern char *VFormat::appendHex(char *p, unsigned int value, uint8_t digits, bool lowerCase) {
+  char alpha = lowerCase ? 'a' - 10 : 'A' - 10;
+
+  for (int8_t shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+    uint8_t nibble = (value >> shift) & 0xf;
+    *p++ = nibble < 10 ? '0' + nibble : alpha + nibble;
+  }
+  return p;
+}
+
+extern char *VFormat::appendPadding(char *p, char *start, uint8_t width) {
+  while (p < start + width) *p++ = ' ';
+  return p;
+}
@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////
+// VFORMAT.H
+// Integer text formatting for the displays, without printf
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+
+#ifndef _VFORMAT
+#define _VFORMAT
+
+#define FORMAT_VALUE_SIZE    12   // Buffer for formatValue()
+#define FORMAT_MAX_DECIMALS  4
+#define FORMAT_DISPLAY_DIGITS 4
+
+// Formatting is stateless, so methods are static
+class VFormat {
+  public:
+    // Fixed-point value for the digits display: value is the magnitude in
+    // units of 10^-decimals, sign is '-', '+' or 0.  Returns the text, within
+    // buf, right justified to 4 digits (a decimal point shares a digit):
+    //   1234,1 -> "123.4"   5,0 -> "   5"   12345,0 -> "12.3k"   -4,0 'C' -> " -4C"
+    // Above 9999 a k, M or B suffix replaces the one given.  Decimals that
+    // don't fit are dropped, not rounded; the last one displaces the suffix.
+    static char *formatValue(char *buf, unsigned long value, uint8_t decimals, char suffix, char sign);
+    static unsigned long getScale(uint8_t decimals);   // 10^decimals
+
+    // Write at p and return the end, without terminating
+    static char *appendDecimal(char *p, int value);
+    static char *appendHex(char *p, unsigned int value, uint8_t digits, bool lowerCase);
+    static char *appendPadding(char *p, char *start, uint8_t width);   // Spaces up to width from start
+};
+
+#endif
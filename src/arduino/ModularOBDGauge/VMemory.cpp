@@ -0,0 +1,96 @@
+#include "Environment.h"
+#include "VMemory.h"
+
+#include <Arduino.h>
+#include <assert.h>
+
+///////////////////////////////////////////////////////////////
+// VMEMORY.CPP
+// SRAM use, stack high-water mark and the shared working arena
+///////////////////////////////////////////////////////////////
+
+static unsigned long mm_arena[(MEMORY_ARENA_SIZE + sizeof(unsigned long) - 1) / sizeof(unsigned long)];
+static uint8_t mm_arenaOwner = MEMORY_OWNER_NONE;
+static uint8_t mm_arenaConflicts = 0;
+
+#if defined(__AVR__)
+
+extern uint8_t __data_start;
+extern uint8_t __heap_start;
+extern char   *__brkval;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+// Runs from the startup code after the stack pointer is set and before
+// constructors, so is naked and must not call anything
+void mm_paintStack() __attribute__((naked, used, section(".init3")));
+
+void mm_paintStack() {
+  uint8_t *p = &__heap_start;
+  while (p < (uint8_t *)SP) *p++ = MEMORY_PAINT_BYTE;
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VMemory::getUsage(struct MemoryUsage *usage) {
+  uint8_t *heapEnd = __brkval ? (uint8_t *)__brkval : &__heap_start;
+  uint8_t *p = heapEnd;
+
+  // Painted bytes left above the heap were never reached by the stack
+  while (p <= (uint8_t *)SP && *p == MEMORY_PAINT_BYTE) p++;
+
+  usage->staticBytes = &__heap_start - &__data_start;
+  usage->heapBytes = heapEnd - &__heap_start;
+  usage->freeBytes = p - heapEnd;
+  usage->stackBytes = (uint8_t *)RAMEND + 1 - p;
+}
+
+#else
+
+// Host shim (HostShim.h)
+size_t hostGetStackBytes();
+
+extern void VMemory::getUsage(struct MemoryUsage *usage) {
+  usage->staticBytes = 0;
+  usage->heapBytes = 0;
+  usage->freeBytes = 0;
+  usage->stackBytes = hostGetStackBytes();
+}
+
+#endif
+
+//------------------------------------------------------
+// Public (arena)
+//------------------------------------------------------
+
+extern void *VMemory::lease(uint8_t owner, size_t size) {
+  if (mm_arenaOwner == owner && size <= sizeof(mm_arena)) return mm_arena;
+
+  if (mm_arenaOwner != MEMORY_OWNER_NONE || size > sizeof(mm_arena)) {
+    if (mm_arenaConflicts < 0xff) mm_arenaConflicts++;
+#if !defined(__AVR__)
+    assert(!"arena already leased or too small");
+#endif
+    return NULL;
+  }
+
+  mm_arenaOwner = owner;
+  memset(mm_arena, 0, size);
+  return mm_arena;
+}
+
+extern void VMemory::release(uint8_t owner) {
+  if (mm_arenaOwner == owner) mm_arenaOwner = MEMORY_OWNER_NONE;
+}
+
+extern uint8_t VMemory::getArenaOwner() {
+  return mm_arenaOwner;
+}
+
+extern uint8_t VMemory::getArenaConflicts() {
+  return mm_arenaConflicts;
+}
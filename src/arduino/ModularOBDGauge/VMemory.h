@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////
+// VMEMORY.H
+// SRAM use, stack high-water mark and the shared working arena
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+
+#ifndef _VMEMORY
+#define _VMEMORY
+
+#define MEMORY_PAINT_BYTE 0xc5   // Free SRAM is filled with this at boot
+
+// Working buffers that are never needed at the same time share one arena,
+// sized for the largest of them
+#define MEMORY_ARENA_SIZE (SERIAL_MAX_FLIPS * sizeof(unsigned long))
+
+// Arena owners
+#define MEMORY_OWNER_NONE          0
+#define MEMORY_OWNER_FLIPS         1   // VObd flip dumps, sniff debug mode 2
+#define MEMORY_OWNER_GEARS         2   // N/V histogram, while the gear or N/V gauge is showing
+#define MEMORY_OWNER_HIDDEN_ITEMS  3   // Hidden gauge titles, while the settings gauges menu is open
+
+// On the part, the area between the heap and the stack is painted before
+// main() runs, so stack and free bytes are the deepest the stack has ever
+// been.  The host build reports the deepest call into the Arduino shim
+// instead, with 64-bit frames, and no static or heap figures (see make ram).
+struct MemoryUsage {
+  unsigned int staticBytes;   // .data and .bss
+  unsigned int heapBytes;
+  unsigned int stackBytes;    // high-water mark
+  unsigned int freeBytes;     // never touched by heap or stack
+};
+
+// Memory is one per part, so methods are static
+class VMemory {
+  public:
+    static void getUsage(struct MemoryUsage *usage);
+
+    // A new lease is zeroed; leasing again as the same owner returns the same
+    // buffer as it was.  Another owner's lease is a bug: the host build
+    // asserts, the part counts it, and both return NULL.
+    static void *lease(uint8_t owner, size_t size);
+    static void release(uint8_t owner);
+    static uint8_t getArenaOwner();
+    static uint8_t getArenaConflicts();
+};
+
+#endif
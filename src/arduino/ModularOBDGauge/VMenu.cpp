@@ -17,60 +17,131 @@ char  mn_defaultGetItemColor        (int index, int current, MenuDataSource *ds)
 bool  mn_defaultIsItemHidden        (int index, MenuDataSource *ds) { return false; }
 bool  mn_defaultLongPressAction     (int index, MenuDataSource *ds) { return true; }
  
+void mn_idle(struct MenuControlsProvider *optionalControls) {
+  if (optionalControls && optionalControls->idle) optionalControls->idle();
+}
+
+// Next press waiting, 1 for button 1 and -1 for button 2, else 0; the
+// releases and holds of presses already handled are dropped on the way
+int mn_readPress(struct MenuControlsProvider *controls) {
+  struct ButtonEvent event;
+  while (controls->readButtonEvent(&event)) {
+    if (event.type == BUTTON_EVENT_PRESS) return event.button ? -1 : 1;
+  }
+  return 0;
+}
+
+// Events left by actions that read the buttons themselves
+void mn_flushEvents(struct MenuControlsProvider *controls) {
+  struct ButtonEvent event;
+  while (controls->readButtonEvent(&event)) {}
+}
+
 int mn_showTitles(char *title1, char *title2, struct MenuDisplayProvider *display, struct MenuControlsProvider *optionalControls) {
-    bool b1;
+    int press;
     display->showItemTitle(title1);
-    long time = millis();
+    unsigned long time = millis();
     while (millis() < time + 1000) {
-      if (optionalControls && ((b1 = optionalControls->isButton1Down()) || optionalControls->isButton2Down())) return b1 ? 1 : -1;
+      if (optionalControls && (press = mn_readPress(optionalControls))) return press;
+      mn_idle(optionalControls);
     }
     display->showItemTitle(title2);
     while (millis() < time + 2000) {
-      if (optionalControls && ((b1 = optionalControls->isButton1Down()) || optionalControls->isButton2Down())) return b1 ? 1 : -1;
+      if (optionalControls && (press = mn_readPress(optionalControls))) return press;
+      mn_idle(optionalControls);
     }
     return false;
 }
 
-int mn_getVisibleItemCount(struct MenuDataSource *dataSource) {
-  int result = 0;
-  // Count number of visible items
-  for (int i = 0; i < dataSource->itemCount; i++) {
-    if (!dataSource->isItemHidden || !dataSource->isItemHidden(i, dataSource)) {
-      result++;
+// Waits for the press just read to end, flashing the item once it's long
+int mn_waitForRelease(int current, char color, int itemCount, struct MenuDataSource *dataSource, struct MenuDisplayProvider *display, struct MenuControlsProvider *controls) {
+  struct ButtonEvent event;
+  unsigned long start = 0;
+  unsigned long pressed = millis();   // Near enough; the press was read just before
+
+  while (1) {
+    // Sampled before the queue, so a release queued in between is still read
+    bool released = !controls->isButton1Down() && !controls->isButton2Down();
+    if (controls->readButtonEvent(&event)) {
+      switch (event.type) {
+        case BUTTON_EVENT_RELEASE:
+          return event.heldMs >= MENU_LONG_PRESS_MS ? MENU_PRESS_LONG : MENU_PRESS_SHORT;
+        case BUTTON_EVENT_LONG:
+          start = millis() - BUTTON_LONG_MS;
+          break;
+        case BUTTON_EVENT_SUPER_LONG:
+          return MENU_PRESS_SUPER_LONG;
+      }
+    } else if (released) {
+      // The release was dropped from a full queue or flushed
+      return millis() - pressed >= MENU_LONG_PRESS_MS ? MENU_PRESS_LONG : MENU_PRESS_SHORT;
     }
+    if (start) {
+      display->highlightItem(current, millis() > start + MENU_LONG_PRESS_MS || ((millis()-start)&128) ? color : 'k', itemCount, dataSource);
+    }
+  }
+}
+
+// Visible-to-raw index table for the last data source looked up, rebuilt when its hidden mask or item count changes
+static struct {
+  struct MenuDataSource *dataSource;
+  unsigned long hiddenMask;
+  int itemCount;                          // Some sources grow with the mask unchanged
+  uint8_t visibleCount;
+  uint8_t items[MENU_MAX_ITEMS];          // Raw index of each visible item
+  uint8_t visibleIndexes[MENU_MAX_ITEMS]; // Visible items before each raw one
+} mn_visible;
+
+unsigned long mn_getHiddenMask(struct MenuDataSource *dataSource) {
+  if (dataSource->getHiddenMask) return dataSource->getHiddenMask(dataSource);
+
+  // Else ask about each item
+  unsigned long mask = 0;
+  if (dataSource->isItemHidden) for (int i = 0; i < dataSource->itemCount && i < MENU_MAX_ITEMS; i++) {
+    if (dataSource->isItemHidden(i, dataSource)) mask |= 1UL << i;
+  }
+  return mask;
+}
+
+void mn_updateVisibleItems(struct MenuDataSource *dataSource) {
+  unsigned long mask = mn_getHiddenMask(dataSource);
+  if (mn_visible.dataSource == dataSource && mn_visible.hiddenMask == mask && mn_visible.itemCount == dataSource->itemCount) return;
+
+  mn_visible.dataSource = dataSource;
+  mn_visible.hiddenMask = mask;
+  mn_visible.itemCount = dataSource->itemCount;
+  mn_visible.visibleCount = 0;
+  for (int i = 0; i < dataSource->itemCount && i < MENU_MAX_ITEMS; i++) {
+    mn_visible.visibleIndexes[i] = mn_visible.visibleCount;
+    if (!(mask & (1UL << i))) mn_visible.items[mn_visible.visibleCount++] = i;
   }
-  return result;
+}
+
+int mn_getVisibleItemCount(struct MenuDataSource *dataSource) {
+  mn_updateVisibleItems(dataSource);
+  return mn_visible.visibleCount;
 } 
 
 int mn_getCurrentVisibleItem(struct MenuDataSource *dataSource) {
-  int result = 0;
+  int current = dataSource->getCurrentItem(dataSource);
+
   // Count number of non-hidden items before us
-  for (int i = 0; i < dataSource->getCurrentItem(dataSource); i++) {
-    if (!dataSource->isItemHidden || !dataSource->isItemHidden(i, dataSource)) {
-      result++;
-    }
-  }
-  return result;
+  mn_updateVisibleItems(dataSource);
+  if (current <= 0) return 0;
+  if (current >= dataSource->itemCount || current >= MENU_MAX_ITEMS) return mn_visible.visibleCount;
+  return mn_visible.visibleIndexes[current];
 } 
 
-void mn_setCurrentVisibleItem(struct MenuDataSource *dataSource, int current) {
-  // Set index to n'th visible item
-  for (int i = 0; i < dataSource->itemCount; i++) {
-    if (!dataSource->isItemHidden || !dataSource->isItemHidden(i, dataSource)) {
-      if (!current--) {
-        dataSource->setCurrentItem(i, dataSource);
-        return;
-      }
-    }
-  }
+int mn_getItemFromVisibleIndex(struct MenuDataSource *dataSource, int current) {
+  mn_updateVisibleItems(dataSource);
+  return (current >= 0 && current < mn_visible.visibleCount) ? mn_visible.items[current] : -1;
+}
 
-  // Else set first visible one
-  for (int i = 0; i < dataSource->itemCount; i++) {
-    if (!dataSource->isItemHidden || !dataSource->isItemHidden(i, dataSource)) {
-      dataSource->setCurrentItem(i, dataSource);
-      return;
-    }
-  }
+void mn_setCurrentVisibleItem(struct MenuDataSource *dataSource, int current) {
+  // Set index to n'th visible item, else the first visible one
+  int item = mn_getItemFromVisibleIndex(dataSource, current);
+  if (item < 0 && mn_visible.visibleCount) item = mn_visible.items[0];
+  if (item >= 0) dataSource->setCurrentItem(item, dataSource);
 } 
 
 //------------------------------------------------------
@@ -103,13 +174,13 @@ extern int VMenu::showMenu(char *optionalTitle) {
 } 
 
 extern bool VMenu::mainLoop(bool showCurrent) {
-  bool button1Down = controls->isButton1Down();
-  bool button2Down = controls->isButton2Down();
-  bool buttonDown = button1Down || button2Down;
-  int advance = button1Down ? 1 : button2Down ? -1 : 0;
+  int advance = mn_readPress(controls);
+  bool buttonDown = advance != 0;
   int itemCount = mn_getVisibleItemCount(dataSource);
 
   if (itemCount) while (advance || showCurrent) {
+    int button = advance < 0 ? 1 : 0;
+
     // Update current index
     int current = mn_getCurrentVisibleItem(dataSource);
     char currentColor = dataSource->getItemColor(current, current, dataSource);
@@ -123,23 +194,10 @@ extern bool VMenu::mainLoop(bool showCurrent) {
     }
 
     // Wait for button up
-    long start = millis();
-    if (advance) while (1) {
-      button1Down = controls->isButton1Down();
-      button2Down = controls->isButton2Down();
-      if (!button1Down && !button2Down) break;
-      advance = button1Down ? 1 : button2Down ? -1 : 0;
-
-      // Handle long press
-      if (millis() > start + 500) {
- 
-        // Wait for button up flashing menu item
-        while ((controls->isButton1Down() || controls->isButton2Down()) && millis() < start + 1500) {
-          display->highlightItem(current, millis() > start + 1000 || ((millis()-start)&128) ? currentColor : 'k', itemCount, dataSource);
-        }
-
-        // Handle super long press (backup, button 1 only)
-        if (controls->isButton1Down()) {
+    if (advance) switch (mn_waitForRelease(current, currentColor, itemCount, dataSource, display, controls)) {
+      case MENU_PRESS_SUPER_LONG:
+        // Back up (button 1 only)
+        if (button == 0) {
           current = (current + itemCount- 1) % itemCount;
           mn_setCurrentVisibleItem(dataSource, current);
           display->highlightItem(current, currentColor, itemCount, dataSource);
@@ -149,18 +207,13 @@ extern bool VMenu::mainLoop(bool showCurrent) {
           controls->smartDelay(10);
           break;
         }
-
-        if (millis() > start + 1000) {
-          // Convert visible index to raw index
-          for (int i = 0; i < dataSource->itemCount; i++) {
-            if (!dataSource->isItemHidden || !dataSource->isItemHidden(i, dataSource)) {
-              if (!current--) {
-                return dataSource->longPressAction(i, button2Down ? 1 : 0, dataSource);
-              }
-            }
-          }
-          return false;
-        }
+        // Fall through
+      case MENU_PRESS_LONG: {
+        // Convert visible index to raw index
+        int item = mn_getItemFromVisibleIndex(dataSource, current);
+        bool result = item >= 0 ? dataSource->longPressAction(item, button, dataSource) : false;
+        mn_flushEvents(controls);
+        return result;
       }
     }
     controls->smartDelay(10);
@@ -170,7 +223,7 @@ extern bool VMenu::mainLoop(bool showCurrent) {
       current = (current + advance + itemCount) % itemCount;
       mn_setCurrentVisibleItem(dataSource, current);
     }
-    dataSource->shortPressAction(current, button2Down ? 1 : 0, dataSource);
+    dataSource->shortPressAction(current, button, dataSource);
 
     // Show light and titles for new item
     advance = showCurrentItem(true);
@@ -180,6 +233,7 @@ extern bool VMenu::mainLoop(bool showCurrent) {
 
     showCurrent = false;
   }
+  if (!buttonDown) mn_idle(controls);
   return false;
 }
 
@@ -195,3 +249,7 @@ extern void VMenu::highlightCurrentItem() {
 
   display->highlightItem(current, dataSource->getItemColor(current, current, dataSource), mn_getVisibleItemCount(dataSource), dataSource);
 }
+
+extern int VMenu::getItemIndex(int visibleIndex) {
+  return mn_getItemFromVisibleIndex(dataSource, visibleIndex);
+}
@@ -6,6 +6,16 @@
 #ifndef _VMENU
 #define _VMENU
 
+#include "VButtons.h"
+
+#define MENU_MAX_ITEMS  32    // Items the visible index table holds, one hidden mask bit each
+#define MENU_LONG_PRESS_MS 1000  // Released after this, a press runs the long press action
+
+// How a press ended
+#define MENU_PRESS_SHORT       0
+#define MENU_PRESS_LONG        1
+#define MENU_PRESS_SUPER_LONG  2   // Still down after BUTTON_SUPER_LONG_MS
+
 struct MenuDataSource {
   int   itemCount;
   int   (*getCurrentItem)(MenuDataSource *);              // optional
@@ -22,6 +32,8 @@ struct MenuDataSource {
   char **alternateTitles1;
   char **alternateTitles2;
   char *alternateColors;
+
+  unsigned long (*getHiddenMask)(MenuDataSource *);       // optional, bit n set when item n is hidden; lets lookups skip isItemHidden
 };
 
 struct MenuDisplayProvider {
@@ -32,7 +44,9 @@ struct MenuDisplayProvider {
 struct MenuControlsProvider {
   bool  (*isButton1Down)(void);
   bool  (*isButton2Down)(void);
+  bool  (*readButtonEvent)(struct ButtonEvent *event); // false when none are queued
   void  (*smartDelay)(unsigned long waitMs);
+  void  (*idle)(void);                                 // optional, background work while waiting for input
 };
 
 class VMenu {  
@@ -47,6 +61,7 @@ class VMenu {
     bool mainLoop(bool showCurrent);
     int  showCurrentItem(bool abortable);
     void highlightCurrentItem();
+    int  getItemIndex(int visibleIndex);   // raw index, or -1 past the last visible item
 };
 
 #endif
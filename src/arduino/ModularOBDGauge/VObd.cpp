@@ -1,5 +1,8 @@
 #include "VDisplayables.h" // for sweep enums
 #include "VObd.h"
+#include "VProfile.h"
+#include "VMemory.h"
+#include "VFormat.h"
 #include <Arduino.h>
 
 ///////////////////////////////////////////////////////////////
@@ -22,6 +25,43 @@
 #define KWP_MESSAGE_FORMAT_ADDRESS_HEADER_LENGTH_IN_FORMAT    2
 #define KWP_MESSAGE_FORMAT_ADDRESS_HEADER_ADDITIONAL_LENGTH   3
 
+// Mode 01 data bytes for pids 0x00-0x5F, '0' if unknown
+static const char obd_pidDataLengths[] PROGMEM =
+  "4422111111112111"  // 00
+  "2111222222221112"  // 10
+  "4222444444441111"  // 20
+  "1221444444442222"  // 30
+  "4422211111112224"  // 40
+  "4112222222111221"; // 50
+
+#if OBD_STATS_ENABLED
+// Upper bounds of the timing histogram buckets in ms, spanning P1 (0-20),
+// P2 (25-50) and whole transactions; the last bucket is open
+static const uint8_t obd_statsBucketMs[OBD_STATS_BUCKET_COUNT] PROGMEM = { 2, 5, 10, 20, 30, 50, 100, 0 };
+
+static int obd_getStatsBucket(unsigned long micros) {
+  unsigned long ms = micros / 1000;
+  for (int i=0; i<OBD_STATS_BUCKET_COUNT-1; i++) {
+    if (ms < pgm_read_byte_near(obd_statsBucketMs + i)) return i;
+  }
+  return OBD_STATS_BUCKET_COUNT-1;
+}
+
+static void obd_addToHistogram(uint8_t *buckets, int count, int index) {
+  if (buckets[index] == 0xff) {
+    for (int i=0; i<count; i++) buckets[i] >>= 1;
+  }
+  buckets[index]++;
+}
+#endif
+
+// KWP StartDiagnosticSession baud rate identifiers
+#define KWP_BAUD_ID_9600    0x01
+#define KWP_BAUD_ID_19200   0x02
+#define KWP_BAUD_ID_38400   0x03
+#define KWP_BAUD_ID_57600   0x04
+#define KWP_BAUD_ID_115200  0x05
+
 //------------------------------------------------------
 // Public (Connect)
 //------------------------------------------------------
@@ -30,28 +70,45 @@ extern void VObd::setup(int in, int out, void (*delay)(unsigned long), struct Ob
   output = optionalOutputProvider;
   vserial.setup(in, out, delay);
   smartDelay = delay;
+  highSpeedFailures = 0;
+}
+
+extern void VObd::setCaptureProvider(struct SerialCaptureProvider *provider) {
+  vserial.setCaptureProvider(provider);
+}
+
+extern void VObd::setHighSpeedBaud(unsigned long baud) {
+  highSpeedBaud = baud;
 }
 
 extern void VObd::connect(int proto, bool demoMode) {
+  PROFILE_BEGIN(start);
+
   switch (proto) {
     case OBD_PROTOCOL_ISO_9141:
     case OBD_PROTOCOL_KWP_SLOW:
-      if (proto = kwpSlowInit(proto, demoMode)) {
+      if ((proto = kwpSlowInit(proto, demoMode))) {
         protocol = proto;
       }
       break;
     case OBD_PROTOCOL_KWP_FAST:
-      if (proto = kwpFastInit(proto)) {
+      if ((proto = kwpFastInit(proto))) {
         protocol = proto;
       }
       break;
   }
   if (protocol) {
-    lastPidRequestTime = millis();
+    multiPidSupport = OBD_MULTI_PID_UNKNOWN;
+    multiPidTimeouts = 0;
+    ecuAddress = 0;
+    keepAliveMode = (protocol == OBD_PROTOCOL_ISO_9141) ? OBD_KEEP_ALIVE_PID_REQUEST : OBD_KEEP_ALIVE_TESTER_PRESENT_SILENT;
+    kwpStartHighSpeedSession();
   }
+  PROFILE_END(PROFILE_PHASE_CONNECT, start);
 }
 
 extern void VObd::disconnect() {
+  stopHighSpeedSession();
   protocol = 0;
 }
 
@@ -60,36 +117,60 @@ extern bool VObd::isConnected() {
 }
 
 extern void VObd::ping() {
-  // Periodically send request to keep connection alive
-  if (isConnected() && ((long)(millis() - lastPidRequestTime)) > QUERY_MAX_INTERVAL) {
-      sendPidRequest(0x00, 1);
+  // Keep connection alive, but only if no real request went out within the P3 window
+  if (!isConnected() || autoPidRequestDisabled || ((long)(millis() - lastPidRequestTime)) <= QUERY_MAX_INTERVAL) {
+    return;
+  }
+  autoPidRequestDisabled = true;  // Don't re-enter from delays below
+
+  if (keepAliveMode == OBD_KEEP_ALIVE_PID_REQUEST) {
+    unsigned char buf[4];
+    sendPidRequest(0x00, 1);
+    receivePidResponseData(buf, sizeof(buf), 0x00, 1, false, 0);
+  } else {
+    // Example: 82 33 F1 3E 02 E6 (no reply) or 82 33 F1 3E 01 E5 -> 81 F1 11 7E 01
+    unsigned char req[] = { KWP_SERVICE_TESTER_PRESENT, (unsigned char)(keepAliveMode == OBD_KEEP_ALIVE_TESTER_PRESENT_SILENT ? KWP_TESTER_PRESENT_NO_RESPONSE : KWP_TESTER_PRESENT_RESPONSE_REQUIRED) };
+    unsigned char *bytes;
+    sendRequest(req, sizeof(req));
+
+    // Consume any reply so it can't collide with the next request
+    int byteCount = vserial.readBytes(&bytes, QUERY_RECEIVE_MESSAGE_TIMEOUT, QUERY_RECEIVE_BYTE_TIMEOUT, NULL, NULL);
+    bool rejected = (byteCount == 0 && keepAliveMode == OBD_KEEP_ALIVE_TESTER_PRESENT);
+    for (int i=0; i+1<byteCount; i++) {
+      if (bytes[i] == 0x7f && bytes[i+1] == KWP_SERVICE_TESTER_PRESENT) rejected = true;
+    }
+    if (rejected) keepAliveMode++;
   }
+
+  lastPidRequestTime = millis();
+  autoPidRequestDisabled = false;
 }
 
 extern bool VObd::resetConnection() {
-  unsigned long start = micros();
-
   // Send a bunch of nulls to force the ECU to wait for initialization.
   // By happenstance this was found to work on ECU simulator.  Unsure
   // how effective or necessary this is on a real ECU.
-  vserial.sendByteRepeatedly(0, 256, 10400L, 0);
+  stopHighSpeedSession();
+  vserial.sendByteRepeatedly(0, 256, 0);
   smartDelay(2600);
+  return true;
 }
 
 //------------------------------------------------------
 // Public (Query)
 //------------------------------------------------------
 
-extern int VObd::sendPidRequest(unsigned char pid, int mode) {
+extern int VObd::sendRequest(unsigned char *data, int length) {
   char bytes[20];
   int count = 0;
-  int length = (pid || (mode == 1)) ? 2 : 1;
   unsigned long time = millis();
   long wait = lastPidRequestTime + QUERY_MIN_INTERVAL - time;
 
   // Enforce minimum time between receiving last request and sending new one
   if (wait > 0 && wait <= QUERY_MIN_INTERVAL) {
+    PROFILE_BEGIN(start);
     smartDelay(wait);
+    PROFILE_END(PROFILE_PHASE_P3_WAIT, start);
   }
   // Save time for pinging
   lastPidRequestTime = time;
@@ -120,30 +201,48 @@ extern int VObd::sendPidRequest(unsigned char pid, int mode) {
       }
 
       // Address header with format length byte
+      // Switches from functional to physical addressing once the ECU is known
       else if ((keyByte1 & KWP_KEY1_LENGTH_IN_FORMAT_BYTE_SUPPORTED)) {
         messageFormat = KWP_MESSAGE_FORMAT_ADDRESS_HEADER_LENGTH_IN_FORMAT;
-        bytes[count++] = 0xC0 | length;  // 80 = address information, 40 = functional addressing, length = 2
-        bytes[count++] = 0x33;  // target (engine)
+        bytes[count++] = (ecuAddress ? 0x80 : 0xC0) | length;  // 80 = address information, 40 = functional addressing, length = 2
+        bytes[count++] = ecuAddress ? ecuAddress : 0x33;  // target (engine)
         bytes[count++] = 0xf1;  // source (diagnostic tools F0-FD)
       }
 
       // Address header with external length byte
       else {
         messageFormat = KWP_MESSAGE_FORMAT_ADDRESS_HEADER_ADDITIONAL_LENGTH;
-        bytes[count++] = 0xc0;  // 80 = address information, 40 = functional addressing
-        bytes[count++] = 0x33;  // target
+        bytes[count++] = ecuAddress ? 0x80 : 0xc0;  // 80 = address information, 40 = functional addressing
+        bytes[count++] = ecuAddress ? ecuAddress : 0x33;  // target
         bytes[count++] = 0xf1;  // source (diagnostic tools F0-FD)
         bytes[count++] = length;
       }
       break;
   }
 
-  bytes[count++] = mode;  // data1: mode
-  if (pid || (mode == 1)) {
-    bytes[count++] = pid;   // data2: pid
+  for (int i=0; i<length; i++) {
+    bytes[count++] = data[i];
   }
   bytes[count] = getChecksum(bytes, 0, count-1);
-  vserial.sendBytes(bytes, count+1, 10400, QUERY_SEND_DELAY_BETWEEN_BYTES);
+#if OBD_STATS_ENABLED
+  requestStart = micros();
+#endif
+  vserial.sendBytes(bytes, count+1, QUERY_SEND_DELAY_BETWEEN_BYTES);
+#if OBD_STATS_ENABLED
+  requestEnd = micros();
+#endif
+  return count+1;
+}
+
+extern int VObd::sendPidRequest(unsigned char pid, int mode) {
+  unsigned char data[2];
+  int length = 0;
+
+  data[length++] = mode;  // data1: mode
+  if (pid || (mode == 1)) {
+    data[length++] = pid;   // data2: pid
+  }
+  return sendRequest(data, length);
 }
 
 extern long VObd::receivePidResponse(unsigned char pid, int mode, bool showErrors, int debugMode) {
@@ -171,60 +270,170 @@ extern int VObd::receivePidResponseData(unsigned char *outbuf, int maxBytes, uns
 
   // Debug mode 2 (dump flips)
   if (debugMode == 2) {
-    unsigned long *flips;
-    int flipCount = vserial.readFlipIntervals(&flips, QUERY_RECEIVE_MESSAGE_TIMEOUT, isSniffing ? QUERY_RECEIVE_BYTE_TIMEOUT_SNIFFING : QUERY_RECEIVE_BYTE_TIMEOUT);
+    unsigned long *flips = (unsigned long *)VMemory::lease(MEMORY_OWNER_FLIPS, SERIAL_MAX_FLIPS * sizeof(unsigned long));
+    if (!flips) return -1;
+    int flipCount = vserial.readFlipIntervals(flips, SERIAL_MAX_FLIPS, QUERY_RECEIVE_MESSAGE_TIMEOUT, isSniffing ? QUERY_RECEIVE_BYTE_TIMEOUT_SNIFFING : QUERY_RECEIVE_BYTE_TIMEOUT);
     if (flipCount > 2) debugLongs(flips, flipCount);
-    return;
+    VMemory::release(MEMORY_OWNER_FLIPS);
+    return 0;
   }
 
-  int byteCount = vserial.readBytes(&bytes, QUERY_RECEIVE_MESSAGE_TIMEOUT, isSniffing ? QUERY_RECEIVE_BYTE_TIMEOUT_SNIFFING : QUERY_RECEIVE_BYTE_TIMEOUT, 10400, &minByteSpacing, &maxByteSpacing);
+  int byteCount = vserial.readBytes(&bytes, QUERY_RECEIVE_MESSAGE_TIMEOUT, isSniffing ? QUERY_RECEIVE_BYTE_TIMEOUT_SNIFFING : QUERY_RECEIVE_BYTE_TIMEOUT, &minByteSpacing, &maxByteSpacing);
 
 
   // Debug
   if (debugMode) {
     if (byteCount) debugBytes(bytes, byteCount, minByteSpacing/1000, maxByteSpacing/1000);
-    if (isSniffing) return;
+    if (isSniffing) return byteCount;
   }
-  
+  int result = parsePidResponse(bytes, byteCount, outbuf, maxBytes, pid, mode, showErrors);
+#if OBD_STATS_ENABLED
+  if (!isSniffing) recordStats(pid, mode);
+#endif
+  return result;
+}
+
+extern int VObd::requestPids(unsigned char *pids, int count, long *values, unsigned char errorMask, bool firstRequired) {
+  int found = 0;
+
+  for (int i=0; i<count; i++) {
+    values[i] = -1;
+  }
+
+  // Try several pids in one frame unless this ECU is known not to answer them
+  if (count > 1 && multiPidSupport != OBD_MULTI_PID_UNSUPPORTED) {
+    int recordCount = 0;
+    found = requestPidsBatched(pids, count, values, (errorMask & 1) && multiPidSupport == OBD_MULTI_PID_SUPPORTED, &recordCount);
+
+    // Judge support by the reply itself, so a dropped frame or a pid the ECU
+    // doesn't have isn't taken as a refusal; those probe again next time.
+    // Some ECUs ignore such requests, so enough unanswered probes are one.
+    if (multiPidSupport == OBD_MULTI_PID_UNKNOWN && recordCount >= 0) {
+      multiPidTimeouts = (lastResult == OBD_RESULT_TIMEOUT) ? multiPidTimeouts + 1 : 0;
+      if (recordCount > 1) multiPidSupport = OBD_MULTI_PID_SUPPORTED;
+      else if (recordCount == 1 || lastResult == OBD_RESULT_NACK || lastResult == OBD_RESULT_SID ||
+               multiPidTimeouts >= OBD_MULTI_PID_MAX_PROBE_TIMEOUTS) multiPidSupport = OBD_MULTI_PID_UNSUPPORTED;
+    }
+  }
+
+  // Fall back to single requests for anything still missing.  Failing a
+  // required first pid stops the remaining ones, as does a dropped high
+  // speed session.
+  for (int i=0; i<count && protocol; i++) {
+    if (values[i] < 0) {
+      sendPidRequest(pids[i], 1);
+      values[i] = receivePidResponse(pids[i], 1, errorMask & (1 << i), 0);
+      if (values[i] >= 0) found++;
+      else if (i == 0 && firstRequired) break;
+    }
+  }
+  return found;
+}
+
+extern int VObd::readLocalIdentifier(unsigned char localId, unsigned char *buf, int maxBytes, bool showErrors) {
+  // Manufacturer record block, returning many live values in one response
+  // Example: 82 33 F1 21 01 -> 8A F1 11 61 01 [data...] CS
+  unsigned char req[] = { KWP_SERVICE_READ_DATA_BY_LOCAL_ID, localId };
+
+  if (protocol != OBD_PROTOCOL_KWP_SLOW && protocol != OBD_PROTOCOL_KWP_FAST) return -1;
+
+  sendRequest(req, sizeof(req));
+  int byteCount = receivePidResponseData(buf, maxBytes, localId, KWP_SERVICE_READ_DATA_BY_LOCAL_ID, showErrors, 0);
+  lastPidRequestTime = millis();
+  return byteCount;
+}
+
+// Forwards a raw service request, returning the response from the service id on
+// (without header or checksum), 0 on negative response or -1 on no response
+extern int VObd::request(unsigned char *data, int length, unsigned char *response, int maxBytes) {
+  unsigned char mode = data[0];
+  unsigned char pid = (length > 1) ? data[1] : 0;
+  int count = 0;
+
+  if (maxBytes < 2) return -1;
+
+  // Example: 01 0C -> 41 0C 1A F8
+  sendRequest(data, length);
+  response[count++] = 0x40 + mode;
+  if (mode == 1 || mode == KWP_SERVICE_READ_DATA_BY_LOCAL_ID) {
+    response[count++] = pid;
+  }
+  int byteCount = receivePidResponseData(response + count, maxBytes - count, pid, mode, false, 0);
+  lastPidRequestTime = millis();
+
+  return (byteCount > 0) ? count + byteCount : byteCount;
+}
+
+#if OBD_STATS_ENABLED
+extern struct ObdStats *VObd::getStats() {
+  return &stats;
+}
+
+extern void VObd::resetStats() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+extern int VObd::getStatsBucketMs(int bucket) {
+  return pgm_read_byte_near(obd_statsBucketMs + bucket);
+}
+#endif
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+// Checks headers of a received response and copies out its data
+int VObd::parsePidResponse(unsigned char *bytes, int byteCount, unsigned char *outbuf, int maxBytes, unsigned char pid, int mode, bool showErrors) {
   if (byteCount == 0) {
+    lastResult = OBD_RESULT_TIMEOUT;
     if (output && showErrors) { output->showStatusString_P(PSTR(" -- ")); smartDelay(400); }
+    dropToDefaultBaud();
     return -1;
   }
+  lastResult = OBD_RESULT_COUNT;
   if (byteCount < 3) {
     if (output && showErrors) { output->showStatusString_P(PSTR("Cnt!")); smartDelay(400); output->showStatusInteger(byteCount); smartDelay(100); }
+    dropToDefaultBaud();
     return -1;
   }
-  int headerSize;
-  switch (protocol) {
-    case OBD_PROTOCOL_ISO_9141:
-      // [48 6B 10] [41 0D] 7F [90]
-      headerSize = 3;
-      break;
 
-    case OBD_PROTOCOL_KWP_SLOW:
-    case OBD_PROTOCOL_KWP_FAST:
-      // Sample: [83 F1 11] [41 0D] 78 [4B]
-      headerSize = 1;
-      if (bytes[0] & 0x80) headerSize += 2;       // target, source addresses in header
-      if ((bytes[0] & 0x3f)==0) headerSize += 1;  // extra length byte at end of header
-      break;
+  // Split back-to-back responses from several ECUs and keep the one we talk to
+  struct ObdFrame frames[OBD_MAX_FRAMES];
+  int frameCount = splitFrames(bytes, byteCount, frames, OBD_MAX_FRAMES);
+  int frameIndex = selectFrame(bytes, frames, frameCount, pid, mode);
+
+  if (frameIndex < 0) {
+    if (output && showErrors) { output->showStatusString_P(PSTR("ECU!")); smartDelay(400); output->showStatusInteger(frameCount); smartDelay(100); }
+    dropToDefaultBaud();
+    return -1;
   }
+  bytes += frames[frameIndex].start;
+  byteCount = frames[frameIndex].length;
+  int headerSize = getHeaderSize(bytes);
+
+  // Mode 1 and block reads echo the requested pid/local identifier
+  bool echoesPid = (mode == 1 || mode == KWP_SERVICE_READ_DATA_BY_LOCAL_ID);
 
   // Error - wrong # of bytes (minimum response should include mode + pid + data + checksum)
-  if (byteCount < headerSize + (mode==3 ? 0 : pid ? 2 : 1) + 1) {
+  if (byteCount < headerSize + (mode==3 ? 0 : (pid || echoesPid) ? 2 : 1) + 1) {
     if (output && showErrors) { output->showStatusString_P(PSTR("Cnt!")); smartDelay(400); output->showStatusInteger(byteCount); smartDelay(100); }
+    dropToDefaultBaud();
     return -1;
   }
 
   // Negative Acknowledgement
   if (bytes[headerSize] == 0x7f) {
+    lastResult = OBD_RESULT_NACK;
+    lastNackCode = bytes[headerSize+2];
     if (output && showErrors) { output->showStatusString_P(PSTR("NACK")); smartDelay(400); output->showStatusByte(bytes[headerSize+2]); smartDelay(100); }
     return 0;
   }
 
   // Error - wrong SID
   if (bytes[headerSize] != (0x40 + mode)) {
+    lastResult = OBD_RESULT_SID;
     if (output && showErrors) { output->showStatusString_P(PSTR("SID!")); smartDelay(400); output->showStatusByte(bytes[headerSize]); smartDelay(100); }
+    dropToDefaultBaud();
     return -1;
   }
 
@@ -233,10 +442,12 @@ extern int VObd::receivePidResponseData(unsigned char *outbuf, int maxBytes, uns
   int count = valueEnd - valueStart;
   int outCount = 0;
 
-  // Read and confirm PID byte for mode 1 requests
-  if (mode == 1) {
+  // Read and confirm PID byte for mode 1 and block read requests
+  if (echoesPid) {
     if (bytes[valueStart++] != pid) {
+      lastResult = OBD_RESULT_PID;
       if (output && showErrors) { output->showStatusString_P(PSTR("PID!")); smartDelay(400); output->showStatusByte(bytes[headerSize+1]); smartDelay(100); }
+      dropToDefaultBaud();
       return -1;
     }
   } 
@@ -248,6 +459,8 @@ extern int VObd::receivePidResponseData(unsigned char *outbuf, int maxBytes, uns
     count++;
   }
 
+  lastResult = OBD_RESULT_OK;
+
   // Loop thru data
   for (int i=valueStart; i<valueEnd; i++) {
     if (count > 0) {
@@ -270,17 +483,13 @@ extern int VObd::receivePidResponseData(unsigned char *outbuf, int maxBytes, uns
   return outCount;
 }
 
-//------------------------------------------------------
-// Private
-//------------------------------------------------------
-
 int VObd::kwpSlowInit(int proto, bool demoMode) {
 
   // W0
   vserial.waitForIdle(SLOW_INIT_IDLE_WAIT, SLOW_INIT_IDLE_TIMEOUT);
 
   // Address  
-  vserial.sendBytes("\x33", 1, 5, QUERY_SEND_DELAY_BETWEEN_BYTES);
+  vserial.sendByte(0x33, 5);
 
   unsigned char *bytes;
   char bytesBuf[3];
@@ -293,7 +502,7 @@ int VObd::kwpSlowInit(int proto, bool demoMode) {
     bytes[1] = 0x08;
     bytes[2] = 0x08;
   } else {
-    byteCount = vserial.readBytes(&bytes, SLOW_INIT_SYNC_MESSAGE_TIMEOUT, SLOW_INIT_SYNC_BYTE_TIMEOUT, 10400, NULL, NULL);
+    byteCount = vserial.readBytes(&bytes, SLOW_INIT_SYNC_MESSAGE_TIMEOUT, SLOW_INIT_SYNC_BYTE_TIMEOUT, NULL, NULL);
   }
 
   if (byteCount != 3) {
@@ -307,12 +516,16 @@ int VObd::kwpSlowInit(int proto, bool demoMode) {
     return 0;
   }
 
-  // Delay before sending inverted response, excluding timeout from previous fetch
+  // Delay before sending inverted response, excluding timeout from previous fetch.
+  // Ring refreshes block interrupts, so they wait until the response is out.
+  if (output) output->deferBar(true);
   smartDelay(SLOW_INIT_INVERSION_DELAY - SLOW_INIT_SYNC_BYTE_TIMEOUT);
 
   unsigned char response[1];
   response[0] = ~bytes[2];
-  vserial.sendBytes(response, 1, 10400, QUERY_SEND_DELAY_BETWEEN_BYTES);
+  vserial.sendBytes(response, 1, QUERY_SEND_DELAY_BETWEEN_BYTES);
+  unsigned long sentTime = millis();
+  if (output) output->deferBar(false);
 
   // Save key bytes, which define types of headers/byte intervals supported
   keyByte1 = bytes[1];
@@ -323,21 +536,28 @@ int VObd::kwpSlowInit(int proto, bool demoMode) {
     byteCount = 1;
     bytes[0] = 0xcc;
   } else {
-    byteCount = vserial.readBytes(&bytes, SLOW_INIT_FINAL_MESSAGE_TIMEOUT, SLOW_INIT_FINAL_MESSAGE_TIMEOUT, 10400, NULL, NULL);
+    byteCount = vserial.readBytes(&bytes, SLOW_INIT_FINAL_MESSAGE_TIMEOUT, SLOW_INIT_FINAL_MESSAGE_TIMEOUT, NULL, NULL);
   }
 
+  // The ECU may time P3 from our inverted key byte, so the keep-alive clock
+  // starts there rather than after the wait for the ready byte to end and
+  // the status display below, which together can take most of P3
+  if (byteCount > 0) lastPidRequestTime = sentTime;
+
   if (output) { 
     char buf[6];
 
     // Show keybytes we got
     output->showSweep('y', SWEEP_MODE_DOWN);
-    snprintf_P(buf, 6, PSTR("%02X%02X"), (int)keyByte1, (int)keyByte2);
+    *VFormat::appendHex(VFormat::appendHex(buf, keyByte1, 2, false), keyByte2, 2, false) = 0;
     output->showStatusString(buf);    
     smartDelay(220);
 
     // Show response we sent
 //  snprintf_P(buf, 6, PSTR("\x03%02X\x03"), (int)response[0]);
-    snprintf_P(buf, 6, PSTR(" %02X "), (int)response[0]);
+    buf[0] = buf[3] = ' ';
+    buf[4] = 0;
+    VFormat::appendHex(buf + 1, response[0], 2, false);
     output->showStatusString(buf);
     output->showSweep('l', SWEEP_MODE_UP);
     smartDelay(220);
@@ -349,7 +569,7 @@ int VObd::kwpSlowInit(int proto, bool demoMode) {
     } else {
       output->showSweep('g', SWEEP_MODE_DOWN);
 //    snprintf_P(buf, 5, PSTR("_%02X_"), (int)bytes[0]);
-      snprintf_P(buf, 5, PSTR(" %02X "), (int)bytes[0]);
+      VFormat::appendHex(buf + 1, bytes[0], 2, false);   // Between the spaces set above
       output->showStatusString(buf);
     }
   }
@@ -387,11 +607,12 @@ int VObd::kwpFastInit(int proto) {
 
   // Send start-communication request
   unsigned char req[] = { 0xc1, 0x33, 0xf1, 0x81, 0x66 };
-  vserial.sendBytes(req, 5, 10400, QUERY_SEND_DELAY_BETWEEN_BYTES);
+  vserial.sendBytes(req, 5, QUERY_SEND_DELAY_BETWEEN_BYTES);
+  unsigned long sentTime = millis();
 
   // Receive start-communication response
   unsigned char *bytes;
-  int byteCount = vserial.readBytes(&bytes,  QUERY_RECEIVE_MESSAGE_TIMEOUT, QUERY_RECEIVE_BYTE_TIMEOUT, 10400, NULL, NULL);
+  int byteCount = vserial.readBytes(&bytes,  QUERY_RECEIVE_MESSAGE_TIMEOUT, QUERY_RECEIVE_BYTE_TIMEOUT, NULL, NULL);
 
   // Error - wrong # of bytes
   if (byteCount == 0) {
@@ -408,15 +629,324 @@ int VObd::kwpFastInit(int proto) {
     if (output) { output->showStatusString_P(PSTR("Kwd!")); smartDelay(400); output->showStatusByte(bytes[3]); smartDelay(100); }
     return 0;
   }
+
+  // As for slow init, P3 may run from the end of our request; a failed init
+  // leaves the clock alone, as there's no session to keep alive
+  lastPidRequestTime = sentTime;
   return proto;
 }
 
+void VObd::kwpStartHighSpeedSession() {
+  unsigned char baudId;
+
+  switch (highSpeedBaud) {
+    case 9600:   baudId = KWP_BAUD_ID_9600;   break;
+    case 19200:  baudId = KWP_BAUD_ID_19200;  break;
+    case 38400:  baudId = KWP_BAUD_ID_38400;  break;
+    case 57600:  baudId = KWP_BAUD_ID_57600;  break;
+    case 115200: baudId = KWP_BAUD_ID_115200; break;
+    default: return;
+  }
+  if (highSpeedFailures >= OBD_HIGH_SPEED_MAX_FAILURES || protocol == OBD_PROTOCOL_ISO_9141) return;
+
+  // Request a diagnostic session at the faster rate.  The ECU acknowledges
+  // at the current baud and switches once the response has been sent.
+  // Example: 83 33 F1 10 81 02 -> 83 F1 11 50 81 02
+  unsigned char req[] = { KWP_SERVICE_START_DIAGNOSTIC_SESSION, KWP_DIAGNOSTIC_MODE_STANDARD, baudId };
+  unsigned char buf[2];
+  sendRequest(req, sizeof(req));
+
+  int byteCount = receivePidResponseData(buf, sizeof(buf), 0, KWP_SERVICE_START_DIAGNOSTIC_SESSION, false, 0);
+  if (byteCount < 1 || buf[0] != KWP_DIAGNOSTIC_MODE_STANDARD) {
+    // A refusal won't change, while a lost reply may just be noise
+    highSpeedFailures = (byteCount < 0) ? highSpeedFailures + 1 : OBD_HIGH_SPEED_MAX_FAILURES;
+    return;
+  }
+
+  vserial.setBaud(highSpeedBaud);
+  if (output) { output->showStatusString_P(PSTR("HiSP")); }
+}
+
+// On an error at the faster baud.  The ECU keeps its session's baud until
+// told otherwise or its P3 runs out, so the session ends here and the next
+// connect starts over at the default baud.
+void VObd::dropToDefaultBaud() {
+  if (vserial.getBaud() == SERIAL_DEFAULT_BAUD) return;
+
+  stopHighSpeedSession();
+  protocol = 0;
+  if (highSpeedFailures < OBD_HIGH_SPEED_MAX_FAILURES) highSpeedFailures++;
+}
+
+// Asks the ECU to end a session at the faster baud, then goes back to the default
+void VObd::stopHighSpeedSession() {
+  if (vserial.getBaud() == SERIAL_DEFAULT_BAUD) return;
+
+  // Example: 81 33 F1 82 27 -> 81 F1 11 C2 45, ignored if the ECU has moved on
+  if (protocol) {
+    unsigned char req[] = { KWP_SERVICE_STOP_COMMUNICATION };
+    unsigned char *bytes;
+    sendRequest(req, sizeof(req));
+    vserial.readBytes(&bytes, QUERY_RECEIVE_MESSAGE_TIMEOUT, QUERY_RECEIVE_BYTE_TIMEOUT, NULL, NULL);
+  }
+  vserial.setBaud(SERIAL_DEFAULT_BAUD);
+}
+
+// Returns the number of requested pids found, and the number of pid records
+// in the reply through recordCount (-1 if nothing was sent)
+int VObd::requestPidsBatched(unsigned char *pids, int count, long *values, bool showErrors, int *recordCount) {
+  unsigned char data[OBD_MAX_PIDS_PER_REQUEST+1];
+  unsigned char buf[SERIAL_MAX_BYTES];
+  int length = 0;
+  int found = 0;
+
+  data[length++] = 1;
+  for (int i=0; i<count && i<OBD_MAX_PIDS_PER_REQUEST; i++) {
+    if (!getPidDataLength(pids[i])) {
+      *recordCount = -1;   // Not sent, so nothing to judge support by
+      return 0;
+    }
+    data[length++] = pids[i];
+  }
+
+  // Example: 84 33 F1 01 0D 5E 0C CS -> 88 F1 11 41 0D 32 5E 01 F4 0C 1A F8 CS
+  sendRequest(data, length);
+  int byteCount = receivePidResponseData(buf, sizeof(buf), pids[0], 1, showErrors, 0);
+  lastPidRequestTime = millis();
+
+  // Split into per-pid values; the first pid was consumed by the header check
+  unsigned char pid = pids[0];
+  for (int i=0; i<byteCount; ) {
+    int pidLength = getPidDataLength(pid);
+    if (!pidLength || i + pidLength > byteCount) break;
+
+    long value = 0;
+    (*recordCount)++;
+    for (int j=0; j<pidLength; j++) {
+      value = (value << 8) | buf[i++];
+    }
+    for (int k=0; k<count; k++) {
+      if (pids[k] == pid && values[k] < 0) {
+        values[k] = value;
+        found++;
+        break;
+      }
+    }
+    if (i >= byteCount) break;
+    pid = buf[i++];
+  }
+  return found;
+}
+
+// Decodes mode 01 traffic between another tester and the ECU (Y cable on K+).
+// Requests are remembered so responses are only taken for pids that were asked for.
+// Returns the number of pid values found in the next message on the bus.
+int VObd::listenForPids(unsigned char *pids, long *values, int maxCount) {
+  unsigned char *bytes;
+  int found = 0;
+  int byteCount = vserial.readBytes(&bytes, QUERY_LISTEN_MESSAGE_TIMEOUT, QUERY_RECEIVE_BYTE_TIMEOUT, NULL, NULL);
+
+  if (byteCount < 3) return 0;
+
+  // Not connected, so tell header formats apart by the first byte (68/48 = ISO 9141 request/response)
+  int connectedProtocol = protocol;
+  if (!connectedProtocol) {
+    protocol = (bytes[0] == 0x68 || bytes[0] == 0x48) ? OBD_PROTOCOL_ISO_9141 : OBD_PROTOCOL_KWP_FAST;
+  }
+
+  struct ObdFrame frames[OBD_MAX_FRAMES];
+  int frameCount = splitFrames(bytes, byteCount, frames, OBD_MAX_FRAMES);
+
+  for (int f=0; f<frameCount; f++) {
+    unsigned char *frame = bytes + frames[f].start;
+    int length = frames[f].length;
+    int headerSize = getHeaderSize(frame);
+
+    // Skip partial or corrupt frames
+    if (length < headerSize + 2 || getChecksum(frame, 0, length-2) != frame[length-1]) continue;
+
+    // Example: c2 33 F1 01 0d F4 -> 83 F1 11 41 0d 64 37
+    unsigned char sid = frame[headerSize];
+    int dataStart = headerSize + 1;
+    int dataEnd = length - 1;
+
+    if (sid == 1) {
+      listenPidCount = 0;
+      for (int i=dataStart; i<dataEnd && listenPidCount<OBD_MAX_PIDS_PER_REQUEST; i++) {
+        listenPids[listenPidCount++] = frame[i];
+      }
+    }
+
+    else if (sid == 0x41 && listenPidCount) {
+      for (int i=dataStart; i<dataEnd; ) {
+        unsigned char pid = frame[i++];
+        int pidLength = getPidDataLength(pid);
+        if (!pidLength || i + pidLength > dataEnd) break;
+
+        long value = 0;
+        for (int j=0; j<pidLength; j++) {
+          value = (value << 8) | frame[i++];
+        }
+        for (int k=0; k<listenPidCount; k++) {
+          if (listenPids[k] == pid && found < maxCount) {
+            pids[found] = pid;
+            values[found++] = value;
+            break;
+          }
+        }
+      }
+      listenPidCount = 0;
+    }
+
+    // Any other request ends the pending one
+    else if (sid < 0x40) {
+      listenPidCount = 0;
+    }
+  }
+  protocol = connectedProtocol;
+  return found;
+}
+
+int VObd::getPidDataLength(unsigned char pid) {
+  if (pid >= sizeof(obd_pidDataLengths) - 1) return 0;
+  return pgm_read_byte_near(obd_pidDataLengths + pid) - '0';
+}
+
+unsigned char VObd::getLastNackCode() {
+  return lastResult == OBD_RESULT_NACK ? lastNackCode : 0;
+}
+
+int VObd::getHeaderSize(unsigned char *frame) {
+  int headerSize = 0;
+
+  switch (protocol) {
+    case OBD_PROTOCOL_ISO_9141:
+      // [48 6B 10] [41 0D] 7F [90]
+      headerSize = 3;
+      break;
+
+    case OBD_PROTOCOL_KWP_SLOW:
+    case OBD_PROTOCOL_KWP_FAST:
+      // Sample: [83 F1 11] [41 0D] 78 [4B]
+      headerSize = 1;
+      if (frame[0] & 0x80) headerSize += 2;       // target, source addresses in header
+      if ((frame[0] & 0x3f)==0) headerSize += 1;  // extra length byte at end of header
+      break;
+  }
+  return headerSize;
+}
+
+int VObd::splitFrames(unsigned char *bytes, int byteCount, struct ObdFrame *frames, int maxFrames) {
+  int frameCount = 0;
+  int start = 0;
+
+  // Example: [83 F1 11 41 0D 64 37] [83 F1 18 41 0D 64 3E] (engine, transmission)
+  while (start < byteCount && frameCount < maxFrames) {
+    int headerSize = getHeaderSize(bytes + start);
+    int length = byteCount - start;
+
+    if (protocol == OBD_PROTOCOL_ISO_9141) {
+      // No length in header, so end at a matching checksum followed by another header (or the end)
+      unsigned char sum = 0;
+      for (int i = start; i < byteCount - 1; i++) {
+        sum += bytes[i];
+        if (i - start >= headerSize && sum == bytes[i+1] && (i + 2 == byteCount || bytes[i+2] == bytes[start])) {
+          length = i + 2 - start;
+          break;
+        }
+      }
+    } else if (start + headerSize <= byteCount) {
+      int dataLength = (bytes[start] & 0x3f) ? (bytes[start] & 0x3f) : bytes[start + headerSize - 1];
+      length = min(headerSize + dataLength + 1, byteCount - start);
+    }
+
+    frames[frameCount].start = start;
+    frames[frameCount].length = length;
+    frames[frameCount].source = (length > 2 && (protocol == OBD_PROTOCOL_ISO_9141 || (bytes[start] & 0x80))) ? bytes[start + 2] : 0;
+    frameCount++;
+    start += length;
+  }
+  return frameCount;
+}
+
+// Picks the engine ECU's frame, which is then the only one taken and the
+// target of physical addressing.  Until it has answered, another ECU's
+// positive response carrying the requested pid will do, without being
+// remembered, so a transmission answering first can't take over the session.
+int VObd::selectFrame(unsigned char *bytes, struct ObdFrame *frames, int frameCount, unsigned char pid, int mode) {
+  int first = -1;
+  int positive = -1;
+  int carrying = -1;
+
+  for (int i=0; i<frameCount; i++) {
+    unsigned char *frame = bytes + frames[i].start;
+    int headerSize = getHeaderSize(frame);
+    if (frames[i].length <= headerSize) continue;
+
+    // Once known, only accept frames from our ECU
+    if (ecuAddress) {
+      if (frames[i].source == ecuAddress) return i;
+      continue;
+    }
+
+    if (first < 0) first = i;
+    if (frame[headerSize] != (0x40 + mode)) continue;
+    if (frames[i].source >= OBD_ENGINE_ADDRESS_FIRST && frames[i].source <= OBD_ENGINE_ADDRESS_LAST) {
+      ecuAddress = frames[i].source;
+      return i;
+    }
+    if (positive < 0) positive = i;
+    if (carrying < 0 && (mode != 1 || (frames[i].length > headerSize + 1 && frame[headerSize + 1] == pid))) carrying = i;
+  }
+  return (carrying >= 0) ? carrying : (positive >= 0) ? positive : first;
+}
+
 unsigned char VObd::getChecksum(unsigned char *buf, int start, int end) {
   unsigned char sum = 0;
   for (int i=start; i<=end; i++) sum += buf[i];
   return sum;
 }
 
+#if OBD_STATS_ENABLED
+// Adds the response just parsed to its protocol's and its request's statistics
+void VObd::recordStats(unsigned char pid, int mode) {
+  struct SerialReadTiming *read = vserial.getReadTiming();
+  struct ObdPidStats *slot = NULL;
+
+  if (protocol >= OBD_PROTOCOL_FIRST && protocol <= OBD_PROTOCOL_LAST) {
+    addTimingStats(&stats.protocols[protocol - 1], read);
+  }
+
+  // The request's slot, else the first free one
+  for (int i=0; i<OBD_STATS_PID_SLOTS && !slot; i++) {
+    if (stats.pids[i].mode == mode && stats.pids[i].pid == pid) slot = &stats.pids[i];
+  }
+  for (int i=0; i<OBD_STATS_PID_SLOTS && !slot; i++) {
+    if (!stats.pids[i].mode) {
+      slot = &stats.pids[i];
+      slot->mode = mode;
+      slot->pid = pid;
+    }
+  }
+  if (slot) addTimingStats(&slot->timing, read);
+}
+
+void VObd::addTimingStats(struct ObdTimingStats *timing, struct SerialReadTiming *read) {
+  obd_addToHistogram(timing->results, OBD_RESULT_COUNT_ALL, lastResult);
+
+  // Timeouts have no response to time
+  if (lastResult == OBD_RESULT_TIMEOUT) return;
+
+  unsigned long p2 = read->firstByteStart - requestEnd;
+  unsigned long total = read->lastByteEnd - requestStart;
+  obd_addToHistogram(timing->p2, OBD_STATS_BUCKET_COUNT, obd_getStatsBucket(p2));
+  obd_addToHistogram(timing->p1, OBD_STATS_BUCKET_COUNT, obd_getStatsBucket(read->maxByteGap));
+  obd_addToHistogram(timing->total, OBD_STATS_BUCKET_COUNT, obd_getStatsBucket(total));
+  timing->maxP2Ms = max(timing->maxP2Ms, min(p2 / 1000, 0xffUL));
+  timing->maxP1Ms = max(timing->maxP1Ms, min(read->maxByteGap / 1000, 0xffUL));
+}
+#endif
+
 void VObd::debugBytes(unsigned char *bytes, int byteCount, int minByteSpacing, int maxByteSpacing) {
   if (output) { 
     output->showStatusString_P(PSTR("CNT="));
@@ -428,7 +958,9 @@ void VObd::debugBytes(unsigned char *bytes, int byteCount, int minByteSpacing, i
     // Show initial byte in buffer if response is empty (debug code)
     for (int i=0; i<byteCount; i++) {
       char text[6];
-      snprintf_P(text, sizeof(text), PSTR("%-2d.%02X"), i, (int)bytes[i]);
+      char *p = VFormat::appendPadding(VFormat::appendDecimal(text, i), text, 2);
+      *p++ = '.';
+      *VFormat::appendHex(p, bytes[i], 2, false) = 0;
       output->showStatusString(text);
       smartDelay(500);
     }
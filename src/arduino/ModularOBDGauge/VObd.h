@@ -63,16 +63,102 @@
 #define QUERY_RECEIVE_MESSAGE_TIMEOUT       (KWP_P2_MAX_MESSAGE_SPACING_FROM_VEHICLE+1)
 #define QUERY_RECEIVE_BYTE_TIMEOUT          (KWP_P1_MAX_BYTE_SPACING_FROM_VEHICLE+1)
 #define QUERY_RECEIVE_BYTE_TIMEOUT_SNIFFING 300
+#define QUERY_LISTEN_MESSAGE_TIMEOUT        300
 #define QUERY_SEND_DELAY_BETWEEN_BYTES      (ISO_9141_P4_MIN_BYTE_SPACING_TO_VEHICLE+1)
 #define QUERY_MIN_INTERVAL                  (KWP_P3_MIN_DELAY_BEFORE_NEW_MESSAGE_TO_VEHICLE+5)
 #define QUERY_MAX_INTERVAL                  (KWP_P3_MAX_DELAY_BEFORE_NEW_MESSAGE_TO_VEHICLE-1000)
 
+// KWP2000 services from ISO-14230-3 specification
+
+#define KWP_SERVICE_START_DIAGNOSTIC_SESSION  0x10
+#define KWP_SERVICE_READ_DATA_BY_LOCAL_ID     0x21
+#define KWP_SERVICE_TESTER_PRESENT            0x3E
+#define KWP_SERVICE_STOP_COMMUNICATION        0x82
+#define KWP_DIAGNOSTIC_MODE_STANDARD          0x81
+#define KWP_TESTER_PRESENT_RESPONSE_REQUIRED  0x01
+#define KWP_TESTER_PRESENT_NO_RESPONSE        0x02
+
+// Negative response codes
+#define KWP_NACK_SERVICE_NOT_SUPPORTED        0x11
+#define KWP_NACK_SUB_FUNCTION_NOT_SUPPORTED   0x12
+#define KWP_NACK_REQUEST_OUT_OF_RANGE         0x31
+
+// Keep-alive requests, downgraded when the ECU rejects one
+
+#define OBD_KEEP_ALIVE_TESTER_PRESENT_SILENT  0  // 3E 02, no reply expected
+#define OBD_KEEP_ALIVE_TESTER_PRESENT         1  // 3E 01
+#define OBD_KEEP_ALIVE_PID_REQUEST            2  // 01 00 (ISO 9141 has no TesterPresent)
+
+// Sessions dropped at the faster baud before it's no longer asked for; a refusal counts as all of them
+#define OBD_HIGH_SPEED_MAX_FAILURES  3
+
+// Mode 01 requests may list up to six pids (SAE J1979)
+
+#define OBD_MAX_PIDS_PER_REQUEST  6
+
+#define OBD_MULTI_PID_UNKNOWN     0
+#define OBD_MULTI_PID_SUPPORTED   1
+#define OBD_MULTI_PID_UNSUPPORTED 2
+
+#define OBD_MULTI_PID_MAX_PROBE_TIMEOUTS 3   // In a row, before an ECU that ignores them is taken not to support them
+
+// Frames split from one receive window, when several ECUs answer a functional request
+
+#define OBD_MAX_FRAMES 4
+
+// Physical addresses of engine controllers (SAE J2178); 18-1F are transmissions
+#define OBD_ENGINE_ADDRESS_FIRST  0x10
+#define OBD_ENGINE_ADDRESS_LAST   0x17
+
+struct ObdFrame {
+  unsigned char start;   // offset in received bytes
+  unsigned char length;  // header + data + checksum
+  unsigned char source;  // sender address, 0 if header has none
+};
+
+// Outcome of the last response parsed
+
+#define OBD_RESULT_OK       0
+#define OBD_RESULT_TIMEOUT  1  // no bytes
+#define OBD_RESULT_COUNT    2  // too short, or no frame from our ECU
+#define OBD_RESULT_NACK     3
+#define OBD_RESULT_SID      4
+#define OBD_RESULT_PID      5
+#define OBD_RESULT_COUNT_ALL 6
+
+// Response timing statistics, with OBD_STATS_ENABLED.  Counts are bytes; a
+// histogram is halved when one of its buckets fills, keeping its shape.
+
+#define OBD_STATS_BUCKET_COUNT  8   // Upper bounds in obd_statsBucketMs
+#define OBD_STATS_PID_SLOTS     6   // Requests tracked separately, first come
+
+struct ObdTimingStats {
+  uint8_t p2[OBD_STATS_BUCKET_COUNT];        // end of request to first response byte
+  uint8_t p1[OBD_STATS_BUCKET_COUNT];        // longest gap between response bytes
+  uint8_t total[OBD_STATS_BUCKET_COUNT];     // start of request to end of response
+  uint8_t results[OBD_RESULT_COUNT_ALL];     // OBD_RESULT_*
+  uint8_t maxP2Ms;
+  uint8_t maxP1Ms;
+};
+
+struct ObdPidStats {
+  uint8_t mode;   // 0 if unused
+  uint8_t pid;    // first pid of batched requests
+  struct ObdTimingStats timing;
+};
+
+struct ObdStats {
+  struct ObdTimingStats protocols[OBD_PROTOCOL_LAST];  // by protocol - 1
+  struct ObdPidStats pids[OBD_STATS_PID_SLOTS];
+};
+
 struct ObdOutputProvider {
   void  (*showStatusString)(char *text);
   void  (*showStatusString_P)(char *text);
   void  (*showStatusInteger)(int num);
   void  (*showStatusByte)(int num);
-  void  (*showSweep)(char color, int mode);
+  void  (*showSweep)(char color, int mode);   // Animates while the caller carries on
+  void  (*deferBar)(bool deferred);           // Holds ring refreshes through timed init phases; nests
 };
 
 #define SWEEP_MODE_RIGHT_LEFT 0
@@ -80,6 +166,8 @@ struct ObdOutputProvider {
 #define SWEEP_MODE_DOWN       2
 
 class VObd {
+  friend class VBench;
+
   private:
     VSerial vserial;
     int protocol = 0;
@@ -88,26 +176,67 @@ class VObd {
     unsigned char keyByte2; // Used for kwp header format
     unsigned long lastPidRequestTime;
     bool autoPidRequestDisabled;
+    unsigned long highSpeedBaud = OBD_HIGH_SPEED_BAUD;
+    uint8_t highSpeedFailures;   // Up to OBD_HIGH_SPEED_MAX_FAILURES, since power on
+    int  multiPidSupport;   // Probed on first batched request after connecting
+    uint8_t multiPidTimeouts;  // Unanswered probes in a row
+    int  keepAliveMode;
+    unsigned char ecuAddress; // Physical address of the engine ECU once it has answered, else 0
+    unsigned char listenPids[OBD_MAX_PIDS_PER_REQUEST]; // Pids of last observed mode 01 request
+    int  listenPidCount;
+    uint8_t lastResult;     // OBD_RESULT_* of the last response parsed
+    uint8_t lastNackCode;   // Response code of the last NACK
+#if OBD_STATS_ENABLED
+    unsigned long requestStart;
+    unsigned long requestEnd;
+    struct ObdStats stats;
+#endif
     void (*smartDelay)(unsigned long);
 
     struct ObdOutputProvider *output;
 
     int kwpSlowInit(int protocol, bool demoMode);
     int kwpFastInit(int protocol);
+    void kwpStartHighSpeedSession();
+    void dropToDefaultBaud();
+    void stopHighSpeedSession();
     unsigned char getChecksum(unsigned char *buf, int start, int end);
+    int  getHeaderSize(unsigned char *frame);
+    int  splitFrames(unsigned char *bytes, int byteCount, struct ObdFrame *frames, int maxFrames);
+    int  selectFrame(unsigned char *bytes, struct ObdFrame *frames, int frameCount, unsigned char pid, int mode);
+    int  parsePidResponse(unsigned char *bytes, int byteCount, unsigned char *outbuf, int maxBytes, unsigned char pid, int mode, bool showErrors);
+    int  requestPidsBatched(unsigned char *pids, int count, long *values, bool showErrors, int *recordCount);
     void debugBytes(unsigned char *bytes, int byteCount, int minByteSpacing, int maxByteSpacing);
     void debugLongs(unsigned long *longs, int longCount);
+#if OBD_STATS_ENABLED
+    void recordStats(unsigned char pid, int mode);
+    void addTimingStats(struct ObdTimingStats *timing, struct SerialReadTiming *read);
+#endif
 
   public:
     void setup(int in, int out, void (*smartDelay)(unsigned long), struct ObdOutputProvider *optionalOutputProvider);
+    void setCaptureProvider(struct SerialCaptureProvider *provider);
+    void setHighSpeedBaud(unsigned long baud);   // Asked for after each KWP init, 0 for none
     void connect(int proto, bool demoMode);
     void disconnect();
     bool isConnected();
     void ping();
     bool resetConnection();
+    int  sendRequest(unsigned char *data, int length);
     int  sendPidRequest(unsigned char pid, int mode);
     long receivePidResponse(unsigned char pid, int mode, bool showErrors, int debugMode);  // pid0 + mode0 is a special sniffer mode
     int  receivePidResponseData(unsigned char *buf, int maxBytes, unsigned char pid, int mode, bool showErrors, int debugMode);
+    int  requestPids(unsigned char *pids, int count, long *values, unsigned char errorMask, bool firstRequired);  // bit i shows errors for pids[i]
+    int  readLocalIdentifier(unsigned char localId, unsigned char *buf, int maxBytes, bool showErrors);
+    int  listenForPids(unsigned char *pids, long *values, int maxCount);  // passive, never transmits
+    int  request(unsigned char *data, int length, unsigned char *response, int maxBytes);
+    int  getPidDataLength(unsigned char pid);  // mode 01 data bytes, 0 if unknown
+    unsigned char getLastNackCode();           // KWP_NACK_* of the last response, 0 if it wasn't one
+#if OBD_STATS_ENABLED
+    struct ObdStats *getStats();
+    void resetStats();
+    static int getStatsBucketMs(int bucket);  // upper bound, 0 for the last (open) bucket
+#endif
 };
 
 #endif
\ No newline at end of file
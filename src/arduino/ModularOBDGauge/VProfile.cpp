@@ -0,0 +1,63 @@
+#include "Environment.h"
+#include "VProfile.h"
+
+#include <Arduino.h>
+
+///////////////////////////////////////////////////////////////
+// VPROFILE.CPP
+// Loop phase timing counters
+///////////////////////////////////////////////////////////////
+
+#if PROFILE_ENABLED
+
+// Indexed by PROFILE_PHASE_*, readable on the digits
+static const char pf_phaseNames[PROFILE_PHASE_COUNT][PROFILE_NAME_SIZE] PROGMEM = {
+  "Loop", "Conn", "P3", "tx", "P2", "rx", "rInG", "dIGt", "EEPr", "tItL"
+};
+
+struct ProfileCounter {
+  unsigned long minMicros;
+  unsigned long maxMicros;
+  unsigned long totalMicros;
+  unsigned int  count;
+};
+
+static struct ProfileCounter pf_counters[PROFILE_PHASE_COUNT];
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VProfile::add(uint8_t phase, unsigned long elapsedMicros) {
+  struct ProfileCounter *counter = &pf_counters[phase];
+
+  if (!counter->count || elapsedMicros < counter->minMicros) counter->minMicros = elapsedMicros;
+  if (elapsedMicros > counter->maxMicros) counter->maxMicros = elapsedMicros;
+
+  // Halve rather than wrap, so the average keeps following recent passes
+  if (counter->count == 0xffff || counter->totalMicros + elapsedMicros < counter->totalMicros) {
+    counter->count >>= 1;
+    counter->totalMicros >>= 1;
+  }
+  counter->totalMicros += elapsedMicros;
+  counter->count++;
+}
+
+extern void VProfile::getPhase(uint8_t phase, struct ProfilePhase *result) {
+  struct ProfileCounter *counter = &pf_counters[phase];
+
+  result->minMicros = counter->minMicros;
+  result->maxMicros = counter->maxMicros;
+  result->avgMicros = counter->count ? counter->totalMicros / counter->count : 0;
+  result->count = counter->count;
+}
+
+extern void VProfile::getPhaseName(uint8_t phase, char *buf) {
+  strcpy_P(buf, pf_phaseNames[phase]);
+}
+
+extern void VProfile::reset() {
+  memset(pf_counters, 0, sizeof(pf_counters));
+}
+
+#endif
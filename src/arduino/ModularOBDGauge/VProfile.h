@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////
+// VPROFILE.H
+// Loop phase timing counters
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+
+#ifndef _VPROFILE
+#define _VPROFILE
+
+#define PROFILE_NAME_SIZE     5
+
+// Phases; they nest, e.g. a loop includes the transmit and receive within it
+#define PROFILE_PHASE_LOOP      0   // VDisplayables::mainLoop, one pass
+#define PROFILE_PHASE_CONNECT   1   // VObd::connect, init through start of session
+#define PROFILE_PHASE_P3_WAIT   2   // VObd::sendRequest, minimum gap before a request
+#define PROFILE_PHASE_TRANSMIT  3   // VSerial::sendBytes
+#define PROFILE_PHASE_P2_WAIT   4   // VSerial::readBytes, until the first start bit
+#define PROFILE_PHASE_RECEIVE   5   // VSerial::readBytes, first start bit to inactivity timeout
+#define PROFILE_PHASE_RING      6   // Ring updates in the app glue
+#define PROFILE_PHASE_DIGITS    7   // Number formatting and digit updates in the app glue
+#define PROFILE_PHASE_EEPROM    8   // Persisted state writes
+#define PROFILE_PHASE_TITLES    9   // Gauge title display between values
+#define PROFILE_PHASE_COUNT     10
+
+// Brackets a phase; both compile to nothing unless PROFILE_ENABLED
+#if PROFILE_ENABLED
+  #define PROFILE_BEGIN(_start)         unsigned long _start = micros()
+  #define PROFILE_END(_phase, _start)   VProfile::add(_phase, micros() - (_start))
+#else
+  #define PROFILE_BEGIN(_start)
+  #define PROFILE_END(_phase, _start)
+#endif
+
+struct ProfilePhase {
+  unsigned long minMicros;
+  unsigned long maxMicros;
+  unsigned long avgMicros;
+  unsigned int  count;      // passes in the average, halved with it when full
+};
+
+// Counters are shared by all modules, so methods are static
+class VProfile {
+  public:
+    static void add(uint8_t phase, unsigned long elapsedMicros);
+    static void getPhase(uint8_t phase, struct ProfilePhase *result);
+    static void getPhaseName(uint8_t phase, char *buf);   // buf holds PROFILE_NAME_SIZE
+    static void reset();
+};
+
+#endif
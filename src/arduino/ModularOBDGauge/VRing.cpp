@@ -11,19 +11,151 @@
 
 #define RING_FLAGS  NEO_RGB + NEO_KHZ800
 
+#if WOKWI
+  #define RING_DIM(_v)  (uint8_t)((_v)/1.2)
+#else
+  #define RING_DIM(_v)  ((_v)/4)
+#endif
+
+struct RingColor {
+  char    color;
+  uint8_t g, r, b;
+};
+
+// Colors by character, dim variants scaled at compile time; unknown characters are white
+static constexpr struct RingColor rn_palette[] PROGMEM = {
+                                                           // g     r     b
+  { 'w', 0x88, 0x88, 0x88 },
+  { 'r', 0x00, 0xff, 0x00 },
+  { 'n', 0x0d, 0x50, 0x02 },
+  { 'o', 0x50, 0xff, 0x00 },
+  { 'y', 0x77, 0x77, 0x10 },
+  { 'l', 0xaa, 0x44, 0x00 },
+  { 'g', 0xff, 0x00, 0x00 },
+  { 'c', 0xcc, 0x00, 0x50 },
+  { 'b', 0x20, 0x00, 0xff },
+  { 'i', 0x00, 0x00, 0xff },
+  { 'v', 0x00, 0xff, 0x80 },
+  { 'p', 0x00, 0x20, 0xaa },
+  { 'k', 0x00, 0x00, 0x00 },
+
+  { 'R', RING_DIM(0x00), RING_DIM(0xaa), RING_DIM(0x00) },
+  { 'N', RING_DIM(0x20), RING_DIM(0x50), RING_DIM(0x02) },
+  { 'O', RING_DIM(0x50), RING_DIM(0xff), RING_DIM(0x00) },
+  { 'Y', RING_DIM(0x77), RING_DIM(0x77), RING_DIM(0x10) },
+  { 'L', RING_DIM(0xaa), RING_DIM(0x44), RING_DIM(0x00) },
+  { 'G', RING_DIM(0xff), RING_DIM(0x00), RING_DIM(0x00) },
+  { 'C', RING_DIM(0xcc), RING_DIM(0x00), RING_DIM(0x50) },
+  { 'B', RING_DIM(0x40), RING_DIM(0x00), RING_DIM(0xff) },
+  { 'I', RING_DIM(0x00), RING_DIM(0x00), RING_DIM(0xff) },
+  { 'V', RING_DIM(0x00), RING_DIM(0xff), RING_DIM(0x80) },
+  { 'P', RING_DIM(0x00), RING_DIM(0x40), RING_DIM(0xaa) },
+  { 'K', 0x00, 0x00, 0x00 },
+
+  { 'W', 0x33, 0x33, 0x33 },
+  { 'e', 0x19, 0x19, 0x19 },
+
+  // Menu banks
+  { '-', RING_DIM(0x00), RING_DIM(0x00), RING_DIM(0x10) },
+  { '+', RING_DIM(0x00), RING_DIM(0x00), RING_DIM(0x20) },
+
+  { '1', RING_DIM(0x00), RING_DIM(0x80), RING_DIM(0x00) },   // red
+  { '2', RING_DIM(0x40), RING_DIM(0x80), RING_DIM(0x00) },   // yellow
+  { '3', RING_DIM(0x80), RING_DIM(0x40), RING_DIM(0x00) },   // green
+  { '4', RING_DIM(0x80), RING_DIM(0x00), RING_DIM(0x40) },   // cyan
+  { '5', RING_DIM(0x00), RING_DIM(0x40), RING_DIM(0x80) },   // purple
+};
+
+#define RING_PALETTE_COUNT (sizeof(rn_palette)/sizeof(rn_palette[0]))
+
+// Palette index of each 7-bit color character, worked out by the compiler so
+// a lookup is one flash read rather than a scan of the palette
+static constexpr uint8_t rn_paletteIndexOf(char color, uint8_t i) {
+  return i >= RING_PALETTE_COUNT ? 0 : rn_palette[i].color == color ? i : rn_paletteIndexOf(color, i + 1);
+}
+
+#define RING_INDEX4(_c)   rn_paletteIndexOf(_c, 0), rn_paletteIndexOf(_c+1, 0), rn_paletteIndexOf(_c+2, 0), rn_paletteIndexOf(_c+3, 0)
+#define RING_INDEX16(_c)  RING_INDEX4(_c), RING_INDEX4(_c+4), RING_INDEX4(_c+8), RING_INDEX4(_c+12)
+
+static const uint8_t rn_paletteIndexes[128] PROGMEM = {
+  RING_INDEX16(0),  RING_INDEX16(16), RING_INDEX16(32), RING_INDEX16(48),
+  RING_INDEX16(64), RING_INDEX16(80), RING_INDEX16(96), RING_INDEX16(112)
+};
+
 static Adafruit_NeoPixel ring;
 static int rn_brightness;
 static int rn_rotationOffset;
+static int rn_count;
+static char rn_colors[VRING_MAX_PIXELS];
+static uint32_t rn_dirty;          // Pixels changed since the last show, one bit each
+static uint8_t rn_deferred;       // Nesting depth of setShowDeferred(true)
+
+// Frames are drawn over the pixels in the mask, which keep their colors underneath
+struct RingAnimation {
+  uint32_t mask;                   // 0 when not running
+  unsigned long start;
+  uint8_t first;
+  uint8_t count;
+  uint8_t mode;
+  uint8_t frame;
+  uint8_t frameCount;
+  char color;
+};
+static struct RingAnimation rn_animation;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+static const struct RingColor *rn_findColor(char color) {
+  if ((uint8_t)color >= sizeof(rn_paletteIndexes)) return &rn_palette[0];
+  return &rn_palette[pgm_read_byte(&rn_paletteIndexes[(uint8_t)color])];
+}
+
+static void rn_writeColor(int i, char color) {
+  const struct RingColor *entry = rn_findColor(color);
+  ring.setPixelColor((i+rn_rotationOffset) % rn_count,
+    pgm_read_byte(&entry->g), pgm_read_byte(&entry->r), pgm_read_byte(&entry->b), 0);
+}
+
+static uint8_t rn_getSweepFrameCount(uint8_t mode, uint8_t count) {
+  return (mode == VRING_SWEEP_RIGHT_LEFT) ? count * 2 : count / 2 + 1;
+}
+
+static bool rn_isSweepPixelLit(uint8_t mode, uint8_t count, uint8_t frame, uint8_t i) {
+  uint8_t j;
+  switch (mode) {
+    case VRING_SWEEP_UP:   j = frame; break;
+    case VRING_SWEEP_DOWN: j = count / 2 - frame; break;
+    default:               return i == ((frame < count) ? frame : count * 2 - 1 - frame);
+  }
+  return i == j || i == count - 1 - j;
+}
+
+static void rn_drawAnimationFrame() {
+  struct RingAnimation *a = &rn_animation;
+  for (uint8_t i = 0; i < a->count; i++) {
+    rn_writeColor(a->first + i, rn_isSweepPixelLit(a->mode, a->count, a->frame, i) ? a->color : 'k');
+  }
+  ring.show();
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
 
 extern void VRing::setup(int pin, int count, int brightness, int rotationOffset) {
-  ring = Adafruit_NeoPixel(count, pin, RING_FLAGS);
+  rn_count = min(count, VRING_MAX_PIXELS);
+  ring = Adafruit_NeoPixel(rn_count, pin, RING_FLAGS);
   ring.begin();
 
   rn_rotationOffset = rotationOffset;
+  rn_deferred = 0;
 
-  for (int i = 0; i < count; i++) {
-    setPixelColor(i, 'k');
+  for (int i = 0; i < rn_count; i++) {
+    rn_colors[i] = 'k';
   }
+  rn_dirty = 0;
 
   ring.show();            
 
@@ -33,77 +165,95 @@ extern void VRing::setup(int pin, int count, int brightness, int rotationOffset)
 extern void VRing::setBrightness(int brightness) {
   rn_brightness = brightness;
   ring.setBrightness(brightness*6);
+
+  // Rewrite from the palette, rather than let the strip rescale its already scaled colors
+  for (int i = 0; i < rn_count; i++) {
+    if (rn_colors[i] != 'k') rn_dirty |= 1UL << i;
+  }
 }
 
 extern void VRing::setPixelColor(int i, char color) {
-#if WOKWI
-  float dim = 1.2;
-#else
-  int dim = 4;
-#endif
-  i = (i+rn_rotationOffset) % ring.numPixels();
-
-  switch (color) {               // g     r     b
-    case 'r': ring.setPixelColor(i, 0x00, 0xff, 0x00, 0); break;
-    case 'n': ring.setPixelColor(i, 0x0d, 0x50, 0x02, 0); break;
-    case 'o': ring.setPixelColor(i, 0x50, 0xff, 0x00, 0); break;
-    case 'y': ring.setPixelColor(i, 0x77, 0x77, 0x10, 0); break;
-    case 'l': ring.setPixelColor(i, 0xaa, 0x44, 0x00, 0); break;
-    case 'g': ring.setPixelColor(i, 0xff, 0x00, 0x00, 0); break;
-    case 'c': ring.setPixelColor(i, 0xcc, 0x00, 0x50, 0); break;
-    case 'b': ring.setPixelColor(i, 0x20, 0x00, 0xff, 0); break;
-    case 'i': ring.setPixelColor(i, 0x00, 0x00, 0xff, 0); break;
-    case 'v': ring.setPixelColor(i, 0x00, 0xff, 0x80, 0); break;
-    case 'p': ring.setPixelColor(i, 0x00, 0x20, 0xaa, 0); break;
-    case 'k': ring.setPixelColor(i, 0x00, 0x00, 0x00, 0); break;
-
-    case 'R': ring.setPixelColor(i, 0x00/dim, 0xaa/dim, 0x00/dim, 0); break;
-    case 'N': ring.setPixelColor(i, 0x20/dim, 0x50/dim, 0x02/dim, 0); break;
-    case 'O': ring.setPixelColor(i, 0x50/dim, 0xff/dim, 0x00/dim, 0); break;
-    case 'Y': ring.setPixelColor(i, 0x77/dim, 0x77/dim, 0x10/dim, 0); break;
-    case 'L': ring.setPixelColor(i, 0xaa/dim, 0x44/dim, 0x00/dim, 0); break;
-    case 'G': ring.setPixelColor(i, 0xff/dim, 0x00/dim, 0x00/dim, 0); break;
-    case 'C': ring.setPixelColor(i, 0xcc/dim, 0x00/dim, 0x50/dim, 0); break;
-    case 'B': ring.setPixelColor(i, 0x40/dim, 0x00/dim, 0xff/dim, 0); break;
-    case 'I': ring.setPixelColor(i, 0x00/dim, 0x00/dim, 0xff/dim, 0); break;
-    case 'V': ring.setPixelColor(i, 0x00/dim, 0xff/dim, 0x80/dim, 0); break;
-    case 'P': ring.setPixelColor(i, 0x00/dim, 0x40/dim, 0xaa/dim, 0); break;
-    case 'K': ring.setPixelColor(i, 0x00/dim, 0x00/dim, 0x00/dim, 0); break;
-
-    default:
-    case 'w': ring.setPixelColor(i, 0x88, 0x88, 0x88, 0); break;
-    case 'W': ring.setPixelColor(i, 0x33, 0x33, 0x33, 0); break;
-    case 'e': ring.setPixelColor(i, 0x19, 0x19, 0x19, 0); break;
-
-    // Menu banks
-    case '-': ring.setPixelColor(i, 0x00/dim, 0x00/dim, 0x10/dim, 0); break;
-    case '+': ring.setPixelColor(i, 0x00/dim, 0x00/dim, 0x20/dim, 0); break;
-
-    case '1': ring.setPixelColor(i, 0x00/dim, 0x80/dim, 0x00/dim, 0); break; // red
-    case '2': ring.setPixelColor(i, 0x40/dim, 0x80/dim, 0x00/dim, 0); break; // yellow
-    case '3': ring.setPixelColor(i, 0x80/dim, 0x40/dim, 0x00/dim, 0); break; // green
-    case '4': ring.setPixelColor(i, 0x80/dim, 0x00/dim, 0x40/dim, 0); break; // cyan
-    case '5': ring.setPixelColor(i, 0x00/dim, 0x40/dim, 0x80/dim, 0); break; // purple
-                                    // g     r     b
-
-  }
- }
+  if (i < 0 || i >= rn_count || rn_colors[i] == color) return;
+  rn_colors[i] = color;
+  rn_dirty |= 1UL << i;
+}
 
 extern void VRing::show() {
+  // Changes under an animation wait for it to end
+  uint32_t changed = rn_dirty & ~rn_animation.mask;
+  if (!changed || rn_deferred) return;
+
+  for (int i = 0; i < rn_count; i++) {
+    if (changed & (1UL << i)) rn_writeColor(i, rn_colors[i]);
+  }
+  rn_dirty &= ~changed;
   ring.show();
 }
 
-extern void VRing::showDemo() {
-  int num = ring.numPixels();
+extern void VRing::startSweep(int first, int count, char color, int mode) {
+  struct RingAnimation *a = &rn_animation;
+
+  first = constrain(first, 0, rn_count);
+  count = constrain(count, 0, rn_count - first);
+  a->mask = 0;
+  for (int i = first; i < first + count; i++) {
+    a->mask |= 1UL << i;
+  }
+  a->start = millis();
+  a->first = first;
+  a->count = count;
+  a->mode = mode;
+  a->color = color;
+  a->frame = 0xff;   // None drawn yet
+  a->frameCount = rn_getSweepFrameCount(mode, count);
 
-  for (int i=0; i<num; i++) {
+  // A blocking sweep left its range cleared, so callers see the same underneath
+  for (int i = first; i < first + count; i++) {
+    setPixelColor(i, 'k');
+  }
+  animate();
+}
+
+extern void VRing::animate() {
+  struct RingAnimation *a = &rn_animation;
+  if (!a->mask || rn_deferred) return;
+
+  // The frame due now, skipping any the caller was too busy to show
+  unsigned long frame = (millis() - a->start) / VRING_FRAME_MILLIS;
+  if (frame >= a->frameCount) {
+    rn_dirty |= a->mask;
+    a->mask = 0;
+    show();
+  } else if (frame != a->frame) {
+    a->frame = frame;
+    rn_drawAnimationFrame();
+  }
+}
+
+extern bool VRing::isAnimating() {
+  return rn_animation.mask != 0;
+}
+
+extern void VRing::setShowDeferred(bool deferred) {
+  // Deferrals nest, as when a slow init runs inside the passive loop's,
+  // so only the outermost clear shows what was held
+  if (deferred) {
+    rn_deferred++;
+  } else if (rn_deferred > 0) {
+    rn_deferred--;
+  }
+  show();
+}
+
+extern void VRing::showDemo() {
+  for (int i=0; i<rn_count; i++) {
     setPixelColor(i, i < 3 ? 'k' : (i & 1) ? 'g' : 'c');
   }
-  ring.show();            
+  show();
 }
 
 extern void VRing::clear() {
-  for (int i=0; i<ring.numPixels(); i++) {
+  for (int i=0; i<rn_count; i++) {
     setPixelColor(i, 'k');
   }
 }
@@ -6,13 +6,21 @@
 #ifndef _VRING
 #define _VRING
 
+#define VRING_MAX_PIXELS 32   // Pixels tracked by the dirty mask
+
+// Sweep modes, the same values as SWEEP_MODE_*
+#define VRING_SWEEP_RIGHT_LEFT  0   // One pixel out and back
+#define VRING_SWEEP_UP          1   // A pixel from each end, meeting in the middle
+#define VRING_SWEEP_DOWN        2   // From the middle out to the ends
+#define VRING_FRAME_MILLIS      40
+
 #define VRING_BROWN   'n'
 #define VRING_RED     'r'
 #define VRING_ORANGE  'o'
 #define VRING_YELLOW  'y'
 #define VRING_GREEN   'g'
 #define VRING_CYAN    'c'
-#define VRING_BLUE.   'b'
+#define VRING_BLUE    'b'
 #define VRING_INDIGO  'i'
 #define VRING_VIOLET  'v'
 #define VRING_PURPLE  'p'
@@ -25,7 +33,7 @@
 #define VRING_DIM_YELLOW  'Y'
 #define VRING_DIM_GREEN   'G'
 #define VRING_DIM_CYAN    'C'
-#define VRING_DIM_BLUE.   'B'
+#define VRING_DIM_BLUE    'B'
 #define VRING_DIM_INDIGO  'I'
 #define VRING_DIM_VIOLET  'V'
 #define VRING_DIM_PURPLE  'P'
@@ -34,12 +42,26 @@
 
 #define VRING_DIM_GRAY   VRING_DIM_WHITE
 
+// Pixel colors are kept as color characters and only changed pixels are
+// written to the strip, on show().  A strip refresh blocks interrupts for
+// about 30us per pixel, so show() does nothing if no pixel has changed,
+// and nothing while deferred, until each setShowDeferred(true) is matched
+// by a setShowDeferred(false).
 class VRing {
   public:
     void setup(int pin, int count, int brightness, int rotationOffset);
     void setBrightness(int brightness);
     void setPixelColor(int i, char color);
     void show();
+    void setShowDeferred(bool deferred);   // Nests; the last clear shows any changes held meanwhile
+
+    // Animations draw over a range of pixels from animate(), called from the
+    // idle loop, showing whichever frame is due and skipping late ones.  Pixels
+    // set meanwhile are shown once the animation ends; a sweep starts by
+    // clearing its range, as the blocking sweep it replaces did.
+    void startSweep(int first, int count, char color, int mode);
+    void animate();
+    bool isAnimating();
     void showDemo();
     void clear();
 };
@@ -1,4 +1,5 @@
 #include "VSerial.h"
+#include "VProfile.h"
 #include <Arduino.h>
 
 ///////////////////////////////////////////////////////////////
@@ -26,33 +27,169 @@ extern void VSerial::setup(int in, int out, void (*smartDelay)(unsigned long)) {
   }
 }
 
-extern int VSerial::readBytes(unsigned char **byteBuf, unsigned long timeoutMs, unsigned long inactivityTimeoutMs, unsigned long baud, unsigned long *minByteSpacing, unsigned long *maxByteSpacing) {
-  int flipCount = readFlips(flips, SERIAL_MAX_FLIPS, timeoutMs, inactivityTimeoutMs);
-  int byteCount = decodeFlipsToBytes(bytes, SERIAL_MAX_BYTES, flips, flipCount, baud, minByteSpacing, maxByteSpacing);
+extern void VSerial::setCaptureProvider(struct SerialCaptureProvider *provider) {
+  capture = provider;
+}
+
+extern void VSerial::setBaud(unsigned long newBaud) {
+  baud = newBaud;
+}
+
+extern unsigned long VSerial::getBaud() {
+  return baud;
+}
+
+#if OBD_STATS_ENABLED
+extern struct SerialReadTiming *VSerial::getReadTiming() {
+  return &readTiming;
+}
+#endif
+
+extern int VSerial::readBytes(unsigned char **byteBuf, unsigned long timeoutMs, unsigned long inactivityTimeoutMs, unsigned long *minByteSpacing, unsigned long *maxByteSpacing) {
+  unsigned int sampleUs[9];
+  unsigned long startTime = micros();
+  unsigned long endTime = startTime + timeoutMs * 1000L;
+  unsigned long endTime2 = startTime + inactivityTimeoutMs * 1000L;
+  int last = digitalRead(inPin);
+  int flipCount = 0;
+  int byteCount = 0;
+  bool foundLow = false;
+  unsigned long lastByteEdge = startTime;    // last edge of the last byte decoded
+#if OBD_STATS_ENABLED || PROFILE_ENABLED
+  unsigned long firstEdge = startTime;
+#endif
+#if OBD_STATS_ENABLED
+  unsigned long byteUs = 10000000L/baud;     // start bit to end of stop bit
+  unsigned long lastByteStart = startTime;   // first edge of the last byte decoded
+  unsigned long maxByteGap = 0;
+#endif
+
+  // Sample points at 1.5, 2.5, 3.5... 8.5 x period after start time, plus
+  // the stop bit (9.5), computed once rather than per bit
+  for (int i=0; i<9; i++) {
+    sampleUs[i] = (i * 1000000L + 1500000L)/baud;
+  }
+
+  // Listen for state changes, keeping only the edges of the byte in progress.
+  // Each byte is decoded once its stop bit is sampled, in the idle half bit
+  // before the next start bit can arrive, so edges within a byte are timed by
+  // a loop that does nothing else.  Message length is limited by the byte
+  // buffer rather than the flips buffer.
+  while(1) {
+    unsigned long time = micros();
+
+    if ((TIME_AFTER(time, endTime) && byteCount == 0 && flipCount == 0) || ((byteCount > 0 || flipCount > 0) && TIME_AFTER(time, endTime2))) break;
+
+    if (flipCount > 0) {
+      if (TIME_AFTER(flips[0] + sampleUs[8], time)) {
+        // Byte in progress
+        int val = digitalRead(inPin);
+        if (val != last) {
+          if (flipCount < SERIAL_BYTE_FLIPS) {
+            flips[flipCount++] = time;
+          }
+          last = val;
+          endTime2 = time + inactivityTimeoutMs * 1000L;
+        }
+        continue;
+      }
+
+      // Past the stop bit
+      bytes[byteCount++] = decodeAndCaptureByte(flips, flipCount, sampleUs);
+      lastByteEdge = flips[flipCount-1];
+#if OBD_STATS_ENABLED
+      lastByteStart = flips[0];
+#endif
+      flipCount = 0;
+      if (byteCount >= SERIAL_MAX_BYTES) break;
+    }
+
+    // Between bytes, call this to detect interruptions
+    ser_smartDelay(0);
+    if (capture) capture->service();
+
+    int val = digitalRead(inPin);
+    if (val != last) {
+      // Falling edge between bytes starts a new one
+      if (!val) {
+        if (!foundLow) {
+          foundLow = true;
+#if OBD_STATS_ENABLED || PROFILE_ENABLED
+          firstEdge = time;
+#endif
+#if PROFILE_ENABLED
+          VProfile::add(PROFILE_PHASE_P2_WAIT, time - startTime);
+#endif
+        } else if (byteCount > 0) {
+          // Get spacing for first few bytes (in outgoing request if sniffing packets)
+          if (byteCount < 5) {
+            unsigned long byteSpacing = time - lastByteEdge;
+            if (minByteSpacing && (byteCount == 1 || byteSpacing < *minByteSpacing)) *minByteSpacing = byteSpacing;
+            if (maxByteSpacing && (byteCount == 1 || byteSpacing > *maxByteSpacing)) *maxByteSpacing = byteSpacing;
+          }
+
+#if OBD_STATS_ENABLED
+          // Idle time from the stop bit to this start bit
+          long byteGap = time - lastByteStart - byteUs;
+          if (byteGap > (long)maxByteGap) maxByteGap = byteGap;
+#endif
+        }
+        flips[flipCount++] = time;
+      }
+      last = val;
+      endTime2 = time + inactivityTimeoutMs * 1000L;
+    }
+  }
+
+  // Decode final byte
+  if (flipCount > 0 && byteCount < SERIAL_MAX_BYTES) {
+    bytes[byteCount++] = decodeAndCaptureByte(flips, flipCount, sampleUs);
+#if OBD_STATS_ENABLED
+    lastByteStart = flips[0];
+#endif
+  }
+
+#if OBD_STATS_ENABLED
+  readTiming.start = startTime;
+  readTiming.firstByteStart = firstEdge;
+  readTiming.lastByteEnd = byteCount ? lastByteStart + byteUs : startTime;
+  readTiming.maxByteGap = maxByteGap;
+#endif
+
+#if PROFILE_ENABLED
+  // Silence counts as a wait for the whole timeout
+  if (foundLow) {
+    VProfile::add(PROFILE_PHASE_RECEIVE, micros() - firstEdge);
+  } else {
+    VProfile::add(PROFILE_PHASE_P2_WAIT, micros() - startTime);
+  }
+#endif
 
   *byteBuf = bytes;
   return byteCount;
 }
 
-extern int VSerial::readFlipIntervals(unsigned long **flipBuf, unsigned long timeoutMs, unsigned long inactivityTimeoutMs) {
-  int flipCount = readFlips(flips, SERIAL_MAX_FLIPS, timeoutMs, inactivityTimeoutMs);
+extern int VSerial::readFlipIntervals(unsigned long *flipBuf, int maxFlips, unsigned long timeoutMs, unsigned long inactivityTimeoutMs) {
+  int flipCount = readFlips(flipBuf, maxFlips, timeoutMs, inactivityTimeoutMs);
+  if (capture && flipCount) capture->captureFlips(flipBuf, flipCount);
   for (int i = flipCount-2; i >= 0; i--) {
-    flips[i+1] -= flips[i];
+    flipBuf[i+1] -= flipBuf[i];
   }
-  flips[0] = 0;
-  *flipBuf = flips;
+  flipBuf[0] = 0;
   return flipCount;
 }
 
 //#define US_BIT_OFFSET(_byte,_bit,_baud,_byteMsDelay)  (1000000L * ((_byte) * 10L + (_bit))/(_baud) + (_byte)*(_byteMsDelay)*1000L);  // start bit
 
-extern void VSerial::sendBytes(unsigned char *bytes, int count, unsigned long baud, int msDelayBetweenBytes) {
+extern void VSerial::sendBytes(unsigned char *bytes, int count, int msDelayBetweenBytes) {
+  PROFILE_BEGIN(start);
   for (int i=0; i<count; i++) {
      sendByte(*bytes++, baud);
     if (msDelayBetweenBytes && i<count-1) {
       delayUntil(micros() + msDelayBetweenBytes * 1000L);
     }
   }
+  PROFILE_END(PROFILE_PHASE_TRANSMIT, start);
 }
 
 extern void VSerial::sendByte(unsigned char val, unsigned long baud) {
@@ -64,9 +201,10 @@ extern void VSerial::sendByte(unsigned char val, unsigned long baud) {
       sendBit(value&1, startTime + (1000000L * (++totalPulses))/baud); // data bits
       value >>= 1;
     }
+    if (capture) capture->captureByte(startTime, val, SERIAL_CAPTURE_TX, NULL, 0);
 }
 
-extern void VSerial::sendByteRepeatedly(unsigned char byte, int count, unsigned long baud, int msDelayBetweenBytes) {
+extern void VSerial::sendByteRepeatedly(unsigned char byte, int count, int msDelayBetweenBytes) {
   for (int i=0; i<count; i++) {
     sendByte(byte, baud);
   }   
@@ -106,6 +244,7 @@ int VSerial::readFlips(long *buffer, int buflen, long messageTimeoutMs, long byt
 
     // Call this to detect interruptions
     ser_smartDelay(0);
+    if (capture) capture->service();
 
     int val = digitalRead(inPin);
     if (val != last) {
@@ -124,33 +263,25 @@ int VSerial::readFlips(long *buffer, int buflen, long messageTimeoutMs, long byt
   }
 }
 
-int VSerial::decodeFlipsToBytes(unsigned char *bytes, int bytesLen, unsigned long *flips, int flipCount, long baud, unsigned long *minByteSpacing, unsigned long *maxByteSpacing) {
-  int index = 0;
-  int startFlip = 0;
+unsigned char VSerial::decodeFlipsToByte(unsigned long *flips, int flipCount, unsigned int *sampleUs) {
+  unsigned long start = flips[0];
+  unsigned char value = 0;
 
-  while(1) {
-    if (startFlip >= flipCount) return index;
-    if (index >= bytesLen) return bytesLen;
-    
-    unsigned long start = flips[startFlip];
-
-    // read bytes, at 1.5, 2.5, 3.5... 8.5 x period after start time
-    bytes[index] = 0;
-    for (int i=0; i<=7; i++) {
-      bytes[index] |= decodeFlippedValueAtTime(start + (i * 1000000L + 1500000L)/baud, flips+startFlip, flipCount-startFlip) ? (1 << i) : 0;
-    }
-    index++;
+  for (int i=0; i<=7; i++) {
+    value |= decodeFlippedValueAtTime(start + sampleUs[i], flips, flipCount) ? (1 << i) : 0;
+  }
+  return value;
+}
 
-    // find next start bit (first down transition after stop bit)
-    while (startFlip < flipCount && flips[startFlip] < start + 9500000L/baud) startFlip += 2;
+unsigned char VSerial::decodeAndCaptureByte(unsigned long *flips, int flipCount, unsigned int *sampleUs) {
+  unsigned char value = decodeFlipsToByte(flips, flipCount, sampleUs);
 
-    // Get spacing for first few bytes (in outgoing request if sniffing packets)
-    if (startFlip < flipCount && index < 5) {
-      unsigned long byteSpacing = flips[startFlip] - flips[startFlip-1];
-      if (minByteSpacing && (index == 1 || byteSpacing < *minByteSpacing)) *minByteSpacing = byteSpacing;
-      if (maxByteSpacing && (index == 1 || byteSpacing > *maxByteSpacing)) *maxByteSpacing = byteSpacing;
-    }
+  if (capture) {
+    // Stop bit is sampled at 9.5 bit periods, the earliest next start bit
+    unsigned char flags = decodeFlippedValueAtTime(flips[0] + sampleUs[8], flips, flipCount) == 0 ? SERIAL_CAPTURE_FRAMING_ERROR : 0;
+    capture->captureByte(flips[0], value, flags, flips, flipCount);
   }
+  return value;
 }
 
 int VSerial::decodeFlippedValueAtTime(unsigned long time, unsigned long *flips, int flipCount) {
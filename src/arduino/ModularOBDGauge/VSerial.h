@@ -8,25 +8,59 @@
 #ifndef _VSERIAL
 #define _VSERIAL
 
+// Byte flags, also sent as is in stream BYTE records
+#define SERIAL_CAPTURE_TX             0x01  // sent by us (no flip intervals)
+#define SERIAL_CAPTURE_FRAMING_ERROR  0x02  // stop bit was low
+
+// Optional hooks to record bus traffic; all are called from bus timing loops so must return quickly
+struct SerialCaptureProvider {
+  void (*captureByte)(unsigned long time, unsigned char value, unsigned char flags, unsigned long *flips, int flipCount);
+  void (*captureFlips)(unsigned long *flips, int flipCount);
+  void (*service)(void);
+};
+
+// Edges of the last readBytes call, in micros
+struct SerialReadTiming {
+  unsigned long start;
+  unsigned long firstByteStart;   // start when nothing arrived
+  unsigned long lastByteEnd;      // end of the stop bit, start when nothing arrived
+  unsigned long maxByteGap;       // longest idle between a stop bit and the next start bit
+};
+
 class VSerial {
+  friend class VBench;
+
   private:
     int inPin, outPin;
-    unsigned long flips[SERIAL_MAX_FLIPS];
+    unsigned long baud = SERIAL_DEFAULT_BAUD;
+    unsigned long flips[SERIAL_BYTE_FLIPS];   // The byte in progress
     unsigned char bytes[SERIAL_MAX_BYTES];
+    struct SerialCaptureProvider *capture;
+#if OBD_STATS_ENABLED
+    struct SerialReadTiming readTiming;
+#endif
 
     int  readFlips(long *buffer, int buflen, long startTimeoutMs, long inactivityTimeoutMs);
-    int  decodeFlipsToBytes(unsigned char *bytes, int bytesLen, unsigned long *flips, int flipCount, long baud, unsigned long *minByteSpacing, unsigned long *maxByteSpacing);
-    int  decodeFlippedValueAtTime(unsigned long time, unsigned long *flips, int flipCount);
+    static unsigned char decodeFlipsToByte(unsigned long *flips, int flipCount, unsigned int *sampleUs);
+    unsigned char decodeAndCaptureByte(unsigned long *flips, int flipCount, unsigned int *sampleUs);
+    static int decodeFlippedValueAtTime(unsigned long time, unsigned long *flips, int flipCount);
     void delayUntil(unsigned long waitUs);
 
   public:
     void setup(int inPin, int outPin, void (*smartDelay)(unsigned long));
+    void setCaptureProvider(struct SerialCaptureProvider *provider);
+    void setBaud(unsigned long baud);
+    unsigned long getBaud();
+#if OBD_STATS_ENABLED
+    struct SerialReadTiming *getReadTiming();
+#endif
 
-    int  readBytes(unsigned char **byteBuf, unsigned long timeoutMs, unsigned long inactivityTimeoutMs, unsigned long baud, unsigned long *minByteSpacing, unsigned long *maxByteSpacing);
-    int  readFlipIntervals(unsigned long **byteBuf, unsigned long timeoutMs, unsigned long inactivityTimeoutMs);
-    void sendBytes(unsigned char *bytes, int count, unsigned long baud, int msDelayBetweenBytes);
+    // Reads and writes use the session baud set above
+    int  readBytes(unsigned char **byteBuf, unsigned long timeoutMs, unsigned long inactivityTimeoutMs, unsigned long *minByteSpacing, unsigned long *maxByteSpacing);
+    int  readFlipIntervals(unsigned long *flipBuf, int maxFlips, unsigned long timeoutMs, unsigned long inactivityTimeoutMs);
+    void sendBytes(unsigned char *bytes, int count, int msDelayBetweenBytes);
     void sendByte(unsigned char val, unsigned long baud);
-    void sendByteRepeatedly(unsigned char byte, int count, unsigned long baud, int msDelay);
+    void sendByteRepeatedly(unsigned char byte, int count, int msDelay);
     void sendBit(int val, long waitUs);
     void waitForIdle(unsigned long idleMs, unsigned long timeoutMs);
 };
@@ -188,17 +188,25 @@ bool st_isValuesItemHidden(int item) {
 #define SETTINGS_MENU_MODES_ITEM_LOOP_MODE      1
 #define SETTINGS_MENU_MODES_ITEM_DEMO_MODE      2
 #define SETTINGS_MENU_MODES_ITEM_DEBUG_MODE     3
-#define SETTINGS_MENU_MODES_ITEM_SNIFF_MODE     4
-#define SETTINGS_MENU_MODES_ITEM_COUNT          5
+#define SETTINGS_MENU_MODES_ITEM_LISTEN_MODE    4
+#define SETTINGS_MENU_MODES_ITEM_SNIFF_MODE     5
+#define SETTINGS_MENU_MODES_ITEM_PROFILE        6
+#define SETTINGS_MENU_MODES_ITEM_COUNT          7
 
-static const char *st_modesTitles1[] = { "BACK", "Loop", "Demo", "DBug", "Snif" };
-static const char *st_modesTitles2[] = { "BACK", "Mode", "Mode", "Mode", "Mode" };
-static const char  st_modesColors[]  = "bCiNR";
+static const char *st_modesTitles1[] = { "BACK", "Loop", "Demo", "DBug", "Lisn", "Snif", "Prof" };
+static const char *st_modesTitles2[] = { "BACK", "Mode", "Mode", "Mode", "Mode", "Mode", "tImE" };
+static const char  st_modesColors[]  = "bCiNvRO";
+
+bool st_isModesItemHidden(int item);
 
 static struct MenuDataSource st_modesDataSource = {  
-  SETTINGS_MENU_MODES_ITEM_COUNT, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 'V', 0, st_modesTitles1, st_modesTitles2, st_modesColors
+  SETTINGS_MENU_MODES_ITEM_COUNT, NULL, NULL, NULL, NULL, NULL, st_isModesItemHidden, NULL, NULL, 'V', 0, st_modesTitles1, st_modesTitles2, st_modesColors
 };
 
+bool st_isModesItemHidden(int item) {
+  return item == SETTINGS_MENU_MODES_ITEM_PROFILE && !st_dataSource->showProfile;
+}
+
 //------------------------------------------------------
 // Private (menu support)
 //------------------------------------------------------
@@ -245,13 +253,14 @@ reshowHistory:
 
       st_gaugesDataSource.alternateCurrentItem = 0;
       switch (st_gaugesMenu.showMenu(NULL)) {
-        case SETTINGS_MENU_GAUGES_ITEM_BACK:      return true;
+        case SETTINGS_MENU_GAUGES_ITEM_BACK:      st_dataSource->releaseHiddenItems();          return true;
         case SETTINGS_MENU_GAUGES_ITEM_UNITS:     st_dataSource->toggleCurrentItemUnits();      break;
         case SETTINGS_MENU_GAUGES_ITEM_UNITS_SI:  st_dataSource->setAllCurrentItemUnits(false); break;
         case SETTINGS_MENU_GAUGES_ITEM_UNITS_US:  st_dataSource->setAllCurrentItemUnits(true);  break;
         case SETTINGS_MENU_GAUGES_ITEM_HIDE:      st_dataSource->hideCurrentItem();             break;
         case SETTINGS_MENU_GAUGES_ITEM_AUTO_SCAN: st_dataSource->autoScanItems();               break;
-        case SETTINGS_MENU_GAUGES_ITEM_INFO:      st_dataSource->showCurrentItemDetails();      return true;
+        case SETTINGS_MENU_GAUGES_ITEM_INFO:      st_dataSource->releaseHiddenItems();
+                                                  st_dataSource->showCurrentItemDetails();      return true;
         case SETTINGS_MENU_GAUGES_ITEM_SHOW:      
           st_showHiddenMenu.showMenu(NULL);
           if (st_showHiddenDataSource.alternateCurrentItem) {
@@ -259,6 +268,7 @@ reshowHistory:
           }
           break;
       }
+      st_dataSource->releaseHiddenItems();
       break;
 
     case SETTINGS_MENU_ITEM_CODES:
@@ -302,7 +312,9 @@ reshowValues:
         case SETTINGS_MENU_MODES_ITEM_LOOP_MODE:  st_dataSource->toggleLoopMode();  break;
         case SETTINGS_MENU_MODES_ITEM_DEMO_MODE:  st_dataSource->toggleDemoMode();  break;
         case SETTINGS_MENU_MODES_ITEM_DEBUG_MODE: st_dataSource->toggleDebugMode(); break;
+        case SETTINGS_MENU_MODES_ITEM_LISTEN_MODE: st_dataSource->toggleListenMode(); break;
         case SETTINGS_MENU_MODES_ITEM_SNIFF_MODE: st_dataSource->enterSniffMode(0); break;
+        case SETTINGS_MENU_MODES_ITEM_PROFILE:    st_dataSource->showProfile();     return true;
       }
       break;
   }
@@ -37,7 +37,9 @@ struct SettingsDataSource {
   void (*toggleLoopMode)(void);
   void (*toggleDemoMode)(void);
   void (*toggleDebugMode)(void);
+  void (*toggleListenMode)(void);
   void (*enterSniffMode)(int mode);
+  void (*showProfile)(void);           // optional, loop phase timings
 
   bool (*isCurrentItemHidden)(void);
   bool (*isCurrentItemMultiUnit)(void);
@@ -46,6 +48,7 @@ struct SettingsDataSource {
 
   char **(*getHiddenItemTitles)(void); // null terminated list
   char **(*getHiddenItemUnits)(void);  // null terminated list
+  void (*releaseHiddenItems)(void);    // both lists are invalid after this
 };
 
 class VSettings {
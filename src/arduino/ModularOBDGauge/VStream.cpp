@@ -0,0 +1,169 @@
+#include "Environment.h"
+#include "VStream.h"
+
+#include <Arduino.h>
+
+///////////////////////////////////////////////////////////////
+// VSTREAM.CPP
+// Framed binary records over the hardware UART (USB serial)
+///////////////////////////////////////////////////////////////
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+extern void VStream::setup(unsigned long baud) {
+  fillLength = drainLength = drainPos = 0;
+  fillIndex = 0;
+  droppedCount = 0;
+  lastTime = micros();
+  Serial.begin(baud);
+}
+
+// Called as each byte is decoded or sent; never blocks, drops the record if both buffers are busy
+extern void VStream::captureByte(unsigned long time, unsigned char value, unsigned char flags, unsigned long *flips, int flipCount) {
+  int intervalCount = (flips && flipCount > 1) ? flipCount - 1 : 0;
+
+  if (!beginTimedRecord(STREAM_RECORD_BYTE, 2 + intervalCount, time)) return;
+  put(flags);
+  put(value);
+  for (int i=1; i<=intervalCount; i++) {
+    unsigned long ticks = (flips[i] - flips[i-1]) >> 2;
+    put(ticks > 0xff ? 0xff : ticks);
+  }
+  endRecord();
+}
+
+// Called with a raw flip dump outside of bus timing, so waits for room rather than dropping
+extern void VStream::captureFlips(unsigned long *flips, int flipCount) {
+  for (int start=0; start<flipCount; start+=STREAM_FLIPS_PER_RECORD) {
+    int intervalCount = min(STREAM_FLIPS_PER_RECORD, flipCount - 1 - start);
+    if (intervalCount < 0) intervalCount = 0;
+
+    if (!hasRoom(2 + 2*intervalCount + 4 + 8)) flush();
+    if (!beginTimedRecord(STREAM_RECORD_FLIPS, 2*intervalCount, flips[start])) return;
+    for (int i=start+1; i<=start+intervalCount; i++) {
+      unsigned long us = flips[i] - flips[i-1];
+      putWord(us > 0xffff ? 0xffff : us);
+    }
+    endRecord();
+  }
+}
+
+extern void VStream::service() {
+  // Swap buffers once the UART has taken everything from the draining one
+  if (drainPos >= drainLength && fillLength) {
+    fillIndex ^= 1;
+    drainLength = fillLength;
+    drainPos = 0;
+    fillLength = 0;
+  }
+
+  int count = min(Serial.availableForWrite(), STREAM_SERVICE_MAX_BYTES);
+  while (count-- > 0 && drainPos < drainLength) {
+    Serial.write(buffers[fillIndex ^ 1][drainPos++]);
+  }
+}
+
+extern void VStream::drain() {
+  while ((drainPos < drainLength || fillLength) && Serial.availableForWrite() > 0) {
+    service();
+  }
+}
+
+extern void VStream::flush() {
+  while (drainPos < drainLength || fillLength) {
+    service();
+  }
+}
+
+//------------------------------------------------------
+// Public (record building)
+//------------------------------------------------------
+
+extern bool VStream::beginRecord(unsigned char type, int length) {
+  if (!reserve(length + 4)) return false;
+  writeHeader(type, length);
+  return true;
+}
+
+extern bool VStream::beginTimedRecord(unsigned char type, int length, unsigned long time) {
+  unsigned long ticks = ((long)(time - lastTime) > 0) ? (time - lastTime) >> 2 : 0;
+  bool resync = ticks > 0xffff;
+
+  if (!reserve(2 + length + 4 + (resync ? 4 + 4 : 0))) return false;
+
+  if (resync) {
+    writeHeader(STREAM_RECORD_TIME, 4);
+    putLong(time);
+    endRecord();
+    lastTime = time;
+    ticks = 0;
+  }
+
+  // Advance by whole ticks so rounding doesn't accumulate on the host
+  lastTime += ticks << 2;
+
+  writeHeader(type, 2 + length);
+  putWord(ticks);
+  return true;
+}
+
+extern void VStream::put(unsigned char value) {
+  buffers[fillIndex][fillLength++] = value;
+  checksum += value;
+}
+
+extern void VStream::putWord(unsigned int value) {
+  put(value & 0xff);
+  put(value >> 8);
+}
+
+extern void VStream::putLong(unsigned long value) {
+  putWord(value & 0xffff);
+  putWord(value >> 16);
+}
+
+// Records carry IEEE 754 singles; unsigned long is wider than that off the part
+static_assert(sizeof(float) == 4, "stream floats are 4 bytes");
+
+extern void VStream::putFloat(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(float));
+  putLong(bits);
+}
+
+extern void VStream::endRecord() {
+  buffers[fillIndex][fillLength++] = checksum;
+}
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+bool VStream::hasRoom(int size) {
+  // Leave room to report earlier drops ahead of the next record
+  if (droppedCount) size += 2 + 4;
+  return fillLength + size <= STREAM_BUFFER_SIZE;
+}
+
+bool VStream::reserve(int size) {
+  if (!hasRoom(size)) {
+    if (droppedCount < 0xffff) droppedCount++;
+    return false;
+  }
+  if (droppedCount) {
+    writeHeader(STREAM_RECORD_DROPPED, 2);
+    putWord(droppedCount);
+    endRecord();
+    droppedCount = 0;
+  }
+  return true;
+}
+
+void VStream::writeHeader(unsigned char type, int length) {
+  buffers[fillIndex][fillLength++] = STREAM_SYNC;
+  checksum = 0;
+  put(type);
+  put(length);
+}
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////
+// VSTREAM.H
+// Framed binary records over the hardware UART (USB serial)
+///////////////////////////////////////////////////////////////
+
+#include "Environment.h"
+#include "VSerial.h"
+
+#ifndef _VSTREAM
+#define _VSTREAM
+
+// Record layout: SYNC, type, length, payload[length], checksum (8 bit sum of type..payload)
+// Multi-byte fields are little endian.  Times are deltas in 4us ticks (micros() resolution)
+// since the previous timed record; a TIME record resyncs whenever a delta would overflow.
+#define STREAM_SYNC            0xA5
+
+#define STREAM_RECORD_BYTE     0x01  // delta:u16 flags:u8 (SERIAL_CAPTURE_*) value:u8 flipIntervals:u8[] (4us ticks, 0xff = longer)
+#define STREAM_RECORD_FLIPS    0x02  // delta:u16 flipIntervals:u16[] (us, 0xffff = longer)
+#define STREAM_RECORD_TIME     0x03  // micros:u32
+#define STREAM_RECORD_DROPPED  0x04  // count:u16 records lost since the previous DROPPED record
+#define STREAM_RECORD_TELEMETRY 0x10 // delta:u16 sequence:u8 cycleMs:u16 updateMs:u16 requestErrors:u8 totalRequestErrors:u8
+                                     // connectionErrors:u8 protocol:u8 seconds:f32 kilometers:f32 litres:f32
+                                     // sampleCount:u8 { pid:u8 raw:i32 scaled:f32 }[sampleCount]
+
+#define STREAM_MAX_PAYLOAD     60    // Largest record's payload: a 4 sample telemetry record, 2 + 22 + 9*4
+#define STREAM_BUFFER_SIZE     (4 + STREAM_MAX_PAYLOAD + 8 + 6)   // Per buffer; one is filled while the other drains.
+                                                                // The largest record fits behind a TIME and a DROPPED record
+#define STREAM_SERVICE_MAX_BYTES 2   // Bytes handed to the UART per service() call, keeps bus polling jitter low
+#define STREAM_FLIPS_PER_RECORD 16
+
+class VStream {
+  private:
+    unsigned char buffers[2][STREAM_BUFFER_SIZE];
+    unsigned char fillLength;     // bytes in the buffer being filled
+    unsigned char drainLength;    // bytes in the buffer being drained
+    unsigned char drainPos;
+    unsigned char fillIndex;
+    unsigned char checksum;
+    unsigned int  droppedCount;
+    unsigned long lastTime;
+
+    bool hasRoom(int size);
+    bool reserve(int size);
+    void writeHeader(unsigned char type, int length);
+
+  public:
+    void setup(unsigned long baud);
+    void captureByte(unsigned long time, unsigned char value, unsigned char flags, unsigned long *flips, int flipCount);
+    void captureFlips(unsigned long *flips, int flipCount);
+    void service();   // Non-blocking, hands a few bytes to the UART
+    void drain();     // Non-blocking, hands over as much as the UART buffer takes
+    void flush();     // Blocks until everything queued was handed to the UART
+
+    // Building other record types; nothing is written unless begin returns true
+    bool beginRecord(unsigned char type, int length);
+    bool beginTimedRecord(unsigned char type, int length, unsigned long time);  // length excludes the delta
+    void put(unsigned char value);
+    void putWord(unsigned int value);
+    void putLong(unsigned long value);
+    void putFloat(float value);
+    void endRecord();
+};
+
+#endif
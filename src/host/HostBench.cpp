@@ -0,0 +1,139 @@
+#include "Arduino.h"
+#include "HostShim.h"
+#include "HostSketch.h"
+#include "VBench.h"
+#include <time.h>
+
+///////////////////////////////////////////////////////////////
+// HOSTBENCH.CPP
+// Runs the VBench cases on the host with a real clock:
+//
+//   build/bench                      print results
+//   build/bench BASELINE             compare against a baseline
+//   build/bench BASELINE RESULTS     compare two saved runs, e.g.
+//                                    serial captures from the part
+//
+// Each case's time is the fastest of BENCH_HOST_ROUNDS, run in turn
+// with the other cases, so a busy host slows a round rather than a case.
+// Compares exit non-zero when a case is BENCH_REGRESSION_PERCENT
+// and BENCH_REGRESSION_MIN_NS slower than its baseline.
+///////////////////////////////////////////////////////////////
+
+#define BENCH_HOST_ROUNDS        5
+#define BENCH_REGRESSION_PERCENT 100   // A busy host still varies the fastest round by half
+#define BENCH_REGRESSION_MIN_NS  10    // Host cases of a few ns are mostly noise
+#define BENCH_LINE_SIZE          80
+
+struct BenchResult {
+  char name[BENCH_NAME_SIZE];
+  unsigned long ns;
+  unsigned long calls;
+};
+
+extern struct DisplayablesOutputProvider app_displayablesOutputProvider;
+
+static VBench hb_bench;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+static unsigned long hb_realMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+static int hb_runCases(struct BenchResult *results) {
+  // The sketch's own setup, on the virtual clock, wires up the displays and gauge state
+  setup();
+  hb_bench.setup(hb_realMicros, &app_displayablesOutputProvider);
+
+  for (int i=0; i<BENCH_CASE_COUNT; i++) {
+    hb_bench.getCaseName(i, results[i].name);
+    results[i].ns = 0;
+  }
+  for (int round=0; round<BENCH_HOST_ROUNDS; round++) {
+    for (int i=0; i<BENCH_CASE_COUNT; i++) {
+      unsigned long calls;
+      unsigned long ns = hb_bench.runCase(i, &calls);
+      if (!round || ns < results[i].ns) {
+        results[i].ns = ns;
+        results[i].calls = calls;
+      }
+    }
+  }
+  return BENCH_CASE_COUNT;
+}
+
+static int hb_readResults(const char *path, struct BenchResult *results, int maxCount) {
+  FILE *file = fopen(path, "r");
+  char line[BENCH_LINE_SIZE];
+  int count = 0;
+
+  if (!file) {
+    fprintf(stderr, "can't read %s\n", path);
+    return -1;
+  }
+  while (count < maxCount && fgets(line, sizeof(line), file)) {
+    struct BenchResult *result = &results[count];
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%29s %lu %lu", result->name, &result->ns, &result->calls) >= 2) count++;
+  }
+  fclose(file);
+  return count;
+}
+
+static void hb_printResults(struct BenchResult *results, int count) {
+  printf("# VBench %s host, ns per call, fastest of %d rounds\n", BUILD_VERSION, BENCH_HOST_ROUNDS);
+  for (int i=0; i<count; i++) {
+    printf("%s %lu %lu\n", results[i].name, results[i].ns, results[i].calls);
+  }
+}
+
+static bool hb_compare(struct BenchResult *baseline, int baselineCount, struct BenchResult *results, int count) {
+  bool passed = true;
+
+  printf("%-30s %10s %10s %8s\n", "case", "baseline", "ns", "change");
+  for (int i=0; i<count; i++) {
+    struct BenchResult *old = NULL;
+    for (int j=0; j<baselineCount; j++) {
+      if (!strcmp(baseline[j].name, results[i].name)) old = &baseline[j];
+    }
+    if (!old || !old->ns) {
+      printf("%-30s %10s %10lu\n", results[i].name, "-", results[i].ns);
+      continue;
+    }
+
+    long change = ((long)results[i].ns - (long)old->ns) * 100 / (long)old->ns;
+    bool slower = change >= BENCH_REGRESSION_PERCENT && results[i].ns >= old->ns + BENCH_REGRESSION_MIN_NS;
+    printf("%-30s %10lu %10lu %+7ld%%%s\n", results[i].name, old->ns, results[i].ns, change, slower ? "  SLOWER" : "");
+    if (slower) passed = false;
+  }
+  return passed;
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+int main(int argc, char **argv) {
+  struct BenchResult baseline[BENCH_CASE_COUNT * 2];
+  struct BenchResult results[BENCH_CASE_COUNT * 2];
+  int baselineCount = 0;
+  int count;
+
+  if (argc > 1 && (baselineCount = hb_readResults(argv[1], baseline, BENCH_CASE_COUNT * 2)) < 0) return 2;
+
+  if (argc > 2) {
+    if ((count = hb_readResults(argv[2], results, BENCH_CASE_COUNT * 2)) < 0) return 2;
+  } else {
+    count = hb_runCases(results);
+  }
+
+  if (argc < 2) {
+    hb_printResults(results, count);
+    return 0;
+  }
+  return hb_compare(baseline, baselineCount, results, count) ? 0 : 1;
+}
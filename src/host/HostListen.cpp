@@ -0,0 +1,102 @@
+#include "Arduino.h"
+#include "HostShim.h"
+#include "HostSketch.h"
+#include "SimEcu.h"
+#include "VDisplayables.h"
+#include <unistd.h>
+#include <sys/wait.h>
+
+///////////////////////////////////////////////////////////////
+// HOSTLISTEN.CPP
+// Checks that listen mode never transmits: runs the whole sketch
+// against a simulated ECU that nothing else polls, so every gauge
+// misses the listen cache, and fails if the tester drives the
+// K-line at all.
+//
+//   build/listen [profile|all] [seconds per gauge]
+///////////////////////////////////////////////////////////////
+
+#define LISTEN_DEFAULT_SECONDS    10
+#define LISTEN_SIM_SEED           1
+
+// Default profiles, one per init and header style
+static const char *ls_defaultProfiles[] = { "iso9141", "kwpslow", "kwpfast" };
+
+extern VDisplayables vdisplayables;
+
+static SimEcu ls_ecu;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+static void ls_runFor(unsigned long ms) {
+  unsigned long start = hostMicros();
+  while (hostMicros() - start < ms * 1000L) {
+    loop();
+  }
+}
+
+static int ls_runProfile(const struct SimEcuProfile *profile, unsigned long seconds) {
+  hostResetClock();
+  hostEraseEeprom();
+  hostSetPin(HOST_POWER_PIN, HIGH);
+  hostSetAnalog(HOST_POWER_ANALOG_PIN, HOST_BATTERY_ANALOG);
+  ls_ecu.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, profile, LISTEN_SIM_SEED);
+
+  // Connect and scan as usual, so the gauges the ECU has are shown, then listen
+  setup();
+  vdisplayables.toggleMode(DISPLAYABLE_MODE_LISTEN);
+  unsigned long edges = ls_ecu.getStats()->testerEdges;
+
+  int gauges = 0;
+  for (int i=0; i<vdisplayables.getItemCount(); i++) {
+    if (vdisplayables.isItemHidden(i)) continue;
+    vdisplayables.selectItem(i);
+    ls_runFor(seconds * 1000L);
+    gauges++;
+  }
+
+  unsigned long sent = ls_ecu.getStats()->testerEdges - edges;
+  printf("%-12s %3d gauges  %6lu tester edges while listening  %s\n", profile->name, gauges, sent, sent ? "FAIL" : "ok");
+  return sent != 0;
+}
+
+// Sketch state is global, so each profile starts from power-on in its own process
+static int ls_runProfileInChild(const struct SimEcuProfile *profile, unsigned long seconds) {
+  int status;
+
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    int result = ls_runProfile(profile, seconds);
+    fflush(stdout);
+    _exit(result);
+  }
+  if (child < 0 || waitpid(child, &status, 0) < 0) return 1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+int main(int argc, char **argv) {
+  const char *name = (argc > 1) ? argv[1] : "all";
+  unsigned long seconds = (argc > 2) ? strtoul(argv[2], NULL, 10) : LISTEN_DEFAULT_SECONDS;
+  int failed = 0;
+
+  if (strcmp(name, "all")) {
+    const struct SimEcuProfile *profile = SimEcu::findProfile(name);
+    if (!profile) {
+      fprintf(stderr, "unknown profile %s\n", name);
+      return 2;
+    }
+    return ls_runProfile(profile, seconds);
+  }
+
+  for (unsigned int i=0; i<sizeof(ls_defaultProfiles)/sizeof(ls_defaultProfiles[0]); i++) {
+    failed |= ls_runProfileInChild(SimEcu::findProfile(ls_defaultProfiles[i]), seconds);
+  }
+  return failed;
+}
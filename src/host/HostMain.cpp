@@ -0,0 +1,46 @@
+#include "Arduino.h"
+#include "HostShim.h"
+#include "HostSketch.h"
+#include "SimEcu.h"
+
+///////////////////////////////////////////////////////////////
+// HOSTMAIN.CPP
+// Runs the sketch on the virtual clock, e.g. "build/sketch 30"
+// runs 30 simulated seconds.  UART output goes to stdout.  A
+// SimEcu profile name as the second argument puts a simulated
+// ECU on the K-line, e.g. "build/sketch 30 kwpfast".
+///////////////////////////////////////////////////////////////
+
+#define HOST_SIM_SEED         1
+
+static SimEcu hm_ecu;
+
+int main(int argc, char **argv) {
+  unsigned long seconds = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10;
+  const struct SimEcuProfile *profile = NULL;
+
+  if (argc > 2 && !(profile = SimEcu::findProfile(argv[2]))) {
+    fprintf(stderr, "unknown profile %s\n", argv[2]);
+    return 2;
+  }
+  if (profile) hm_ecu.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, profile, HOST_SIM_SEED);
+
+  hostSetPin(HOST_POWER_PIN, HIGH);
+  hostSetAnalog(HOST_POWER_ANALOG_PIN, HOST_BATTERY_ANALOG);
+
+  setup();
+
+  unsigned long loops = 0;
+  while (hostMicros() / 1000000 < seconds) {
+    loop();
+    loops++;
+  }
+
+  fflush(stdout);
+  fprintf(stderr, "%lu loops in %lu.%03lus\n", loops, hostMicros() / 1000000, hostMicros() / 1000 % 1000);
+  if (profile) {
+    struct SimEcuStats *stats = hm_ecu.getStats();
+    fprintf(stderr, "%s: %lu sessions, %lu requests, %lu responses\n", profile->name, stats->sessions, stats->requests, stats->responses);
+  }
+  return 0;
+}
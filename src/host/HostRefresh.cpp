@@ -0,0 +1,265 @@
+#include "Arduino.h"
+#include "HostShim.h"
+#include "HostSketch.h"
+#include "SimEcu.h"
+#include "VDisplayables.h"
+#include "VObd.h"
+#include "VProfile.h"
+#include "VMemory.h"
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+///////////////////////////////////////////////////////////////
+// HOSTREFRESH.CPP
+// End-to-end refresh benchmark: runs the whole sketch against a
+// simulated ECU and reports, per profile:
+//
+//   - time from power-on to the first gauge value
+//   - refresh rate, update time and bus utilization per gauge
+//   - latency from the response's last byte to the end of the
+//     update that displays it
+//   - reconnect time after the ECU drops out
+//   - stack high-water mark, in host frames
+//   - loop phase timings over all gauges, with PROFILE_ENABLED
+//   - response timing histograms per pid, with OBD_STATS_ENABLED
+//
+//   build/refresh [profile|all] [seconds per gauge] [seed]
+///////////////////////////////////////////////////////////////
+
+#define REFRESH_DEFAULT_SECONDS   20
+#define REFRESH_SETTLE_TIMEOUT_MS 60000L    // Gauges without a value by now are reported as such
+#define REFRESH_FIRST_TIMEOUT_MS  180000L
+#define REFRESH_DROPOUT_MS        3000L
+#define REFRESH_SIM_SEED          1
+
+struct RefreshWindow {
+  unsigned long updates;
+  unsigned long updateMillis;     // Sum of telemetry update times
+  unsigned long latencyMicros;    // Sum of response end to update end
+  unsigned long busyMicros;
+  unsigned long errors;
+};
+
+// Default profiles, one per init and header style
+static const char *rf_defaultProfiles[] = { "iso9141", "kwpslow", "kwpfast" };
+
+extern VDisplayables vdisplayables;
+
+static SimEcu rf_ecu;
+static uint8_t rf_lastSequence;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+// One pass of the sketch's loop, true when it ended with a fresh gauge value
+static bool rf_loopOnce(struct RefreshWindow *window) {
+  struct DisplayableTelemetry telemetry;
+
+  loop();
+  vdisplayables.getTelemetry(&telemetry);
+  if (telemetry.sequence == rf_lastSequence) return false;
+  rf_lastSequence = telemetry.sequence;
+
+  if (!telemetry.sampleCount || telemetry.samples[0].raw < 0 || telemetry.requestErrorCount) {
+    if (window) window->errors++;
+    return false;
+  }
+  if (window) {
+    window->updates++;
+    window->updateMillis += telemetry.updateMillis;
+    window->latencyMicros += hostMicros() - rf_ecu.getLastResponseEnd();
+  }
+  return true;
+}
+
+// Runs until a fresh value, returning the virtual time it took or -1
+static long rf_waitForValue(unsigned long timeoutMs) {
+  unsigned long start = hostMicros();
+
+  while (hostMicros() - start < timeoutMs * 1000L) {
+    if (rf_loopOnce(NULL)) return (hostMicros() - start) / 1000;
+  }
+  return -1;
+}
+
+static void rf_measureGauge(int index, unsigned long seconds) {
+  struct RefreshWindow window;
+
+  vdisplayables.selectItem(index);
+  long settleMs = rf_waitForValue(REFRESH_SETTLE_TIMEOUT_MS);
+  if (settleMs < 0) {
+    printf("  %-6s  no value within %lds\n", vdisplayables.getItemName(index), REFRESH_SETTLE_TIMEOUT_MS / 1000);
+    return;
+  }
+
+  memset(&window, 0, sizeof(window));
+  unsigned long busyStart = rf_ecu.getStats()->busyMicros;
+  unsigned long start = hostMicros();
+  while (hostMicros() - start < seconds * 1000000L) {
+    rf_loopOnce(&window);
+  }
+  unsigned long elapsed = hostMicros() - start;
+  window.busyMicros = rf_ecu.getStats()->busyMicros - busyStart;
+
+  printf("  %-6s %6.2f Hz %8.1f ms %8.1f ms %6.1f %% %6lu\n",
+         vdisplayables.getItemName(index),
+         window.updates * 1e6 / elapsed,
+         window.updates ? (double)window.updateMillis / window.updates : 0.0,
+         window.updates ? window.latencyMicros / 1000.0 / window.updates : 0.0,
+         window.busyMicros * 100.0 / elapsed,
+         window.errors);
+}
+
+#if PROFILE_ENABLED
+static void rf_printProfile() {
+  struct ProfilePhase phase;
+  char name[PROFILE_NAME_SIZE];
+
+  printf("  %-6s %9s %11s %11s %11s\n", "phase", "count", "min", "avg", "max");
+  for (int i=0; i<PROFILE_PHASE_COUNT; i++) {
+    VProfile::getPhase(i, &phase);
+    VProfile::getPhaseName(i, name);
+    printf("  %-6s %9u %8.1f ms %8.1f ms %8.1f ms\n", name, phase.count, phase.minMicros / 1000.0, phase.avgMicros / 1000.0, phase.maxMicros / 1000.0);
+  }
+}
+#endif
+
+#if OBD_STATS_ENABLED
+static void rf_printTimingStats(const char *name, struct ObdTimingStats *timing) {
+  uint8_t *histograms[] = { timing->p2, timing->p1, timing->total };
+  const char *labels[] = { "p2", "p1", "all" };
+
+  printf("  %-10s ok %u timeout %u count %u nack %u sid %u pid %u, max p2 %u ms p1 %u ms\n", name,
+         timing->results[OBD_RESULT_OK], timing->results[OBD_RESULT_TIMEOUT], timing->results[OBD_RESULT_COUNT],
+         timing->results[OBD_RESULT_NACK], timing->results[OBD_RESULT_SID], timing->results[OBD_RESULT_PID],
+         timing->maxP2Ms, timing->maxP1Ms);
+  for (int h=0; h<3; h++) {
+    printf("    %-4s", labels[h]);
+    for (int i=0; i<OBD_STATS_BUCKET_COUNT; i++) printf(" %5u", histograms[h][i]);
+    printf("\n");
+  }
+}
+
+static void rf_printObdStats() {
+  struct ObdStats *stats = vdisplayables.getObdStats();
+  char name[16];
+
+  printf("  %-14s", "response ms");
+  for (int i=0; i<OBD_STATS_BUCKET_COUNT; i++) {
+    int bound = VObd::getStatsBucketMs(i);
+    if (bound) printf("  <%-3d", bound);
+    else printf("     +");
+  }
+  printf("\n");
+  for (int i=0; i<OBD_PROTOCOL_LAST; i++) {
+    if (!stats->protocols[i].results[OBD_RESULT_OK]) continue;
+    snprintf(name, sizeof(name), "protocol %d", i + 1);
+    rf_printTimingStats(name, &stats->protocols[i]);
+  }
+  for (int i=0; i<OBD_STATS_PID_SLOTS && stats->pids[i].mode; i++) {
+    snprintf(name, sizeof(name), "%02X %02X", stats->pids[i].mode, stats->pids[i].pid);
+    rf_printTimingStats(name, &stats->pids[i].timing);
+  }
+}
+#endif
+
+static int rf_runProfile(const struct SimEcuProfile *profile, unsigned long seconds, uint32_t seed) {
+  clock_t wallStart = clock();
+
+  hostResetClock();
+  hostEraseEeprom();
+  hostSetPin(HOST_POWER_PIN, HIGH);
+  hostSetAnalog(HOST_POWER_ANALOG_PIN, HOST_BATTERY_ANALOG);
+  rf_ecu.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, profile, seed);
+
+  // Power-on: splash, protocol scan, first connect and the auto scan of supported gauges
+  setup();
+  long firstMs = rf_waitForValue(REFRESH_FIRST_TIMEOUT_MS);
+  printf("%s: ", profile->name);
+  if (firstMs < 0) {
+    printf("no value within %lds of power-on\n", REFRESH_FIRST_TIMEOUT_MS / 1000);
+    return 1;
+  }
+  printf("first value %.1fs after power-on\n", hostMicros() / 1e6);
+
+  printf("  %-6s %9s %11s %11s %8s %6s\n", "gauge", "refresh", "update", "latency", "bus", "errors");
+  int first = -1;
+#if PROFILE_ENABLED
+  VProfile::reset();
+#endif
+#if OBD_STATS_ENABLED
+  vdisplayables.resetObdStats();
+#endif
+  for (int i=0; i<vdisplayables.getItemCount(); i++) {
+    if (vdisplayables.isItemHidden(i)) continue;
+    if (first < 0) first = i;
+    rf_measureGauge(i, seconds);
+    fflush(stdout);
+  }
+#if PROFILE_ENABLED
+  rf_printProfile();
+#endif
+#if OBD_STATS_ENABLED
+  rf_printObdStats();
+#endif
+
+  // Reconnect after the ECU stops answering for a while
+  vdisplayables.selectItem(first);
+  rf_waitForValue(REFRESH_SETTLE_TIMEOUT_MS);
+  unsigned long dropStart = hostMicros();
+  rf_ecu.dropOut(REFRESH_DROPOUT_MS);
+  long reconnectMs = rf_waitForValue(REFRESH_FIRST_TIMEOUT_MS);
+  if (reconnectMs < 0) {
+    printf("  no value within %lds of a %ldms dropout\n", REFRESH_FIRST_TIMEOUT_MS / 1000, REFRESH_DROPOUT_MS);
+  } else {
+    printf("  value %.1fs after a %ldms dropout ended\n", (hostMicros() - dropStart) / 1e6 - REFRESH_DROPOUT_MS / 1000.0, REFRESH_DROPOUT_MS);
+  }
+
+  struct MemoryUsage memory;
+  VMemory::getUsage(&memory);
+  printf("  stack %u bytes at its deepest (host frames)\n", memory.stackBytes);
+  printf("  %.0fs virtual in %.2fs\n", hostMicros() / 1e6, (double)(clock() - wallStart) / CLOCKS_PER_SEC);
+  return reconnectMs < 0;
+}
+
+// Sketch state is global, so each profile starts from power-on in its own process
+static int rf_runProfileInChild(const struct SimEcuProfile *profile, unsigned long seconds, uint32_t seed) {
+  int status;
+
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    int result = rf_runProfile(profile, seconds, seed);
+    fflush(stdout);
+    _exit(result);
+  }
+  if (child < 0 || waitpid(child, &status, 0) < 0) return 1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+int main(int argc, char **argv) {
+  const char *name = (argc > 1) ? argv[1] : "all";
+  unsigned long seconds = (argc > 2) ? strtoul(argv[2], NULL, 10) : REFRESH_DEFAULT_SECONDS;
+  uint32_t seed = (argc > 3) ? strtoul(argv[3], NULL, 10) : REFRESH_SIM_SEED;
+  int failed = 0;
+
+  if (strcmp(name, "all")) {
+    const struct SimEcuProfile *profile = SimEcu::findProfile(name);
+    if (!profile) {
+      fprintf(stderr, "unknown profile %s\n", name);
+      return 2;
+    }
+    return rf_runProfile(profile, seconds, seed);
+  }
+
+  for (unsigned int i=0; i<sizeof(rf_defaultProfiles)/sizeof(rf_defaultProfiles[0]); i++) {
+    failed |= rf_runProfileInChild(SimEcu::findProfile(rf_defaultProfiles[i]), seconds, seed);
+  }
+  return failed;
+}
@@ -0,0 +1,252 @@
+#include "Arduino.h"
+#include "HostShim.h"
+#include "VObd.h"
+#include "HostSketch.h"
+#include "SimEcu.h"
+#include <time.h>
+
+///////////////////////////////////////////////////////////////
+// HOSTSESSIONS.CPP
+// Drives VObd against the simulated ECU, e.g.
+// "build/sessions 1000 all 7" runs 1000 connect/query/disconnect
+// sessions per profile with random seed 7.  Clean profiles also
+// get a keep-alive check: connect with the init's status display
+// delays, then stay idle for several P3 periods on ping() alone.
+// Profiles with a faster baud get a fallback check: sessions
+// switched to it and then dropped must end at both ends, and the
+// gauge must stop asking for it after OBD_HIGH_SPEED_MAX_FAILURES.
+// Profiles that ignore multi-pid requests get a probe check: the
+// gauge must stop sending them after OBD_MULTI_PID_MAX_PROBE_TIMEOUTS.
+///////////////////////////////////////////////////////////////
+
+#define SESSIONS_ROUNDS         4     // requestPids() calls per session
+#define SESSIONS_IDLE_MS        400   // Bus idle between sessions
+#define SESSIONS_MAX_PIDS       OBD_MAX_PIDS_PER_REQUEST
+#define SESSIONS_P3_MARGIN_MS   300   // Keep-alive check shortens the ECU's P3 to QUERY_MAX_INTERVAL plus this
+#define SESSIONS_KEEPALIVE_P3S  3     // P3 periods the keep-alive check idles for
+
+struct SessionsResult {
+  unsigned long sessions;
+  unsigned long connected;
+  unsigned long connectMicros;
+  unsigned long pidsRequested;
+  unsigned long pidsAnswered;
+  unsigned long codeReads;
+};
+
+static VObd ss_obd;
+static SimEcu ss_ecu;
+
+// Shows nothing, but lets VObd spend its status display delays
+static void ss_showString(char *text) {}
+static void ss_showNumber(int num) {}
+static void ss_showSweep(char color, int mode) {}
+static void ss_deferBar(bool deferred) {}
+
+static struct ObdOutputProvider ss_output = {
+  ss_showString, ss_showString, ss_showNumber, ss_showNumber, ss_showSweep, ss_deferBar
+};
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+static void ss_smartDelay(unsigned long ms) {
+  delay(ms);
+}
+
+static int ss_pickProtocol(const struct SimEcuProfile *profile, unsigned long session) {
+  switch (profile->initModes) {
+    case SIM_ECU_INIT_FAST:
+      return OBD_PROTOCOL_KWP_FAST;
+    case SIM_ECU_INIT_SLOW:
+      return OBD_PROTOCOL_KWP_SLOW;   // VObd drops to ISO 9141 on 08 08 / 94 94 key bytes
+  }
+  return (session & 1) ? OBD_PROTOCOL_KWP_FAST : OBD_PROTOCOL_KWP_SLOW;
+}
+
+static void ss_runSession(const struct SimEcuProfile *profile, unsigned long session, struct SessionsResult *result) {
+  unsigned char pids[SESSIONS_MAX_PIDS];
+  long values[SESSIONS_MAX_PIDS];
+  int pidCount = min((int)profile->pidCount, SESSIONS_MAX_PIDS);
+
+  for (int i=0; i<pidCount; i++) pids[i] = profile->pids[i].pid;
+
+  result->sessions++;
+  unsigned long start = hostMicros();
+  ss_obd.connect(ss_pickProtocol(profile, session), false);
+  if (!ss_obd.isConnected()) return;
+  result->connected++;
+  result->connectMicros += hostMicros() - start;
+
+  for (int round=0; round<SESSIONS_ROUNDS; round++) {
+    delay(QUERY_MIN_INTERVAL);
+    result->pidsRequested += pidCount;
+    result->pidsAnswered += ss_obd.requestPids(pids, pidCount, values, 0, true);
+  }
+
+  // Example: 03 -> 43 01 33 04 20 00 00
+  unsigned char codes[] = { 0x03 };
+  unsigned char response[SERIAL_MAX_BYTES];
+  delay(QUERY_MIN_INTERVAL);
+  if (ss_obd.request(codes, sizeof(codes), response, sizeof(response)) > 0) result->codeReads++;
+
+  ss_obd.disconnect();
+}
+
+// The ECU times P3 from the end of the init, so the keep-alive clock must
+// too; started after the status display, ping() comes too late for an ECU
+// with little P3 to spare
+static bool ss_checkKeepAlive(const struct SimEcuProfile *profile) {
+  struct SimEcuProfile *simProfile = ss_ecu.getProfile();
+  unsigned long p3MaxMs = simProfile->p3MaxMs;
+  unsigned char pids[1] = { profile->pids[0].pid };
+  long values[1];
+  bool alive = false;
+
+  delay(profile->p3MaxMs + SESSIONS_IDLE_MS);
+  simProfile->p3MaxMs = QUERY_MAX_INTERVAL + SESSIONS_P3_MARGIN_MS;
+
+  ss_obd.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, ss_smartDelay, &ss_output);
+  ss_obd.connect(ss_pickProtocol(profile, 0), false);
+  if (ss_obd.isConnected()) {
+    // The ECU notices the last session's timeout on the bus, so count from here
+    unsigned long timeouts = ss_ecu.getStats()->timeouts;
+    unsigned long start = hostMicros();
+    while (hostMicros() - start < SESSIONS_KEEPALIVE_P3S * simProfile->p3MaxMs * 1000L) {
+      delay(10);
+      ss_obd.ping();
+    }
+    alive = ss_ecu.getStats()->timeouts == timeouts && ss_obd.requestPids(pids, 1, values, 0, true) == 1;
+    ss_obd.disconnect();
+  }
+
+  ss_obd.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, ss_smartDelay, NULL);
+  simProfile->p3MaxMs = p3MaxMs;
+  return alive;
+}
+
+// Each connect asks for the faster baud and each missed reply ends the
+// session; the ECU misses the StopCommunication every other time, so then
+// keeps the faster baud until its P3 runs out.  After that the gauge
+// stays at the default baud.
+static bool ss_checkHighSpeed(const struct SimEcuProfile *profile) {
+  unsigned char pids[1] = { profile->pids[0].pid };
+  long values[1];
+  bool passed = true;
+
+  ss_obd.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, ss_smartDelay, NULL);
+  for (int drop=1; drop<=OBD_HIGH_SPEED_MAX_FAILURES; drop++) {
+    delay(profile->p3MaxMs + SESSIONS_IDLE_MS);
+    ss_obd.connect(ss_pickProtocol(profile, 0), false);
+    passed = passed && ss_obd.isConnected() && ss_ecu.getBaud() == profile->highSpeedBaud;
+    delay(QUERY_MIN_INTERVAL);
+    passed = passed && ss_obd.requestPids(pids, 1, values, 0, true) == 1;
+
+    ss_ecu.ignoreRequests((drop & 1) ? 1 : 2);
+    delay(QUERY_MIN_INTERVAL);
+    ss_obd.requestPids(pids, 1, values, 0, true);
+    passed = passed && !ss_obd.isConnected();
+    if (drop & 1) passed = passed && !ss_ecu.isInSession() && ss_ecu.getBaud() == profile->baud;
+  }
+
+  delay(profile->p3MaxMs + SESSIONS_IDLE_MS);
+  ss_obd.connect(ss_pickProtocol(profile, 0), false);
+  passed = passed && ss_obd.isConnected() && ss_ecu.getBaud() == profile->baud;
+  delay(QUERY_MIN_INTERVAL);
+  passed = passed && ss_obd.requestPids(pids, 1, values, 0, true) == 1;
+  ss_obd.disconnect();
+  return passed;
+}
+
+// Every round must get all its values by single requests, and only the
+// first few may probe with a multi-pid request
+static bool ss_checkMultiPidProbe(const struct SimEcuProfile *profile) {
+  unsigned char pids[SESSIONS_MAX_PIDS];
+  long values[SESSIONS_MAX_PIDS];
+  int pidCount = min((int)profile->pidCount, SESSIONS_MAX_PIDS);
+  bool passed = true;
+
+  for (int i=0; i<pidCount; i++) pids[i] = profile->pids[i].pid;
+
+  delay(profile->p3MaxMs + SESSIONS_IDLE_MS);
+  unsigned long ignored = ss_ecu.getStats()->multiPidIgnored;
+  ss_obd.connect(ss_pickProtocol(profile, 0), false);
+  passed = ss_obd.isConnected();
+  for (int round=0; round<OBD_MULTI_PID_MAX_PROBE_TIMEOUTS + SESSIONS_ROUNDS && passed; round++) {
+    delay(QUERY_MIN_INTERVAL);
+    passed = ss_obd.requestPids(pids, pidCount, values, 0, true) == pidCount;
+  }
+  ss_obd.disconnect();
+  return passed && ss_ecu.getStats()->multiPidIgnored - ignored == OBD_MULTI_PID_MAX_PROBE_TIMEOUTS;
+}
+
+static bool ss_runProfile(const struct SimEcuProfile *profile, unsigned long count, uint32_t seed) {
+  struct SessionsResult result;
+  memset(&result, 0, sizeof(result));
+
+  ss_ecu.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, profile, seed);
+  ss_obd.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, ss_smartDelay, NULL);
+  ss_obd.setHighSpeedBaud(profile->highSpeedBaud);
+  unsigned long virtualStart = hostMicros();
+  clock_t wallStart = clock();
+
+  for (unsigned long i=0; i<count; i++) {
+    ss_runSession(profile, i, &result);
+
+    // Let the ECU's P3 timer lapse so each session starts with a fresh init
+    delay(profile->p3MaxMs + SESSIONS_IDLE_MS);
+  }
+
+  double wallSeconds = (double)(clock() - wallStart) / CLOCKS_PER_SEC;
+  double virtualSeconds = (hostMicros() - virtualStart) / 1e6;
+  struct SimEcuStats stats = *ss_ecu.getStats();
+
+  // Faults would end the idle session regardless, so only clean profiles are checked
+  bool faulty = profile->nackPercent || profile->dropPercent || profile->noisePercent || profile->glitchesPerSecond;
+  bool keptAlive = faulty || ss_checkKeepAlive(profile);
+  bool fellBack = !profile->highSpeedBaud || ss_checkHighSpeed(profile);
+  bool probed = !profile->singlePidOnly || ss_checkMultiPidProbe(profile);
+  ss_ecu.stop();
+
+  printf("%-12s %5lu/%-5lu connected  %6.1fms connect  %6lu/%-6lu pids  %5lu dtc  "
+         "%4lu nack %4lu drop %4lu noise %4lu bad  %-5s keep-alive  %-5s high speed  %-5s multi-pid  %7.0fs virtual in %.2fs\n",
+         profile->name, result.connected, result.sessions,
+         result.connected ? result.connectMicros / 1000.0 / result.connected : 0.0,
+         result.pidsAnswered, result.pidsRequested, result.codeReads,
+         stats.nacks, stats.dropped, stats.corruptedBytes, stats.badFrames,
+         faulty ? "-" : keptAlive ? "ok" : "FAIL",
+         !profile->highSpeedBaud ? "-" : fellBack ? "ok" : "FAIL",
+         !profile->singlePidOnly ? "-" : probed ? "ok" : "FAIL", virtualSeconds, wallSeconds);
+
+  // Clean profiles must always work; faulty ones only need to mostly work
+  if (faulty) return result.connected * 2 >= result.sessions;
+  return result.connected == result.sessions && result.pidsAnswered == result.pidsRequested && keptAlive && fellBack && probed;
+}
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+int main(int argc, char **argv) {
+  unsigned long count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100;
+  const char *name = (argc > 2) ? argv[2] : "all";
+  uint32_t seed = (argc > 3) ? strtoul(argv[3], NULL, 10) : 1;
+  bool passed = true;
+
+  ss_obd.setup(HOST_OBD_IN_PIN, HOST_OBD_OUT_PIN, ss_smartDelay, NULL);
+
+  if (strcmp(name, "all")) {
+    const struct SimEcuProfile *profile = SimEcu::findProfile(name);
+    if (!profile) {
+      fprintf(stderr, "unknown profile %s\n", name);
+      return 2;
+    }
+    passed = ss_runProfile(profile, count, seed);
+  } else {
+    for (int i=0; SimEcu::profileAt(i); i++) {
+      passed = ss_runProfile(SimEcu::profileAt(i), count, seed) && passed;
+    }
+  }
+  return passed ? 0 : 1;
+}
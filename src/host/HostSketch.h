@@ -0,0 +1,20 @@
+///////////////////////////////////////////////////////////////
+// HOSTSKETCH.H
+// The sketch's entry points and wiring, for host drivers that
+// run the whole sketch
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOSTSKETCH
+#define _HOSTSKETCH
+
+// Match the pin defines in ModularOBDGauge.ino
+#define HOST_POWER_PIN        7
+#define HOST_POWER_ANALOG_PIN A0
+#define HOST_BATTERY_ANALOG   733   // About 12V through the REV 3 divider
+#define HOST_OBD_IN_PIN       4
+#define HOST_OBD_OUT_PIN      3
+
+void setup();
+void loop();
+
+#endif
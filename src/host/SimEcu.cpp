@@ -0,0 +1,720 @@
+#include "Arduino.h"
+#include "SimEcu.h"
+
+///////////////////////////////////////////////////////////////
+// SIMECU.CPP
+// Simulated K-line ECU for the host build
+///////////////////////////////////////////////////////////////
+
+#define SIM_STATE_IDLE               0
+#define SIM_STATE_WAIT_INVERTED_KEY  1
+#define SIM_STATE_SESSION            2
+
+#define SIM_WAKE_UP_MIN_US      20000L    // Fast init pulls the line low for 25ms
+#define SIM_WAKE_UP_MAX_US      40000L
+#define SIM_SLOW_START_MIN_US   150000L   // 5 baud start bit is 200ms
+#define SIM_INVERTED_KEY_TIMEOUT_US 300000L
+#define SIM_ISO_FRAME_GAP_US    12000L    // ISO 9141 requests have no length; tester bytes come every ~7ms
+#define SIM_FRAME_TIMEOUT_US    60000L    // Partial KWP frame is dropped after this
+
+#define SIM_TIME_AFTER(a, b) ((long)((a) - (b)) >= 0)
+
+#define SIM_PID_RPM(min, max, period)    { 0x0C, 2, (min)*4, (max)*4, period }
+
+static const struct SimEcuProfile sim_profiles[] = {
+  // name          init                                      kb1   kb2   addr  2nd   baud   high speed
+  //   w1                  w2              w3             w4               p1           p2               p3    nack drop noise glitch
+  { "iso9141",     SIM_ECU_INIT_SLOW,                        0x08, 0x08, 0x10, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {500, 2000}, {25000, 40000}, 5000, 0, 0, 0, 0,
+      10, {
+        { 0x04, 1, 20, 200, 7000 },          // load
+        { 0x05, 1, 40+40, 40+95, 60000 },     // coolant
+        { 0x0B, 1, 30, 100, 5000 },          // MAP
+        SIM_PID_RPM(800, 4500, 8000),
+        { 0x0D, 1, 0, 120, 20000 },          // speed
+        { 0x0F, 1, 40+20, 40+45, 90000 },    // intake
+        { 0x10, 2, 200, 4000, 8000 },        // MAF
+        { 0x11, 1, 30, 200, 6000 },          // throttle
+        { 0x2F, 1, 180, 160, 600000 },       // fuel level
+        { 0x42, 2, 13800, 14400, 30000 },    // module volts
+      },
+      2, { 0x0133, 0x0420 } },
+  { "iso9141-94",  SIM_ECU_INIT_SLOW,                        0x94, 0x94, 0x10, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      4, {
+        SIM_PID_RPM(700, 6000, 6000),
+        { 0x0D, 1, 0, 160, 15000 },
+        { 0x05, 1, 40+60, 40+90, 60000 },
+        { 0x11, 1, 30, 250, 4000 },
+      },
+      0, {} },
+  { "kwpslow",     SIM_ECU_INIT_SLOW,                        0x8F, 0xE9, 0x10, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 2000}, {25000, 40000}, 5000, 0, 0, 0, 0,
+      6, {
+        SIM_PID_RPM(800, 5000, 7000),
+        { 0x0D, 1, 0, 130, 20000 },
+        { 0x05, 1, 40+50, 40+92, 60000 },
+        { 0x10, 2, 200, 5000, 7000 },
+        { 0x11, 1, 30, 220, 5000 },
+        { 0x5E, 2, 20, 400, 7000 },          // fuel rate
+      },
+      1, { 0x0301 } },
+  { "kwpfast",     SIM_ECU_INIT_FAST,                        0x8F, 0x6B, 0x10, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      8, {
+        SIM_PID_RPM(800, 6500, 5000),
+        { 0x0D, 1, 0, 180, 15000 },
+        { 0x05, 1, 40+50, 40+95, 60000 },
+        { 0x0B, 1, 30, 200, 5000 },
+        { 0x0F, 1, 40+15, 40+50, 90000 },
+        { 0x11, 1, 30, 255, 3000 },
+        { 0x10, 2, 200, 6000, 5000 },
+        { 0x5E, 2, 20, 600, 5000 },
+      },
+      0, {} },
+  { "kwpboth",     SIM_ECU_INIT_SLOW | SIM_ECU_INIT_FAST,    0x8F, 0xEF, 0x11, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      3, {
+        SIM_PID_RPM(900, 4000, 9000),
+        { 0x0D, 1, 0, 100, 25000 },
+        { 0x05, 1, 40+70, 40+90, 60000 },
+      },
+      0, {} },
+  { "multi",       SIM_ECU_INIT_FAST,                        0x8F, 0x6B, 0x10, 0x18, 10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      3, {
+        SIM_PID_RPM(800, 5500, 6000),
+        { 0x0D, 1, 0, 140, 18000 },
+        { 0x05, 1, 40+60, 40+90, 60000 },
+      },
+      0, {} },
+  { "multitcm",    SIM_ECU_INIT_FAST,                        0x8F, 0x6B, 0x10, 0x18, 10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      3, {
+        SIM_PID_RPM(800, 5500, 6000),
+        { 0x0D, 1, 0, 140, 18000 },
+        { 0x05, 1, 40+60, 40+90, 60000 },
+      },
+      0, {}, false, true },
+  { "kwphispeed",  SIM_ECU_INIT_FAST,                        0x8F, 0x6B, 0x10, 0,    10400, 19200,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      4, {
+        SIM_PID_RPM(800, 6500, 5000),
+        { 0x0D, 1, 0, 180, 15000 },
+        { 0x05, 1, 40+50, 40+95, 60000 },
+        { 0x11, 1, 30, 255, 3000 },
+      },
+      0, {} },
+  { "kwp1pid",     SIM_ECU_INIT_FAST,                        0x8F, 0x6B, 0x10, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {0, 1000}, {25000, 35000}, 5000, 0, 0, 0, 0,
+      4, {
+        SIM_PID_RPM(800, 6000, 6000),
+        { 0x0D, 1, 0, 160, 15000 },
+        { 0x05, 1, 40+55, 40+95, 60000 },
+        { 0x11, 1, 30, 240, 4000 },
+      },
+      0, {}, true },
+  { "noisy",       SIM_ECU_INIT_SLOW,                        0x08, 0x08, 0x10, 0,    10400, 0,
+      {60000, 300000}, {5000, 20000}, {0, 20000}, {25000, 50000}, {500, 5000}, {25000, 48000}, 5000, 5, 5, 1, 2,
+      4, {
+        SIM_PID_RPM(800, 4500, 8000),
+        { 0x0D, 1, 0, 120, 20000 },
+        { 0x05, 1, 40+40, 40+95, 60000 },
+        { 0x11, 1, 30, 200, 6000 },
+      },
+      1, { 0x0171 } },
+};
+
+#define SIM_PROFILE_COUNT (sizeof(sim_profiles) / sizeof(sim_profiles[0]))
+
+// KWP StartDiagnosticSession baud rate identifiers 01-05
+static const unsigned long sim_baudIds[] = { 0, 9600, 19200, 38400, 57600, 115200 };
+
+static SimEcu *sim_active = NULL;
+
+static int sim_readPin(int pin, unsigned long micros) {
+  return sim_active ? sim_active->readPin(pin, micros) : -1;
+}
+
+static void sim_writePin(int pin, int value, unsigned long micros) {
+  if (sim_active) sim_active->writePin(pin, value, micros);
+}
+
+static struct HostPinProvider sim_pinProvider = {
+  sim_readPin,
+  sim_writePin,
+};
+
+//------------------------------------------------------
+// Public
+//------------------------------------------------------
+
+void SimEcu::setup(int in, int out, const struct SimEcuProfile *initialProfile, uint32_t seed) {
+  profile = *initialProfile;
+  memset(&stats, 0, sizeof(stats));
+  inPin = in;
+  outPin = out;
+  randomState = seed ? seed : 1;
+  startMicros = hostMicros();
+
+  testerLevel = HIGH;
+  testerLowStart = 0;
+  byteActive = false;
+  edgeCount = 0;
+  wakeUpSeen = false;
+  frameLength = 0;
+
+  state = SIM_STATE_IDLE;
+  kwpHeaders = false;
+  queueHead = queueCount = 0;
+  nextGlitch = glitchEnd = startMicros;
+  silentUntil = startMicros;
+  lastResponseEnd = startMicros;
+  baud = profile.baud;
+  nextBaud = 0;
+  ignoreCount = 0;
+
+  sim_active = this;
+  hostSetPinProvider(&sim_pinProvider);
+}
+
+void SimEcu::stop() {
+  if (sim_active == this) {
+    hostSetPinProvider(NULL);
+    sim_active = NULL;
+  }
+}
+
+struct SimEcuProfile *SimEcu::getProfile() {
+  return &profile;
+}
+
+struct SimEcuStats *SimEcu::getStats() {
+  return &stats;
+}
+
+bool SimEcu::isInSession() {
+  return state == SIM_STATE_SESSION;
+}
+
+unsigned long SimEcu::getLastResponseEnd() {
+  return lastResponseEnd;
+}
+
+unsigned long SimEcu::getBaud() {
+  return baud;
+}
+
+void SimEcu::dropOut(unsigned long ms) {
+  silentUntil = hostMicros() + ms * 1000L;
+  state = SIM_STATE_IDLE;
+  baud = profile.baud;
+  queueCount = 0;
+}
+
+void SimEcu::ignoreRequests(int count) {
+  ignoreCount = count;
+}
+
+int SimEcu::readPin(int pin, unsigned long now) {
+  advance(now);
+  if (pin != inPin) return -1;
+
+  // Open collector bus: either side can pull it low
+  return (testerLevel && ecuLevelAt(now)) ? HIGH : LOW;
+}
+
+void SimEcu::writePin(int pin, int value, unsigned long now) {
+  advance(now);
+  if (pin == outPin && value != testerLevel) {
+    stats.testerEdges++;
+    onTesterEdge(value, now);
+  }
+}
+
+const struct SimEcuProfile *SimEcu::findProfile(const char *name) {
+  for (unsigned int i=0; i<SIM_PROFILE_COUNT; i++) {
+    if (!strcmp(name, sim_profiles[i].name)) return &sim_profiles[i];
+  }
+  return NULL;
+}
+
+const struct SimEcuProfile *SimEcu::profileAt(int index) {
+  return (index >= 0 && index < (int)SIM_PROFILE_COUNT) ? &sim_profiles[index] : NULL;
+}
+
+//------------------------------------------------------
+// Private (tester side)
+//------------------------------------------------------
+
+void SimEcu::advance(unsigned long now) {
+  // A byte ends once its stop bit has been sampled, unless the line is still
+  // held low from the start bit (wake-up pattern or 5 baud address)
+  if (byteActive && SIM_TIME_AFTER(now, byteStart + byteBitUs * 19 / 2)) {
+    if (!(testerLevel == LOW && edgeCount == 1)) finishByte(now);
+  }
+
+  if (frameLength && !kwpHeaders && !wakeUpSeen && SIM_TIME_AFTER(now, frameLastByteEnd + SIM_ISO_FRAME_GAP_US)) {
+    handleFrame(frameLastByteEnd);
+  }
+  if (frameLength && SIM_TIME_AFTER(now, frameLastByteEnd + SIM_FRAME_TIMEOUT_US)) {
+    stats.badFrames++;
+    frameLength = 0;
+  }
+
+  if (state == SIM_STATE_WAIT_INVERTED_KEY && SIM_TIME_AFTER(now, expectDeadline)) {
+    state = SIM_STATE_IDLE;
+  }
+  if (state == SIM_STATE_SESSION && SIM_TIME_AFTER(now, lastRequestMicros + profile.p3MaxMs * 1000L)) {
+    state = SIM_STATE_IDLE;
+    baud = profile.baud;
+    stats.timeouts++;
+  }
+}
+
+void SimEcu::onTesterEdge(int level, unsigned long now) {
+  if (level == LOW) {
+    testerLowStart = now;
+    if (!byteActive) {
+      byteActive = true;
+      byteStart = now;
+      byteBitUs = 1000000L / baud;
+      edgeCount = 0;
+    }
+  } else if (byteActive && edgeCount == 1) {
+    // First rising edge tells a long low pulse from an ordinary start bit
+    unsigned long low = now - testerLowStart;
+    if (low >= SIM_WAKE_UP_MIN_US && low <= SIM_WAKE_UP_MAX_US) {
+      // A new init, whatever the last session's baud
+      byteActive = false;
+      wakeUpSeen = true;
+      baud = profile.baud;
+      frameLength = 0;
+      testerLevel = level;
+      return;
+    }
+    if (low >= SIM_SLOW_START_MIN_US) {
+      byteBitUs = 200000L;
+    }
+  }
+
+  if (byteActive && edgeCount < SIM_ECU_MAX_EDGES) edges[edgeCount++] = now;
+  testerLevel = level;
+}
+
+int SimEcu::testerLevelAt(unsigned long time) {
+  int passed = 0;
+  while (passed < edgeCount && !SIM_TIME_AFTER(edges[passed], time + 1)) passed++;
+  return (passed & 1) ? LOW : HIGH;
+}
+
+void SimEcu::finishByte(unsigned long now) {
+  uint8_t value = 0;
+  for (int i=0; i<8; i++) {
+    if (testerLevelAt(byteStart + byteBitUs * (2*i + 3) / 2)) value |= (1 << i);
+  }
+  bool framed = testerLevelAt(byteStart + byteBitUs * 19 / 2);
+  bool slow = byteBitUs > 100000L;
+  unsigned long end = byteStart + byteBitUs * 10;
+
+  byteActive = false;
+  if (!framed) return;
+  if (!slow) stats.busyMicros += byteBitUs * 10;
+  onTesterByte(value, end, slow);
+}
+
+void SimEcu::onTesterByte(uint8_t value, unsigned long end, bool slow) {
+  bool silent = !SIM_TIME_AFTER(end, silentUntil);
+
+  if (slow) {
+    if (value != 0x33 || !(profile.initModes & SIM_ECU_INIT_SLOW) || silent) return;
+
+    // Sync byte and key bytes at the default baud
+    uint8_t sync[] = { 0x55, profile.keyByte1, profile.keyByte2 };
+    stats.slowInits++;
+    wakeUpSeen = false;
+    baud = profile.baud;
+    frameLength = 0;
+    queueCount = 0;
+    unsigned long start = end + pickMicros(&profile.w1);
+    unsigned long bitUs = 1000000L / baud;
+    for (int i=0; i<3; i++) {
+      queue[(queueHead + queueCount++) % SIM_ECU_MAX_QUEUED] = { start, bitUs, sync[i] };
+      stats.busyMicros += bitUs * 10;
+      start += bitUs * 10 + pickMicros(i ? &profile.w3 : &profile.w2);
+    }
+    kwpHeaders = (profile.keyByte1 != profile.keyByte2);
+    state = SIM_STATE_WAIT_INVERTED_KEY;
+    expectDeadline = queueEnd() + SIM_INVERTED_KEY_TIMEOUT_US;
+    return;
+  }
+
+  if (state == SIM_STATE_WAIT_INVERTED_KEY) {
+    if (value == (uint8_t)~profile.keyByte2) {
+      uint8_t inverted = ~0x33;
+      queueBytes(&inverted, 1, end + pickMicros(&profile.w4), false);
+      state = SIM_STATE_SESSION;
+      lastRequestMicros = end;
+      stats.sessions++;
+    } else {
+      state = SIM_STATE_IDLE;
+    }
+    return;
+  }
+
+  // Bytes too far apart belong to different frames
+  if (frameLength && SIM_TIME_AFTER(end, frameLastByteEnd + SIM_ISO_FRAME_GAP_US + byteBitUs * 10)) {
+    if (kwpHeaders || wakeUpSeen) stats.badFrames++; else handleFrame(frameLastByteEnd);
+    frameLength = 0;
+  }
+  if (frameLength >= SIM_ECU_MAX_BYTES) {
+    stats.badFrames++;
+    frameLength = 0;
+  }
+  frame[frameLength++] = value;
+  frameLastByteEnd = end;
+
+  if ((kwpHeaders || wakeUpSeen) && frameComplete(end)) handleFrame(end);
+}
+
+// KWP frames carry their length in the header
+bool SimEcu::frameComplete(unsigned long now) {
+  uint8_t format = frame[0];
+  int headerSize = (format & 0xC0) ? 3 : 1;
+  int dataLength = format & 0x3f;
+
+  if (!dataLength) {
+    headerSize++;
+    if (frameLength < headerSize) return false;
+    dataLength = frame[headerSize - 1];
+  }
+  return frameLength >= headerSize + dataLength + 1;
+}
+
+//------------------------------------------------------
+// Private (ECU side)
+//------------------------------------------------------
+
+void SimEcu::handleFrame(unsigned long end) {
+  uint8_t response[SIM_ECU_MAX_BYTES];
+  uint8_t sum = 0;
+  int length = frameLength;
+  bool kwp = kwpHeaders || wakeUpSeen;
+  frameLength = 0;
+
+  for (int i=0; i<length-1; i++) sum += frame[i];
+  if (length < 3 || sum != frame[length-1]) {
+    stats.badFrames++;
+    return;
+  }
+  if (!SIM_TIME_AFTER(end, silentUntil)) return;
+
+  // Locate data and target; ISO 9141 requests are always functional
+  int headerSize = 3;
+  bool oneByteHeader = false;
+  bool functional = true;
+  uint8_t target = 0x33;
+
+  if (kwp) {
+    uint8_t format = frame[0];
+    oneByteHeader = !(format & 0xC0);
+    headerSize = oneByteHeader ? 1 : 3;
+    if (!(format & 0x3f)) headerSize++;
+    if (!oneByteHeader) {
+      target = frame[1];
+      functional = (format & 0xC0) == 0xC0;
+    }
+  } else if (frame[0] != 0x68 || frame[1] != 0x6A) {
+    stats.badFrames++;
+    return;
+  }
+
+  uint8_t *data = frame + headerSize;
+  int dataLength = length - headerSize - 1;
+  if (dataLength < 1) {
+    stats.badFrames++;
+    return;
+  }
+
+  // Fast init StartCommunication, e.g. C1 33 F1 81 66 -> 83 F1 10 C1 8F 6B CS
+  if (wakeUpSeen) {
+    wakeUpSeen = false;
+    if (data[0] != 0x81 || !(profile.initModes & SIM_ECU_INIT_FAST)) return;
+    stats.fastInits++;
+    stats.sessions++;
+    state = SIM_STATE_SESSION;
+    kwpHeaders = true;
+    lastRequestMicros = end;
+    response[0] = 0xC1;
+    response[1] = profile.keyByte1;
+    response[2] = profile.keyByte2;
+    sendFrame(response, 3, profile.address, false, end + pickMicros(&profile.p2));
+    return;
+  }
+
+  if (state != SIM_STATE_SESSION) return;
+
+  bool primary = functional ? (target == 0x33) : (target == profile.address);
+  bool second = profile.secondAddress && (functional ? (target == 0x33) : (target == profile.secondAddress));
+  if (!primary && !second) return;
+
+  stats.requests++;
+  lastRequestMicros = end;
+
+  if (ignoreCount || chance(profile.dropPercent)) {
+    if (ignoreCount) ignoreCount--;
+    stats.dropped++;
+    return;
+  }
+
+  unsigned long start = end + pickMicros(&profile.p2);
+  bool secondFirst = second && !oneByteHeader && profile.secondAnswersFirst;
+  if (secondFirst) {
+    int count = buildResponse(data, dataLength, response, true);
+    if (count > 0) {
+      sendFrame(response, count, profile.secondAddress, false, start);
+      start = queueEnd() + pickMicros(&profile.p1);
+    }
+  }
+  if (primary) {
+    int count;
+    if (chance(profile.nackPercent)) {
+      response[0] = 0x7F;
+      response[1] = data[0];
+      response[2] = SIM_ECU_NRC_CONDITIONS_NOT_CORRECT;
+      count = 3;
+      stats.nacks++;
+    } else {
+      count = buildResponse(data, dataLength, response, false);
+    }
+    if (count > 0) {
+      sendFrame(response, count, profile.address, oneByteHeader, start);
+      start = queueEnd() + pickMicros(&profile.p1);
+    }
+
+    // A baud change applies from the next frame either way
+    if (nextBaud) {
+      baud = nextBaud;
+      nextBaud = 0;
+    }
+  }
+  if (second && !oneByteHeader && !secondFirst) {
+    int count = buildResponse(data, dataLength, response, true);
+    if (count > 0) sendFrame(response, count, profile.secondAddress, false, start);
+  }
+}
+
+// Returns the response data length, 0 for no response
+int SimEcu::buildResponse(uint8_t *request, int length, uint8_t *response, bool second) {
+  unsigned long now = hostMicros();
+  uint8_t sid = request[0];
+  int count = 0;
+
+  switch (sid) {
+    case 0x01:
+      // One or more pids; unsupported ones are left out, none at all gets no response
+      if (profile.singlePidOnly && length > 2) {
+        if (!second) stats.multiPidIgnored++;
+        return 0;
+      }
+      response[count++] = 0x41;
+      for (int i=1; i<length; i++) {
+        uint8_t pid = request[i];
+
+        if ((pid & 0x1F) == 0) {
+          // Supported pid bitmap for pid+1..pid+32, with the last bit flagging further ranges
+          uint32_t mask = 0;
+          if (second) {
+            if (pid == 0) mask = 0x10080000UL;   // Load and speed, like a transmission controller
+          } else {
+            for (int p=0; p<profile.pidCount; p++) {
+              int offset = profile.pids[p].pid - pid - 1;
+              if (offset >= 0 && offset < 32) mask |= 0x80000000UL >> offset;
+              if (offset >= 32) mask |= 1;
+            }
+          }
+          if (!mask && pid) continue;
+          response[count++] = pid;
+          for (int b=3; b>=0; b--) response[count++] = mask >> (8*b);
+          continue;
+        }
+        if (second && pid != 0x0D) continue;
+
+        for (int p=0; p<profile.pidCount; p++) {
+          struct SimEcuPid *entry = &profile.pids[p];
+          if (entry->pid != pid) continue;
+          unsigned long value = pidValue(entry, now);
+          response[count++] = pid;
+          for (int b=entry->length-1; b>=0; b--) response[count++] = value >> (8*b);
+          break;
+        }
+      }
+      return count > 1 ? count : 0;
+
+    case 0x03:
+      // Stored codes, three per frame padded with zeros
+      if (second) return 0;
+      response[count++] = 0x43;
+      for (int i=0; i<3; i++) {
+        uint16_t dtc = (i < profile.dtcCount) ? profile.dtcs[i] : 0;
+        response[count++] = dtc >> 8;
+        response[count++] = dtc & 0xff;
+      }
+      return count;
+
+    case 0x04:
+      if (second) return 0;
+      profile.dtcCount = 0;
+      response[count++] = 0x44;
+      return count;
+
+    case 0x10:
+      // StartDiagnosticSession, e.g. 10 81 02 -> 50 81 then 19200 baud if the
+      // profile has it; a baud identifier for any other rate is refused
+      if (second) return 0;
+      if (length > 2 && (!profile.highSpeedBaud || request[2] < 1 || request[2] > 5 || sim_baudIds[request[2]] != profile.highSpeedBaud)) {
+        response[count++] = 0x7F;
+        response[count++] = sid;
+        response[count++] = SIM_ECU_NRC_SUBFUNCTION_NOT_SUPPORTED;
+        return count;
+      }
+      if (length > 2) nextBaud = profile.highSpeedBaud;
+      response[count++] = 0x50;
+      if (length > 1) response[count++] = request[1];
+      return count;
+
+    case 0x3E:
+      // TesterPresent, 3E 02 asks for no response
+      if (second || (length > 1 && request[1] == 0x02)) return 0;
+      response[count++] = 0x7E;
+      return count;
+
+    case 0x82:
+      // StopCommunication, answered at the session's baud
+      if (second) return 0;
+      state = SIM_STATE_IDLE;
+      nextBaud = profile.baud;
+      response[count++] = 0xC2;
+      return count;
+  }
+
+  if (second) return 0;
+  response[count++] = 0x7F;
+  response[count++] = sid;
+  response[count++] = SIM_ECU_NRC_SERVICE_NOT_SUPPORTED;
+  return count;
+}
+
+void SimEcu::sendFrame(uint8_t *data, int length, uint8_t source, bool oneByteHeader, unsigned long start) {
+  uint8_t bytes[SIM_ECU_MAX_BYTES];
+  int count = 0;
+
+  if (!kwpHeaders) {
+    // Example: 48 6B 10 41 0D 64 CS
+    bytes[count++] = 0x48;
+    bytes[count++] = 0x6B;
+    bytes[count++] = source;
+  } else if (oneByteHeader) {
+    bytes[count++] = length;
+  } else {
+    // Example: 83 F1 10 41 0D 64 CS
+    bytes[count++] = 0x80 | length;
+    bytes[count++] = 0xF1;
+    bytes[count++] = source;
+  }
+  for (int i=0; i<length && count<SIM_ECU_MAX_BYTES-1; i++) bytes[count++] = data[i];
+
+  uint8_t sum = 0;
+  for (int i=0; i<count; i++) sum += bytes[i];
+  bytes[count++] = sum;
+
+  lastResponseEnd = queueBytes(bytes, count, start, true);
+  stats.responses++;
+}
+
+// Queues bytes behind anything already going out, returning when the last one ends
+unsigned long SimEcu::queueBytes(uint8_t *bytes, int count, unsigned long start, bool noisy) {
+  unsigned long now = hostMicros();
+  unsigned long bitUs = 1000000L / baud;
+  unsigned long end = queueEnd();
+
+  if (SIM_TIME_AFTER(now, start)) start = now;
+  if (queueCount && SIM_TIME_AFTER(end, start)) start = end;
+
+  for (int i=0; i<count && queueCount<SIM_ECU_MAX_QUEUED; i++) {
+    uint8_t value = bytes[i];
+    if (noisy && chance(profile.noisePercent)) {
+      value ^= 1 << (nextRandom() % 8);
+      stats.corruptedBytes++;
+    }
+    queue[(queueHead + queueCount++) % SIM_ECU_MAX_QUEUED] = { start, bitUs, value };
+    stats.busyMicros += bitUs * 10;
+    start += bitUs * 10 + (i < count-1 ? pickMicros(&profile.p1) : 0);
+  }
+  return queueEnd();
+}
+
+unsigned long SimEcu::queueEnd() {
+  if (!queueCount) return hostMicros();
+  struct SimEcuQueuedByte *last = &queue[(queueHead + queueCount - 1) % SIM_ECU_MAX_QUEUED];
+  return last->start + last->bitUs * 10;
+}
+
+int SimEcu::ecuLevelAt(unsigned long time) {
+  // Line noise: short low glitches at random times
+  if (profile.glitchesPerSecond) {
+    if (SIM_TIME_AFTER(time, nextGlitch)) {
+      glitchEnd = nextGlitch + 5 + nextRandom() % 20;
+      nextGlitch = time + 1 + nextRandom() % (2000000UL / profile.glitchesPerSecond);
+      if (!SIM_TIME_AFTER(time, glitchEnd)) stats.glitches++;
+    }
+    if (!SIM_TIME_AFTER(time, glitchEnd)) return LOW;
+  }
+
+  // Reads come in time order, so finished bytes can be dropped
+  while (queueCount) {
+    struct SimEcuQueuedByte *head = &queue[queueHead];
+    if (!SIM_TIME_AFTER(time, head->start)) return HIGH;
+
+    unsigned long bit = (time - head->start) / head->bitUs;
+    if (bit < 10) {
+      if (bit == 0) return LOW;
+      if (bit == 9) return HIGH;
+      return (head->value >> (bit - 1)) & 1;
+    }
+    queueHead = (queueHead + 1) % SIM_ECU_MAX_QUEUED;
+    queueCount--;
+  }
+  return HIGH;
+}
+
+//------------------------------------------------------
+// Private (helpers)
+//------------------------------------------------------
+
+unsigned long SimEcu::pickMicros(struct SimEcuTiming *timing) {
+  if (timing->max <= timing->min) return timing->min;
+  return timing->min + nextRandom() % (timing->max - timing->min + 1);
+}
+
+// xorshift32, so runs are reproducible from the seed
+uint32_t SimEcu::nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+bool SimEcu::chance(uint8_t percent) {
+  return percent && (nextRandom() % 100) < percent;
+}
+
+// Triangle sweep, so gauges move through their whole range
+unsigned long SimEcu::pidValue(struct SimEcuPid *pid, unsigned long now) {
+  if (!pid->periodMs) return pid->minValue;
+  unsigned long phase = ((now - startMicros) / 1000) % pid->periodMs;
+  unsigned long half = pid->periodMs / 2;
+  long range = (long)pid->maxValue - (long)pid->minValue;
+  long position = (phase < half) ? phase : pid->periodMs - phase;
+  return pid->minValue + range * position / (long)(half ? half : 1);
+}
@@ -0,0 +1,175 @@
+///////////////////////////////////////////////////////////////
+// SIMECU.H
+// Simulated K-line ECU for the host build.  Talks bit-level
+// serial to VSerial through the shim's pin hooks on the virtual
+// clock, so whole sessions run much faster than real time.
+///////////////////////////////////////////////////////////////
+
+#ifndef _SIMECU
+#define _SIMECU
+
+#include <stdint.h>
+#include "HostShim.h"
+
+#define SIM_ECU_INIT_SLOW      0x01   // 5 baud address 0x33
+#define SIM_ECU_INIT_FAST      0x02   // 25ms wake-up pattern + StartCommunication
+
+#define SIM_ECU_MAX_PIDS       24
+#define SIM_ECU_MAX_DTCS       6
+#define SIM_ECU_MAX_BYTES      64     // Longest frame either way
+#define SIM_ECU_MAX_QUEUED     (2*SIM_ECU_MAX_BYTES)
+#define SIM_ECU_MAX_EDGES      12     // Tester edges kept for the byte being decoded
+
+#define SIM_ECU_NRC_CONDITIONS_NOT_CORRECT 0x22
+#define SIM_ECU_NRC_SERVICE_NOT_SUPPORTED  0x11
+#define SIM_ECU_NRC_SUBFUNCTION_NOT_SUPPORTED 0x12
+
+// Timing range in microseconds; each use picks uniformly between min and max
+struct SimEcuTiming {
+  unsigned long min;
+  unsigned long max;
+};
+
+// Mode 01 pid; the value sweeps between min and max and back over periodMs
+struct SimEcuPid {
+  uint8_t pid;
+  uint8_t length;
+  unsigned long minValue;
+  unsigned long maxValue;
+  unsigned long periodMs;
+};
+
+struct SimEcuProfile {
+  const char *name;
+  uint8_t initModes;              // SIM_ECU_INIT_*
+  uint8_t keyByte1;               // 08 08 / 94 94 answer with ISO 9141 headers, 8F xx with KWP headers
+  uint8_t keyByte2;
+  uint8_t address;                // Physical address, e.g. 0x10 engine
+  uint8_t secondAddress;          // Another ECU answering functional pid 00/20/40 and speed requests, 0 if none
+  unsigned long baud;
+  unsigned long highSpeedBaud;    // StartDiagnosticSession may switch to this, 0 refuses any
+
+  struct SimEcuTiming w1;         // Address to sync byte (60-300ms)
+  struct SimEcuTiming w2;         // Sync byte to key byte 1 (5-20ms)
+  struct SimEcuTiming w3;         // Between key bytes (0-20ms)
+  struct SimEcuTiming w4;         // Inverted key byte to inverted address (25-50ms)
+  struct SimEcuTiming p1;         // Between response bytes (0-20ms)
+  struct SimEcuTiming p2;         // Request end to response (25-50ms)
+  unsigned long p3MaxMs;          // Session drops without a request for this long
+
+  uint8_t nackPercent;            // Requests answered with 7F sid 22
+  uint8_t dropPercent;            // Requests not answered at all
+  uint8_t noisePercent;           // Response bytes with one bit flipped
+  unsigned int glitchesPerSecond; // Short low pulses on the idle line
+
+  uint8_t pidCount;
+  struct SimEcuPid pids[SIM_ECU_MAX_PIDS];
+  uint8_t dtcCount;
+  uint16_t dtcs[SIM_ECU_MAX_DTCS];
+  bool singlePidOnly;             // Mode 01 requests listing several pids go unanswered
+  bool secondAnswersFirst;        // The second ECU's frame goes out ahead of the primary's
+};
+
+// Counters since setup(), for checking a run
+struct SimEcuStats {
+  unsigned long slowInits;
+  unsigned long fastInits;
+  unsigned long sessions;         // Completed inits
+  unsigned long requests;         // Valid frames received in session
+  unsigned long responses;
+  unsigned long nacks;
+  unsigned long dropped;
+  unsigned long corruptedBytes;
+  unsigned long glitches;
+  unsigned long badFrames;        // Checksum or format errors in tester frames
+  unsigned long timeouts;         // Sessions dropped after P3
+  unsigned long busyMicros;       // Time either side was driving bytes
+  unsigned long testerEdges;      // Level changes the tester drove on the K-line
+  unsigned long multiPidIgnored;  // Mode 01 requests left unanswered for listing several pids
+};
+
+struct SimEcuQueuedByte {
+  unsigned long start;
+  unsigned long bitUs;
+  uint8_t value;
+};
+
+class SimEcu {
+  private:
+    struct SimEcuProfile profile;
+    struct SimEcuStats stats;
+    int inPin;
+    int outPin;
+    uint32_t randomState;
+    unsigned long startMicros;
+
+    // Tester side
+    int testerLevel;
+    unsigned long testerLowStart;
+    bool byteActive;
+    unsigned long byteStart;
+    unsigned long byteBitUs;
+    unsigned long edges[SIM_ECU_MAX_EDGES];
+    int edgeCount;
+    bool wakeUpSeen;
+    uint8_t frame[SIM_ECU_MAX_BYTES];
+    int frameLength;
+    unsigned long frameLastByteEnd;
+
+    // ECU side
+    int state;
+    bool kwpHeaders;
+    unsigned long lastRequestMicros;
+    unsigned long expectDeadline;
+    struct SimEcuQueuedByte queue[SIM_ECU_MAX_QUEUED];
+    int queueHead;
+    int queueCount;
+    unsigned long nextGlitch;
+    unsigned long glitchEnd;
+    unsigned long silentUntil;
+    unsigned long lastResponseEnd;
+    unsigned long baud;             // profile.baud, or highSpeedBaud in a session switched to it
+    unsigned long nextBaud;         // Taken up once the current response is queued, 0 if none
+    int ignoreCount;
+
+    void advance(unsigned long now);
+    void onTesterEdge(int level, unsigned long now);
+    void finishByte(unsigned long now);
+    int  testerLevelAt(unsigned long time);
+    void onTesterByte(uint8_t value, unsigned long end, bool slow);
+    bool frameComplete(unsigned long now);
+    void handleFrame(unsigned long end);
+    int  buildResponse(uint8_t *request, int length, uint8_t *response, bool second);
+    void sendFrame(uint8_t *data, int length, uint8_t source, bool oneByteHeader, unsigned long start);
+    unsigned long queueBytes(uint8_t *bytes, int count, unsigned long start, bool noisy);
+    unsigned long queueEnd();
+    int  ecuLevelAt(unsigned long time);
+    unsigned long pickMicros(struct SimEcuTiming *timing);
+    uint32_t nextRandom();
+    bool chance(uint8_t percent);
+    unsigned long pidValue(struct SimEcuPid *pid, unsigned long now);
+
+  public:
+    // Installs itself as the shim's pin provider; one simulated bus at a time
+    void setup(int inPin, int outPin, const struct SimEcuProfile *profile, uint32_t seed);
+    void stop();
+
+    struct SimEcuProfile *getProfile();   // May be changed between sessions
+    struct SimEcuStats *getStats();
+    bool isInSession();
+    unsigned long getLastResponseEnd();   // Virtual time the last response's checksum byte ends
+    unsigned long getBaud();
+
+    // Fault injection: ECU ignores the bus for a while and forgets the session
+    void dropOut(unsigned long ms);
+    // Or stays in session, at its baud, without answering the next count requests
+    void ignoreRequests(int count);
+
+    int  readPin(int pin, unsigned long micros);
+    void writePin(int pin, int value, unsigned long micros);
+
+    static const struct SimEcuProfile *findProfile(const char *name);
+    static const struct SimEcuProfile *profileAt(int index);   // NULL past the last one
+};
+
+#endif
@@ -0,0 +1,43 @@
+///////////////////////////////////////////////////////////////
+// ADAFRUIT_NEOPIXEL.H (host shim)
+// Keeps the pixel colors so a host program can inspect them
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOST_NEOPIXEL
+#define _HOST_NEOPIXEL
+
+#include <stdint.h>
+
+#define NEO_RGB     0x06
+#define NEO_GRB     0x52
+#define NEO_RGBW    0x1B
+#define NEO_KHZ800  0x0000
+#define NEO_KHZ400  0x0100
+
+#define HOST_NEOPIXEL_MAX_COUNT 32
+#define HOST_NEOPIXEL_MICROS_PER_PIXEL 30   // 24 bits at 800kHz, interrupts off on the part
+
+class Adafruit_NeoPixel {
+  private:
+    uint16_t count;
+    uint8_t  brightness;
+    uint32_t pixels[HOST_NEOPIXEL_MAX_COUNT];
+
+  public:
+    unsigned long showCount;   // Number of show() calls, each one a strip refresh on the part
+
+    Adafruit_NeoPixel(uint16_t n = 0, int16_t pin = -1, uint16_t type = NEO_GRB + NEO_KHZ800);
+    void begin() {}
+    void show();   // Advances the virtual clock as long as the strip refresh takes
+    void clear();
+    void setBrightness(uint8_t value) { brightness = value; }
+    uint8_t getBrightness() const { return brightness; }
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+    void setPixelColor(uint16_t n, uint32_t color);
+    uint32_t getPixelColor(uint16_t n) const;
+    uint16_t numPixels() const { return count; }
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "Adafruit_NeoPixel.h"
+#include "TM1637Display.h"
+#include "HostShim.h"
+
+///////////////////////////////////////////////////////////////
+// ARDUINO.CPP (host shim)
+///////////////////////////////////////////////////////////////
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+static unsigned long hs_micros = 0;
+static unsigned int  hs_microsPerCall = HOST_DEFAULT_MICROS_PER_CALL;
+static uint8_t hs_pins[HOST_PIN_COUNT];
+static uint8_t hs_pinModes[HOST_PIN_COUNT];
+static int     hs_analog[HOST_PIN_COUNT];
+static struct HostPinProvider *hs_pinProvider = NULL;
+static uint8_t hs_eeprom[HOST_EEPROM_SIZE];
+static bool    hs_eepromErased = false;
+static unsigned long hs_serialBaud = 0;
+static uint8_t hs_serialInput[HOST_SERIAL_BUFFER];
+static size_t  hs_serialInputHead = 0;
+static size_t  hs_serialInputCount = 0;
+static bool    hs_serialCapture = false;
+static char   *hs_serialOutput = NULL;
+static size_t  hs_serialOutputLength = 0;
+static size_t  hs_serialOutputSize = 0;
+static uintptr_t hs_stackHigh = 0;
+static uintptr_t hs_stackLow = 0;
+
+//------------------------------------------------------
+// Private
+//------------------------------------------------------
+
+static bool hs_validPin(int pin) {
+  return pin >= 0 && pin < HOST_PIN_COUNT;
+}
+
+// Clock and pin calls come from every depth of the sketch, so they
+// sample how far its stack has grown
+static void hs_tick() {
+  uintptr_t frame = (uintptr_t)__builtin_frame_address(0);
+  if (!hs_stackHigh || frame > hs_stackHigh) hs_stackHigh = frame;
+  if (!hs_stackLow || frame < hs_stackLow) hs_stackLow = frame;
+  hs_micros += hs_microsPerCall;
+}
+
+static uint8_t *hs_getEeprom() {
+  if (!hs_eepromErased) {
+    memset(hs_eeprom, 0xff, sizeof(hs_eeprom));
+    hs_eepromErased = true;
+  }
+  return hs_eeprom;
+}
+
+static size_t hs_printNumber(unsigned long value, int base, bool negative) {
+  char buf[8 * sizeof(long) + 2];
+  char *p = buf + sizeof(buf) - 1;
+  *p = 0;
+  if (base < 2) base = 10;
+  do {
+    int digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value);
+  if (negative) *--p = '-';
+  return Serial.print(p);
+}
+
+//------------------------------------------------------
+// Public (Arduino core)
+//------------------------------------------------------
+
+unsigned long millis() {
+  hs_tick();
+  return hs_micros / 1000;
+}
+
+unsigned long micros() {
+  hs_tick();
+  return hs_micros;
+}
+
+void delay(unsigned long ms) {
+  hs_micros += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  hs_micros += us;
+}
+
+void pinMode(int pin, int mode) {
+  if (!hs_validPin(pin)) return;
+  hs_pinModes[pin] = mode;
+  if (mode == INPUT_PULLUP) hs_pins[pin] = HIGH;
+}
+
+int digitalRead(int pin) {
+  hs_tick();
+  if (!hs_validPin(pin)) return LOW;
+  if (hs_pinProvider && hs_pinProvider->read) {
+    int value = hs_pinProvider->read(pin, hs_micros);
+    if (value >= 0) return value;
+  }
+  return hs_pins[pin];
+}
+
+void digitalWrite(int pin, int value) {
+  hs_tick();
+  if (!hs_validPin(pin)) return;
+  hs_pins[pin] = value ? HIGH : LOW;
+  if (hs_pinProvider && hs_pinProvider->write) hs_pinProvider->write(pin, hs_pins[pin], hs_micros);
+}
+
+int analogRead(int pin) {
+  hs_tick();
+  return hs_validPin(pin) ? hs_analog[pin] : 0;
+}
+
+long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+  srand(seed);
+}
+
+char *itoa(int value, char *buf, int radix) {
+  if (radix == 16) {
+    sprintf(buf, "%x", value);
+  } else {
+    sprintf(buf, "%d", value);
+  }
+  return buf;
+}
+
+char *dtostrf(double value, signed char width, unsigned char precision, char *buf) {
+  sprintf(buf, "%*.*f", width, precision, value);
+  return buf;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+//------------------------------------------------------
+// Public (HardwareSerial)
+//------------------------------------------------------
+
+void HardwareSerial::begin(unsigned long baud) {
+  hs_serialBaud = baud;
+}
+
+void HardwareSerial::end() {
+  hs_serialBaud = 0;
+}
+
+int HardwareSerial::available() {
+  return hs_serialInputCount;
+}
+
+int HardwareSerial::availableForWrite() {
+  // Written bytes leave instantly
+  return HOST_SERIAL_BUFFER - 1;
+}
+
+int HardwareSerial::read() {
+  if (!hs_serialInputCount) return -1;
+  int value = hs_serialInput[hs_serialInputHead];
+  hs_serialInputHead = (hs_serialInputHead + 1) % HOST_SERIAL_BUFFER;
+  hs_serialInputCount--;
+  return value;
+}
+
+int HardwareSerial::peek() {
+  return hs_serialInputCount ? hs_serialInput[hs_serialInputHead] : -1;
+}
+
+void HardwareSerial::flush() {
+  if (!hs_serialCapture) fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  if (!hs_serialCapture) {
+    putchar(value);
+    return 1;
+  }
+  if (hs_serialOutputLength >= hs_serialOutputSize) {
+    hs_serialOutputSize = hs_serialOutputSize ? hs_serialOutputSize * 2 : 256;
+    hs_serialOutput = (char *)realloc(hs_serialOutput, hs_serialOutputSize);
+  }
+  hs_serialOutput[hs_serialOutputLength++] = value;
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *bytes, size_t count) {
+  for (size_t i=0; i<count; i++) write(bytes[i]);
+  return count;
+}
+
+size_t HardwareSerial::print(const char *text) {
+  return write((const uint8_t *)text, strlen(text));
+}
+
+size_t HardwareSerial::print(char value) {
+  return write(value);
+}
+
+size_t HardwareSerial::print(int value, int base) {
+  return print((long)value, base);
+}
+
+size_t HardwareSerial::print(unsigned int value, int base) {
+  return print((unsigned long)value, base);
+}
+
+size_t HardwareSerial::print(long value, int base) {
+  if (base == DEC && value < 0) return hs_printNumber(-(unsigned long)value, base, true);
+  return hs_printNumber(value, base, false);
+}
+
+size_t HardwareSerial::print(unsigned long value, int base) {
+  return hs_printNumber(value, base, false);
+}
+
+size_t HardwareSerial::print(double value, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, value);
+  return print(buf);
+}
+
+size_t HardwareSerial::println() {
+  return print("\r\n");
+}
+
+//------------------------------------------------------
+// Public (EEPROM)
+//------------------------------------------------------
+
+uint8_t EEPROMClass::read(int address) {
+  return (address >= 0 && address < HOST_EEPROM_SIZE) ? hs_getEeprom()[address] : 0xff;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address >= 0 && address < HOST_EEPROM_SIZE) hs_getEeprom()[address] = value;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if (read(address) != value) write(address, value);
+}
+
+uint16_t EEPROMClass::length() {
+  return HOST_EEPROM_SIZE;
+}
+
+//------------------------------------------------------
+// Public (drivers)
+//------------------------------------------------------
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, int16_t pin, uint16_t type) {
+  count = min(n, (uint16_t)HOST_NEOPIXEL_MAX_COUNT);
+  brightness = 255;
+  showCount = 0;
+  clear();
+}
+
+void Adafruit_NeoPixel::show() {
+  showCount++;
+  hs_micros += count * HOST_NEOPIXEL_MICROS_PER_PIXEL;
+}
+
+void Adafruit_NeoPixel::clear() {
+  memset(pixels, 0, sizeof(pixels));
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  setPixelColor(n, Color(r, g, b));
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+  setPixelColor(n, ((uint32_t)w << 24) | Color(r, g, b));
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t color) {
+  if (n < count) pixels[n] = color;
+}
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
+  return n < count ? pixels[n] : 0;
+}
+
+TM1637Display::TM1637Display(uint8_t clockPin, uint8_t dataPin, unsigned int bitDelay) {
+  memset(segments, 0, sizeof(segments));
+  brightness = 7;
+  on = true;
+  writeCount = 0;
+  this->bitDelay = bitDelay;
+}
+
+void TM1637Display::setBrightness(uint8_t value, bool displayOn) {
+  brightness = value & 7;
+  on = displayOn;
+}
+
+void TM1637Display::setSegments(const uint8_t *data, uint8_t length, uint8_t pos) {
+  for (int i=0; i<length && pos + i < HOST_TM1637_DIGITS; i++) segments[pos + i] = data[i];
+  writeCount++;
+  hs_micros += (unsigned long)bitDelay * HOST_TM1637_TRANSFER_DELAYS(length);
+}
+
+void TM1637Display::clear() {
+  uint8_t blank[HOST_TM1637_DIGITS] = { 0 };
+  setSegments(blank);
+}
+
+//------------------------------------------------------
+// Public (host control)
+//------------------------------------------------------
+
+unsigned long hostMicros() {
+  return hs_micros;
+}
+
+void hostAdvanceMicros(unsigned long us) {
+  hs_micros += us;
+}
+
+void hostSetMicrosPerCall(unsigned int us) {
+  hs_microsPerCall = us;
+}
+
+void hostResetClock() {
+  hs_micros = 0;
+}
+
+size_t hostGetStackBytes() {
+  return hs_stackHigh - hs_stackLow;
+}
+
+void hostSetPin(int pin, int value) {
+  if (hs_validPin(pin)) hs_pins[pin] = value ? HIGH : LOW;
+}
+
+int hostGetPin(int pin) {
+  return hs_validPin(pin) ? hs_pins[pin] : LOW;
+}
+
+int hostGetPinMode(int pin) {
+  return hs_validPin(pin) ? hs_pinModes[pin] : INPUT;
+}
+
+void hostSetAnalog(int pin, int value) {
+  if (hs_validPin(pin)) hs_analog[pin] = value;
+}
+
+void hostSetPinProvider(struct HostPinProvider *provider) {
+  hs_pinProvider = provider;
+}
+
+void hostEraseEeprom() {
+  hs_eepromErased = false;
+  hs_getEeprom();
+}
+
+uint8_t *hostGetEeprom() {
+  return hs_getEeprom();
+}
+
+void hostSerialInput(const char *text) {
+  hostSerialInputBytes((const uint8_t *)text, strlen(text));
+}
+
+// Bytes beyond the receive buffer are lost, as on the part
+void hostSerialInputBytes(const uint8_t *bytes, size_t count) {
+  for (size_t i=0; i<count && hs_serialInputCount < HOST_SERIAL_BUFFER; i++) {
+    hs_serialInput[(hs_serialInputHead + hs_serialInputCount++) % HOST_SERIAL_BUFFER] = bytes[i];
+  }
+}
+
+void hostSerialCapture(bool enabled) {
+  hs_serialCapture = enabled;
+}
+
+size_t hostSerialOutput(char *buf, size_t maxBytes) {
+  size_t count = min(hs_serialOutputLength, maxBytes);
+  memcpy(buf, hs_serialOutput, count);
+  memmove(hs_serialOutput, hs_serialOutput + count, hs_serialOutputLength - count);
+  hs_serialOutputLength -= count;
+  return count;
+}
+
+unsigned long hostSerialBaud() {
+  return hs_serialBaud;
+}
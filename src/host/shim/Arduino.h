@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////
+// ARDUINO.H (host shim)
+// Just enough of the Arduino core to build the sketch modules
+// with g++; time is virtual and pins are simulated, see HostShim.h
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOST_ARDUINO
+#define _HOST_ARDUINO
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <math.h>
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) ((char *)(s))
+#define F(s) (s)
+#define pgm_read_byte(p)      (*(const uint8_t *)(p))
+#define pgm_read_byte_near(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p)      (*(const uint16_t *)(p))
+#define pgm_read_word_near(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p)     (*(const uint32_t *)(p))
+#define pgm_read_float(p)     (*(const float *)(p))
+#define pgm_read_ptr(p)       (*(void * const *)(p))
+#define strcpy_P       strcpy
+#define strncpy_P      strncpy
+#define strlen_P       strlen
+#define strcmp_P       strcmp
+#define strcasecmp_P   strcasecmp
+#define strncasecmp_P  strncasecmp
+#define memcpy_P       memcpy
+#define snprintf_P     snprintf
+#define sprintf_P      sprintf
+
+#define HIGH 1
+#define LOW  0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define LED_BUILTIN 13
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+int  digitalRead(int pin);
+void digitalWrite(int pin, int value);
+int  analogRead(int pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+char *itoa(int value, char *buf, int radix);
+char *dtostrf(double value, signed char width, unsigned char precision, char *buf);
+
+void noInterrupts();
+void interrupts();
+
+// Templates rather than the core's macros, so arguments are evaluated once
+template<class A, class B> auto min(A a, B b) -> decltype(a + b) { return a < b ? a : b; }
+template<class A, class B> auto max(A a, B b) -> decltype(a + b) { return a > b ? a : b; }
+template<class T, class L, class H> T constrain(T x, L low, H high) { return x < low ? low : x > high ? high : x; }
+
+#define DEC 10
+#define HEX 16
+
+// Hardware UART; output goes to the host's capture (or stdout), input comes from hostSerialInput()
+class HardwareSerial {
+  public:
+    void   begin(unsigned long baud);
+    void   end();
+    int    available();
+    int    availableForWrite();
+    int    read();
+    int    peek();
+    void   flush();
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *bytes, size_t count);
+    size_t print(const char *text);
+    size_t print(char value);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t println();
+    template<class T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template<class T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,20 @@
+///////////////////////////////////////////////////////////////
+// EEPROM.H (host shim)
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOST_EEPROM
+#define _HOST_EEPROM
+
+#include <stdint.h>
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void    write(int address, uint8_t value);
+    void    update(int address, uint8_t value);
+    uint16_t length();
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
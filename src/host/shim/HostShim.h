@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////
+// HOSTSHIM.H
+// Host-side control of the Arduino shim: virtual clock,
+// simulated pins, EEPROM and UART
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOST_SHIM
+#define _HOST_SHIM
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HOST_PIN_COUNT      22
+#define HOST_EEPROM_SIZE    1024
+#define HOST_SERIAL_BUFFER  64     // Same as the Nano's UART buffers
+
+// Every call that reads the clock or a pin costs this much virtual time,
+// so polling loops advance like they would on the 16MHz part
+#define HOST_DEFAULT_MICROS_PER_CALL 4
+
+// Lets a simulation drive inputs and observe outputs, e.g. an ECU on the K-line.
+// Either member may be NULL.
+struct HostPinProvider {
+  int  (*read)(int pin, unsigned long micros);              // -1 to use the last hostSetPin() level
+  void (*write)(int pin, int value, unsigned long micros);
+};
+
+// Virtual clock
+unsigned long hostMicros();
+void hostAdvanceMicros(unsigned long us);
+void hostSetMicrosPerCall(unsigned int us);
+void hostResetClock();
+
+// Deepest stack seen by the clock and pin calls, below the shallowest;
+// host frames are larger than the part's
+size_t hostGetStackBytes();
+
+// Pins
+void hostSetPin(int pin, int value);
+int  hostGetPin(int pin);
+int  hostGetPinMode(int pin);
+void hostSetAnalog(int pin, int value);
+void hostSetPinProvider(struct HostPinProvider *provider);
+
+// EEPROM, erased to 0xff like a new part
+void hostEraseEeprom();
+uint8_t *hostGetEeprom();
+
+// UART; output is echoed to stdout unless captured
+void hostSerialInput(const char *text);
+void hostSerialInputBytes(const uint8_t *bytes, size_t count);
+void hostSerialCapture(bool enabled);
+size_t hostSerialOutput(char *buf, size_t maxBytes);   // Takes captured output, returns its length
+unsigned long hostSerialBaud();
+
+#endif
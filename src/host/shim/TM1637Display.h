@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////
+// TM1637DISPLAY.H (host shim)
+// Keeps the digit segments so a host program can inspect them
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOST_TM1637
+#define _HOST_TM1637
+
+#include <stdint.h>
+
+#define SEG_A   0b00000001
+#define SEG_B   0b00000010
+#define SEG_C   0b00000100
+#define SEG_D   0b00001000
+#define SEG_E   0b00010000
+#define SEG_F   0b00100000
+#define SEG_G   0b01000000
+#define SEG_DP  0b10000000
+
+#define HOST_TM1637_DIGITS 4
+
+// Bit delays in one setSegments() transfer of the library: three commands
+// (data, address, display control) plus the data bytes, 27 delays a byte
+// with its ack, and 4 per start and stop pair
+#define HOST_TM1637_TRANSFER_DELAYS(_length) (12 + 27 * (3 + (_length)))
+
+class TM1637Display {
+  public:
+    uint8_t segments[HOST_TM1637_DIGITS];
+    uint8_t brightness;
+    bool    on;
+    unsigned long writeCount;   // Number of setSegments() calls, each one a bus transfer on the part
+    unsigned int  bitDelay;     // Microseconds; transfers advance the virtual clock as long as they would take
+
+    TM1637Display(uint8_t clockPin, uint8_t dataPin, unsigned int bitDelay = 100);
+    void setBrightness(uint8_t value, bool displayOn = true);
+    void setSegments(const uint8_t *data, uint8_t length = 4, uint8_t pos = 0);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,13 @@
+///////////////////////////////////////////////////////////////
+// TM1637TINYDISPLAY.H (host shim)
+// The WOKWI build's driver has the same interface
+///////////////////////////////////////////////////////////////
+
+#ifndef _HOST_TM1637TINY
+#define _HOST_TM1637TINY
+
+#include "TM1637Display.h"
+
+typedef TM1637Display TM1637TinyDisplay;
+
+#endif